@@ -0,0 +1,145 @@
+#pragma once
+
+#include <Bencode/bencodeDecoder.h>
+#include <Bencode/bencodeEncoder.h>
+#include <Bencode/bencodeValue.h>
+#include <Crypto/sha1.h>
+#include <Torrent/torrentFile.h>
+#include <Torrent/torrentParser.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Generated inputs shared by the benchmarks. Everything is derived from the
+// arguments alone, so every run (and every machine) sees the same bytes.
+namespace corpus {
+
+using bnode = btc::BNode;
+
+inline const std::size_t pieceLength = 256 * 1024;
+
+inline std::string makeBytes(std::size_t size, std::uint32_t seed) {
+  std::string out(size, '\0');
+  std::uint32_t x = seed * 2654435761u + 1;
+  for (auto &c : out) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c = static_cast<char>(x & 0xFF);
+  }
+  return out;
+}
+
+// A metainfo file with `pieces` SHA-1 hashes. With files == 0 it is a
+// single-file torrent, otherwise the length is spread over `files` entries
+// grouped 1000 to a directory.
+inline std::string makeTorrent(std::size_t files, std::size_t pieces) {
+  std::int64_t total = static_cast<std::int64_t>(pieces * pieceLength);
+
+  bnode::dict_t info;
+  info["name"] = bnode(std::string("generated"));
+  info["piece length"] = bnode(static_cast<std::int64_t>(pieceLength));
+  info["pieces"] = bnode(makeBytes(pieces * 20, 1));
+
+  if (files == 0) {
+    info["length"] = bnode(total);
+  } else {
+    bnode::list_t list;
+    list.reserve(files);
+    std::int64_t each = total / static_cast<std::int64_t>(files);
+    for (std::size_t i = 0; i < files; i++) {
+      bnode::list_t path;
+      path.emplace_back(std::string("dir") + std::to_string(i / 1000));
+      path.emplace_back(std::string("file") + std::to_string(i) + ".bin");
+      std::int64_t length = each > 0 ? each : 1;
+      if (i == files - 1)
+        length += total - each * static_cast<std::int64_t>(files);
+
+      bnode::dict_t file;
+      file["length"] = bnode(length);
+      file["path"] = bnode(std::move(path));
+      list.emplace_back(std::move(file));
+    }
+    info["files"] = bnode(std::move(list));
+  }
+
+  bnode::list_t tier;
+  tier.emplace_back(std::string("http://tracker.example.org/announce"));
+  bnode::list_t announceList;
+  announceList.emplace_back(std::move(tier));
+
+  bnode::dict_t root;
+  root["announce"] = bnode(std::string("http://tracker.example.org/announce"));
+  root["announce-list"] = bnode(std::move(announceList));
+  root["comment"] = bnode(std::string("generated for benchmarking"));
+  root["created by"] = bnode(std::string("btc_bench"));
+  root["creation date"] = bnode(static_cast<std::int64_t>(1700000000));
+  root["info"] = bnode(std::move(info));
+  return btc::BencodeEncoder::encode(bnode(std::move(root)));
+}
+
+// An announce reply carrying `peers` peers, either in the compact 6-byte
+// form or as a list of dictionaries.
+inline std::string makeAnnounce(std::size_t peers, bool compact) {
+  bnode::dict_t root;
+  root["complete"] = bnode(static_cast<std::int64_t>(peers / 2));
+  root["incomplete"] = bnode(static_cast<std::int64_t>(peers - peers / 2));
+  root["interval"] = bnode(static_cast<std::int64_t>(1800));
+
+  if (compact) {
+    std::string packed = makeBytes(peers * 6, 2);
+    for (std::size_t i = 0; i < peers; i++)
+      packed[i * 6] = static_cast<char>(1 + i % 223);
+    root["peers"] = bnode(std::move(packed));
+  } else {
+    bnode::list_t list;
+    list.reserve(peers);
+    for (std::size_t i = 0; i < peers; i++) {
+      bnode::dict_t peer;
+      peer["ip"] = bnode(std::to_string(1 + i % 223) + "." +
+                         std::to_string(i / 256 % 256) + "." +
+                         std::to_string(i % 256) + ".1");
+      peer["peer id"] = bnode(makeBytes(20, static_cast<std::uint32_t>(i)));
+      peer["port"] = bnode(static_cast<std::int64_t>(6881 + i % 1000));
+      list.emplace_back(std::move(peer));
+    }
+    root["peers"] = bnode(std::move(list));
+  }
+  return btc::BencodeEncoder::encode(bnode(std::move(root)));
+}
+
+// `pieces` pieces of content whose piece hashes match, so a write cache
+// accepts it.
+struct HashedTorrent {
+  std::string content;
+  btc::TorrentFile torrent;
+};
+
+inline HashedTorrent makeHashedTorrent(std::size_t pieces,
+                                       std::uint32_t seed) {
+  std::string content = makeBytes(pieces * pieceLength, seed);
+  std::string hashes;
+  for (std::size_t i = 0; i < pieces; i++) {
+    auto digest = btc::Sha1::hash(
+        std::string_view(content).substr(i * pieceLength, pieceLength));
+    hashes.append(digest.begin(), digest.end());
+  }
+
+  bnode::dict_t info;
+  info["length"] = bnode(static_cast<std::int64_t>(content.size()));
+  info["name"] = bnode(std::string("hashed"));
+  info["piece length"] = bnode(static_cast<std::int64_t>(pieceLength));
+  info["pieces"] = bnode(std::move(hashes));
+  bnode::dict_t root;
+  root["announce"] = bnode(std::string("http://a.b/announce"));
+  root["info"] = bnode(std::move(info));
+
+  btc::BencodeDecoder decoder;
+  auto torrent = *btc::TorrentParser::parseContent(
+      btc::BencodeEncoder::encode(bnode(std::move(root))), decoder);
+  return HashedTorrent{std::move(content), std::move(torrent)};
+}
+
+} // namespace corpus
@@ -0,0 +1,148 @@
+#include "benchCorpus.h"
+#include <Bencode/bencodeDecoder.h>
+#include <Bencode/bencodeEncoder.h>
+#include <Bencode/bencodeScanner.h>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using bencodeDecoder = btc::BencodeDecoder;
+using bencodeEncoder = btc::BencodeEncoder;
+using bencodeScanner = btc::BencodeScanner;
+
+namespace {
+
+const bencodeScanner::Isa detectedIsa = bencodeScanner::getIsa();
+
+// A full scrape reply listing `torrents` info hashes.
+std::string makeScrape(std::size_t torrents) {
+  std::string out = "d5:filesd";
+  for (std::size_t i = 0; i < torrents; i++) {
+    std::string hash(20, '\0');
+    for (std::size_t b = 0; b < hash.size(); b++)
+      hash[b] = static_cast<char>((i * 131 + b * 7) & 0xFF);
+    out += "20:" + hash;
+    out += "d8:completei" + std::to_string(i % 5000) + "e10:downloadedi" +
+           std::to_string(i * 17) + "e10:incompletei" +
+           std::to_string(i % 300) + "ee";
+  }
+  out += "ee";
+  return out;
+}
+
+// Digit runs of the given length, each terminated like a string length.
+std::string makeDigitRuns(std::size_t runLength, std::size_t bytes) {
+  std::string out;
+  while (out.size() < bytes) {
+    for (std::size_t i = 0; i < runLength; i++)
+      out.push_back(static_cast<char>('1' + (out.size() % 9)));
+    out.push_back(':');
+  }
+  return out;
+}
+
+bool useIsa(benchmark::State &state) {
+  auto isa = static_cast<bencodeScanner::Isa>(state.range(0));
+  if (bencodeScanner::setIsa(isa))
+    return true;
+  state.SkipWithError("instruction set not supported on this CPU");
+  return false;
+}
+
+void BM_DigitRun(benchmark::State &state) {
+  if (!useIsa(state))
+    return;
+  std::string input = makeDigitRuns(state.range(1), 1 << 20);
+
+  for (auto _ : state) {
+    std::string_view rest = input;
+    std::size_t total = 0;
+    while (!rest.empty()) {
+      std::size_t run = bencodeScanner::digitRun(rest);
+      total += run;
+      rest.remove_prefix(run + 1);
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  bencodeScanner::setIsa(detectedIsa);
+}
+
+void BM_DecodeScrape(benchmark::State &state) {
+  if (!useIsa(state))
+    return;
+  std::string input = makeScrape(100'000);
+
+  for (auto _ : state) {
+    auto res = bencodeDecoder::decodeView(input);
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  bencodeScanner::setIsa(detectedIsa);
+}
+
+// Indexed by the benchmark argument: a small single-file torrent, a
+// 100k-file torrent, a 50 MB pieces blob and a 10k-peer compact announce.
+const std::string &document(std::int64_t index) {
+  static const std::vector<std::string> documents = {
+      corpus::makeTorrent(0, 64),
+      corpus::makeTorrent(100'000, 16'384),
+      corpus::makeTorrent(0, 50 * 1024 * 1024 / 20),
+      corpus::makeAnnounce(10'000, true),
+  };
+  return documents[index];
+}
+
+void BM_Decode(benchmark::State &state) {
+  const std::string &input = document(state.range(0));
+
+  for (auto _ : state) {
+    auto res = bencodeDecoder::decode(input);
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void BM_DecodeView(benchmark::State &state) {
+  const std::string &input = document(state.range(0));
+
+  for (auto _ : state) {
+    auto res = bencodeDecoder::decodeView(input);
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void BM_Encode(benchmark::State &state) {
+  const std::string &input = document(state.range(0));
+  auto node = bencodeDecoder::decode(input);
+  if (!node) {
+    state.SkipWithError("corpus does not decode");
+    return;
+  }
+
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    bencodeEncoder::encode(*node, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void isaArgs(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"isa", "digits"});
+  for (int isa : {0, 1, 2})
+    for (int digits : {2, 8, 32})
+      b->Args({isa, digits});
+}
+
+} // namespace
+
+BENCHMARK(BM_DigitRun)->Apply(isaArgs);
+BENCHMARK(BM_DecodeScrape)->ArgName("isa")->DenseRange(0, 2);
+BENCHMARK(BM_Decode)->ArgName("corpus")->DenseRange(0, 3);
+BENCHMARK(BM_DecodeView)->ArgName("corpus")->DenseRange(0, 3);
+BENCHMARK(BM_Encode)->ArgName("corpus")->DenseRange(0, 3);
@@ -0,0 +1,235 @@
+#include "benchCorpus.h"
+#include <Bencode/bencodeDecoder.h>
+#include <Storage/diskIo.h>
+#include <Storage/diskStorage.h>
+#include <Storage/readCache.h>
+#include <Storage/writeCache.h>
+#include <Torrent/torrentParser.h>
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <bufferPool.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <threadPool.h>
+#include <vector>
+
+using torrentParser = btc::TorrentParser;
+using bencodeDecoder = btc::BencodeDecoder;
+
+namespace {
+
+const std::size_t blockSize = 16 * 1024;
+
+// A 256 MiB single-file torrent stored sparsely under the temp directory.
+const btc::TorrentFile &torrent() {
+  static const btc::TorrentFile parsed = [] {
+    bencodeDecoder decoder;
+    return *torrentParser::parseContent(corpus::makeTorrent(0, 1024),
+                                        decoder);
+  }();
+  return parsed;
+}
+
+// `batch` random 16 KiB blocks are queued, submitted together and waited
+// for; the blocks are read when `writing` is 0 and written otherwise.
+void BM_DiskIo(benchmark::State &state) {
+  auto backend = static_cast<btc::DiskBackend>(state.range(0));
+  bool writing = state.range(1) != 0;
+  std::size_t batch = state.range(2);
+
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_bench_disk";
+  auto storageRes = btc::DiskStorage::open(torrent(), root);
+  if (!storageRes) {
+    state.SkipWithError("cannot create the storage files");
+    return;
+  }
+
+  btc::net::io_context ctx;
+  btc::ThreadPool pool(4);
+  auto io = btc::DiskIo::create(ctx, *storageRes, pool, backend);
+  if (io->getBackend() != backend) {
+    state.SkipWithError("io_uring is not available");
+    return;
+  }
+
+  const btc::FileMap &files = storageRes->getFileMap();
+  std::size_t blocksPerPiece = files.getPieceLength() / blockSize;
+  std::string buffer = corpus::makeBytes(batch * blockSize, 3);
+  std::uint32_t x = 12345;
+  std::size_t done = 0;
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < batch; i++) {
+      x = x * 1664525u + 1013904223u;
+      std::size_t piece = (x >> 8) % files.getPieceCount();
+      std::size_t offset = (x & 0xFF) % blocksPerPiece * blockSize;
+      std::span<char> block(buffer.data() + i * blockSize, blockSize);
+      auto onDone = [&](auto res) {
+        if (res)
+          done++;
+      };
+      if (writing)
+        io->asyncWrite(piece, offset, block, onDone);
+      else
+        io->asyncRead(piece, offset, block, onDone);
+    }
+    io->submit();
+    ctx.restart();
+    ctx.run();
+  }
+  if (done != state.iterations() * batch)
+    state.SkipWithError("a request failed");
+  state.SetBytesProcessed(state.iterations() * batch * blockSize);
+
+  io.reset();
+  std::filesystem::remove_all(root);
+}
+
+// 16 MiB of content whose piece hashes match.
+const corpus::HashedTorrent &hashedTorrent() {
+  static const corpus::HashedTorrent hashed = corpus::makeHashedTorrent(64, 4);
+  return hashed;
+}
+
+// Writes every 16 KiB block of the torrent in random order, straight to
+// DiskStorage (cached == 0) or through a WriteCache that holds all pieces
+// and hashes each one as it completes (cached == 1).
+void BM_WriteCache(benchmark::State &state) {
+  bool cached = state.range(0) != 0;
+  const corpus::HashedTorrent &hashed = hashedTorrent();
+
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_bench_write_cache";
+  auto storageRes = btc::DiskStorage::open(hashed.torrent, root);
+  if (!storageRes) {
+    state.SkipWithError("cannot create the storage files");
+    return;
+  }
+
+  std::size_t blocksPerPiece = corpus::pieceLength / blockSize;
+  std::vector<std::size_t> order(hashed.content.size() / blockSize);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(5));
+
+  for (auto _ : state) {
+    btc::WriteCache cache(*storageRes, hashed.torrent,
+                          hashed.content.size());
+    for (std::size_t block : order) {
+      std::size_t piece = block / blocksPerPiece;
+      std::size_t offset = block % blocksPerPiece * blockSize;
+      std::string_view data = std::string_view(hashed.content)
+                                  .substr(block * blockSize, blockSize);
+      bool ok = cached ? cache.write(piece, offset, data).has_value()
+                       : storageRes->write(piece, offset, data).has_value();
+      if (!ok) {
+        state.SkipWithError("a write failed");
+        return;
+      }
+    }
+    if (!cache.flushAll())
+      state.SkipWithError("flushing failed");
+  }
+  state.SetBytesProcessed(state.iterations() * hashed.content.size());
+  state.counters["diskWrites"] = static_cast<double>(
+      cached ? hashed.torrent.getPieces().size() : order.size());
+  std::filesystem::remove_all(root);
+}
+
+// Peers read whole pieces block by block, most of them from a few popular
+// pieces: the piece index is skewed towards 0. Reads go straight to
+// DiskStorage (cached == 0) or through a 4 MiB ReadCache (cached == 1).
+void BM_ReadCache(benchmark::State &state) {
+  bool cached = state.range(0) != 0;
+  const corpus::HashedTorrent &hashed = hashedTorrent();
+
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_bench_read_cache";
+  auto storageRes = btc::DiskStorage::open(hashed.torrent, root);
+  if (!storageRes || !storageRes->write(0, 0, hashed.content)) {
+    state.SkipWithError("cannot create the storage files");
+    return;
+  }
+
+  btc::ReadCache cache(4 * 1024 * 1024);
+  const std::string &infoHash = hashed.torrent.getInfoHash();
+  std::string block(blockSize, '\0');
+  std::uint32_t x = 777;
+
+  for (auto _ : state) {
+    x = x * 1664525u + 1013904223u;
+    std::size_t r = (x >> 8) % 64;
+    std::size_t piece = r * r / 64;
+    for (std::size_t offset = 0; offset < corpus::pieceLength;
+         offset += blockSize) {
+      bool ok = cached
+                    ? cache.read(infoHash, *storageRes, piece, offset, block)
+                          .has_value()
+                    : storageRes->read(piece, offset, block).has_value();
+      if (!ok) {
+        state.SkipWithError("a read failed");
+        return;
+      }
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * corpus::pieceLength);
+  auto stats = cache.getStats();
+  if (cached)
+    state.counters["hitRate"] =
+        static_cast<double>(stats.hits) /
+        static_cast<double>(stats.hits + stats.misses);
+  std::filesystem::remove_all(root);
+}
+
+// Takes and returns `batch` 16 KiB buffers, from a BufferPool (pooled == 1)
+// or from aligned_alloc (pooled == 0).
+void BM_BlockBuffers(benchmark::State &state) {
+  bool pooled = state.range(0) != 0;
+  std::size_t batch = state.range(1);
+  btc::BufferPool pool(blockSize, batch);
+  std::vector<btc::Buffer> buffers(batch);
+  std::vector<char *> raw(batch);
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < batch; i++) {
+      if (pooled)
+        buffers[i] = *pool.acquire();
+      else
+        raw[i] = static_cast<char *>(
+            std::aligned_alloc(btc::BufferPool::pageSize, blockSize));
+    }
+    for (std::size_t i = 0; i < batch; i++) {
+      if (pooled) {
+        benchmark::DoNotOptimize(buffers[i].data());
+        buffers[i] = btc::Buffer();
+      } else {
+        benchmark::DoNotOptimize(raw[i]);
+        std::free(raw[i]);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+  auto stats = pool.getStats();
+  state.counters["peakInUse"] = static_cast<double>(stats.peakInUse);
+}
+
+} // namespace
+
+BENCHMARK(BM_BlockBuffers)
+    ->ArgNames({"pooled", "batch"})
+    ->ArgsProduct({{0, 1}, {1, 256}});
+
+BENCHMARK(BM_ReadCache)->ArgName("cached")->DenseRange(0, 1)->UseRealTime();
+
+BENCHMARK(BM_WriteCache)->ArgName("cached")->DenseRange(0, 1)->UseRealTime();
+
+BENCHMARK(BM_DiskIo)
+    ->ArgNames({"backend", "write", "batch"})
+    ->ArgsProduct({{0, 1}, {0, 1}, {1, 64}})
+    ->UseRealTime();
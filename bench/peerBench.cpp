@@ -0,0 +1,449 @@
+#include "benchCorpus.h"
+#include <Peer/bitfield.h>
+#include <Peer/choker.h>
+#include <Peer/peerWire.h>
+#include <Peer/piecePicker.h>
+#include <Peer/ringBuffer.h>
+#include <Peer/swarm.h>
+#include <Storage/diskStorage.h>
+#include <Storage/writeCache.h>
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using peerWire = btc::PeerWire;
+using bitfield = btc::Bitfield;
+
+namespace {
+
+const bitfield::Isa detectedIsa = bitfield::getIsa();
+
+// A stream of piece messages of `block` bytes, interleaved with have
+// messages, arriving in reads of `chunk` bytes that ignore message
+// boundaries. Each message is framed in place in a RingBuffer.
+void BM_FramePeerMessages(benchmark::State &state) {
+  std::size_t block = state.range(0);
+  std::size_t chunk = state.range(1);
+
+  std::string stream;
+  std::string data = corpus::makeBytes(block, 1);
+  for (std::uint32_t i = 0; i < 64; i++) {
+    peerWire::appendPieceHeader(
+        stream, {i, 0, static_cast<std::uint32_t>(block)});
+    stream += data;
+    peerWire::appendHave(stream, i);
+  }
+
+  auto ringRes = btc::RingBuffer::create(256 * 1024);
+  if (!ringRes) {
+    state.SkipWithError("cannot map the ring buffer");
+    return;
+  }
+  btc::RingBuffer &ring = *ringRes;
+
+  std::size_t messages = 0;
+  for (auto _ : state) {
+    for (std::size_t offset = 0; offset < stream.size(); offset += chunk) {
+      std::size_t n = std::min(chunk, stream.size() - offset);
+      std::memcpy(ring.prepare().data(), stream.data() + offset, n);
+      ring.commit(n);
+
+      btc::PeerMessage message;
+      for (;;) {
+        auto frameRes = peerWire::frame(ring.data(), block + 9, message);
+        if (!frameRes || *frameRes == 0)
+          break;
+        benchmark::DoNotOptimize(message.payload.data());
+        ring.consume(*frameRes);
+        messages++;
+      }
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * stream.size());
+  state.SetItemsProcessed(static_cast<std::int64_t>(messages));
+}
+
+// Rarest-first picking over `pieces` pieces of four blocks, with 50 peers
+// that each have half of the torrent. Every iteration picks a whole piece
+// for one peer, completes it and applies a have message from another, the
+// way a session drives the picker.
+void BM_PickPieces(benchmark::State &state) {
+  std::size_t pieces = state.range(0);
+  const std::size_t peerCount = 50;
+  const std::size_t pieceLength = 64 * 1024;
+
+  std::mt19937 rng(7);
+  std::vector<bitfield> peers(peerCount, bitfield(pieces));
+  for (auto &peer : peers)
+    for (std::size_t i = 0; i < pieces; i++)
+      if (rng() & 1)
+        peer.set(i);
+
+  auto makePicker = [&] {
+    auto picker = std::make_unique<btc::PiecePicker>(
+        pieces, pieceLength, pieces * pieceLength);
+    for (const auto &peer : peers)
+      picker->addPeer(peer);
+    return picker;
+  };
+  auto picker = makePicker();
+
+  std::vector<btc::BlockRequest> out;
+  std::size_t peer = 0;
+  for (auto _ : state) {
+    if (picker->isComplete()) {
+      state.PauseTiming();
+      picker = makePicker();
+      state.ResumeTiming();
+    }
+    out.clear();
+    picker->pick(peers[peer], 4, out);
+    for (const auto &block : out)
+      if (picker->received(block))
+        picker->setHave(block.piece);
+    picker->incrementPiece(rng() % pieces);
+    peer = (peer + 1) % peerCount;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Picking for a peer that has only common pieces, every 100th piece of the
+// torrent, while each of the others is with a single peer and so is rarer.
+// Every iteration picks and completes one piece.
+void BM_PickCommonPieces(benchmark::State &state) {
+  std::size_t pieces = state.range(0);
+  const std::size_t pieceLength = 64 * 1024;
+
+  bitfield own(pieces), rest(pieces);
+  for (std::size_t i = 0; i < pieces; i++) {
+    if (i % 100 == 0)
+      own.set(i);
+    else
+      rest.set(i);
+  }
+  auto makePicker = [&] {
+    auto picker = std::make_unique<btc::PiecePicker>(
+        pieces, pieceLength, pieces * pieceLength, pieceLength);
+    picker->setRandomFirst(0);
+    picker->addPeer(rest);
+    for (int i = 0; i < 3; i++)
+      picker->addPeer(own);
+    return picker;
+  };
+  auto picker = makePicker();
+
+  std::vector<btc::BlockRequest> out;
+  for (auto _ : state) {
+    out.clear();
+    if (picker->pick(own, 1, out) == 0) {
+      state.PauseTiming();
+      picker = makePicker();
+      state.ResumeTiming();
+      continue;
+    }
+    picker->received(out[0]);
+    picker->setHave(out[0].piece);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A peer connecting to and leaving a 500k-piece torrent: its bitfield is
+// added to and taken from the availability counts, and checked for pieces
+// we lack. `percent` of its pieces are set; 100 is a seed.
+void BM_BitfieldConnect(benchmark::State &state) {
+  auto isa = static_cast<bitfield::Isa>(state.range(0));
+  if (!bitfield::setIsa(isa)) {
+    state.SkipWithError("instruction set not supported on this CPU");
+    return;
+  }
+  const std::size_t pieces = 500'000;
+  std::size_t percent = state.range(1);
+
+  std::mt19937 rng(11);
+  bitfield peer(pieces), ours(pieces);
+  for (std::size_t i = 0; i < pieces; i++) {
+    if (rng() % 100 < percent)
+      peer.set(i);
+    if (rng() % 2 == 0)
+      ours.set(i);
+  }
+  std::vector<std::uint32_t> availability(pieces, 3);
+
+  for (auto _ : state) {
+    peer.increment(availability);
+    benchmark::DoNotOptimize(peer.countAndNot(ours));
+    peer.decrement(availability);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * pieces);
+  bitfield::setIsa(detectedIsa);
+}
+
+// Unchokes anyone interested and serves the torrent's content, answering
+// each request after `delay`.
+struct BenchSeeder : btc::PeerHandler {
+  btc::net::io_context &ctx;
+  const std::string &content;
+  std::chrono::milliseconds delay;
+
+  BenchSeeder(btc::net::io_context &ctx, const std::string &content,
+              std::chrono::milliseconds delay)
+      : ctx(ctx), content(content), delay(delay) {}
+
+  std::optional<btc::BlockRequest> pickBlock(btc::PeerConnection &) override {
+    return std::nullopt;
+  }
+  void onBlock(btc::PeerConnection &, const btc::BlockRequest &,
+               std::string_view) override {}
+  void onInterest(btc::PeerConnection &conn) override {
+    if (conn.isPeerInterested())
+      conn.unchoke();
+  }
+  void onRequest(btc::PeerConnection &conn,
+                 const btc::BlockRequest &block) override {
+    auto data = std::string_view(content).substr(
+        block.piece * corpus::pieceLength + block.offset, block.length);
+    if (delay.count() == 0) {
+      conn.sendPiece(block, data);
+      return;
+    }
+    auto timer = std::make_shared<btc::net::steady_timer>(ctx, delay);
+    timer->async_wait([timer, conn = conn.shared_from_this(), block,
+                       data](btc::sys::error_code) {
+      conn->sendPiece(block, data);
+    });
+  }
+};
+
+// A 4 MiB download from three fast seeders and one that takes 50 ms per
+// block, with endgame duplicates capped at `endgame` (1 turns endgame off).
+// The time is until the last piece is verified; without endgame the
+// download waits on the slow peer's last blocks.
+void BM_SwarmTail(benchmark::State &state) {
+  std::size_t endgame = state.range(0);
+  static const corpus::HashedTorrent hashed = corpus::makeHashedTorrent(16, 6);
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_bench_swarm";
+
+  for (auto _ : state) {
+    std::filesystem::remove_all(root);
+    auto storageRes = btc::DiskStorage::open(hashed.torrent, root);
+    if (!storageRes) {
+      state.SkipWithError("cannot create the storage files");
+      return;
+    }
+    btc::WriteCache cache(*storageRes, hashed.torrent,
+                          hashed.content.size());
+    btc::net::io_context ctx;
+
+    std::vector<std::unique_ptr<BenchSeeder>> seeders;
+    std::vector<std::unique_ptr<btc::tcp::acceptor>> acceptors;
+    std::vector<btc::Peer> peers;
+    for (int delay : {50, 0, 0, 0}) {
+      seeders.push_back(std::make_unique<BenchSeeder>(
+          ctx, hashed.content, std::chrono::milliseconds(delay)));
+      acceptors.push_back(std::make_unique<btc::tcp::acceptor>(
+          ctx,
+          btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0)));
+      peers.push_back({std::nullopt, "127.0.0.1",
+                       acceptors.back()->local_endpoint().port()});
+      btc::net::co_spawn(
+          ctx,
+          [&, seeder = seeders.back().get(),
+           acceptor = acceptors.back().get()]() -> btc::net::awaitable<void> {
+            auto socket =
+                co_await acceptor->async_accept(btc::net::use_awaitable);
+            auto connRes = co_await btc::PeerConnection::accept(
+                std::move(socket), hashed.torrent, std::string(20, 's'),
+                *seeder);
+            if (!connRes)
+              co_return;
+            (*connRes)->sendBitfield(btc::Bitfield(16, true));
+            co_await (*connRes)->run();
+          },
+          btc::net::detached);
+    }
+
+    btc::SwarmOptions options;
+    options.endgameDuplicates = endgame;
+    btc::Swarm swarm(ctx, hashed.torrent, cache, std::string(20, 'l'),
+                     options);
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    bool ok = false;
+    btc::net::co_spawn(
+        ctx,
+        [&]() -> btc::net::awaitable<void> {
+          ok = (co_await swarm.wait()).has_value();
+          elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        },
+        btc::net::detached);
+    swarm.addPeers(peers);
+    ctx.run();
+    if (!ok) {
+      state.SkipWithError("the download failed");
+      break;
+    }
+    state.SetIterationTime(elapsed);
+    state.counters["duplicates"] = static_cast<double>(
+        swarm.getStats().duplicateRequests);
+  }
+  state.SetBytesProcessed(state.iterations() * hashed.content.size());
+  std::filesystem::remove_all(root);
+}
+
+// Says it is interested and never asks for anything.
+struct IdleClient : btc::PeerHandler {
+  void onBitfield(btc::PeerConnection &conn) override {
+    conn.setInterested(true);
+  }
+  std::optional<btc::BlockRequest> pickBlock(btc::PeerConnection &) override {
+    return std::nullopt;
+  }
+  void onBlock(btc::PeerConnection &, const btc::BlockRequest &,
+               std::string_view) override {}
+};
+
+// One choker round over `torrents` seeding torrents of four interested
+// loopback peers each, rotating the optimistic unchoke. The round yields
+// every `batch` torrents; maxStallUs is the longest another handler on the
+// io_context waited meanwhile.
+void BM_ChokerTick(benchmark::State &state) {
+  std::size_t torrents = state.range(0);
+  const std::size_t peersPerTorrent = 4;
+  static const corpus::HashedTorrent hashed = corpus::makeHashedTorrent(16, 6);
+
+  btc::net::io_context ctx;
+  btc::tcp::acceptor acceptor(
+      ctx, btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0));
+  btc::Peer peer{std::nullopt, "127.0.0.1", acceptor.local_endpoint().port()};
+  BenchSeeder seeder(ctx, hashed.content, std::chrono::milliseconds(0));
+  IdleClient client;
+  std::size_t total = torrents * peersPerTorrent;
+
+  std::vector<std::shared_ptr<btc::PeerConnection>> served, clients;
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        while (served.size() < total) {
+          auto socket =
+              co_await acceptor.async_accept(btc::net::use_awaitable);
+          auto connRes = co_await btc::PeerConnection::accept(
+              std::move(socket), hashed.torrent, std::string(20, 's'),
+              seeder);
+          if (!connRes)
+            continue;
+          served.push_back(*connRes);
+          (*connRes)->sendBitfield(btc::Bitfield(16, true));
+          btc::net::co_spawn(ctx, (*connRes)->run(), btc::net::detached);
+        }
+      },
+      btc::net::detached);
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        for (std::size_t i = 0; i < total; i++) {
+          auto connRes = co_await btc::PeerConnection::connect(
+              ctx, peer, hashed.torrent, std::string(20, 'c'), client);
+          if (!connRes)
+            co_return;
+          clients.push_back(*connRes);
+          btc::net::co_spawn(ctx, (*connRes)->run(), btc::net::detached);
+        }
+      },
+      btc::net::detached);
+  auto interested = [&] {
+    return served.size() == total &&
+           std::all_of(served.begin(), served.end(), [](const auto &conn) {
+             return conn->isPeerInterested();
+           });
+  };
+  while (!interested() && ctx.run_one_for(std::chrono::seconds(5)) > 0) {
+  }
+  if (!interested()) {
+    state.SkipWithError("cannot connect the loopback peers");
+    return;
+  }
+
+  btc::ChokerOptions options;
+  options.batch = state.range(1);
+  btc::Choker choker(ctx, options);
+  for (std::size_t t = 0; t < torrents; t++) {
+    auto id = choker.addTorrent(true);
+    for (std::size_t p = 0; p < peersPerTorrent; p++)
+      choker.addPeer(id, served[t * peersPerTorrent + p]);
+  }
+
+  using clock = std::chrono::steady_clock;
+  double maxStall = 0;
+  for (auto _ : state) {
+    bool done = false;
+    btc::net::co_spawn(
+        ctx,
+        [&]() -> btc::net::awaitable<void> {
+          co_await choker.tick(true);
+          done = true;
+        },
+        btc::net::detached);
+    // Stands in for peer I/O: a handler that wants to run all the time.
+    btc::net::co_spawn(
+        ctx,
+        [&]() -> btc::net::awaitable<void> {
+          auto last = clock::now();
+          while (!done) {
+            co_await btc::net::post(ctx, btc::net::use_awaitable);
+            auto now = clock::now();
+            maxStall = std::max(
+                maxStall,
+                std::chrono::duration<double, std::micro>(now - last).count());
+            last = now;
+          }
+        },
+        btc::net::detached);
+    while (!done)
+      ctx.run_one();
+  }
+  state.SetItemsProcessed(state.iterations() * total);
+  state.counters["maxStallUs"] = maxStall;
+
+  for (const auto &conn : clients)
+    conn->close();
+  for (const auto &conn : served)
+    conn->close();
+  ctx.run_for(std::chrono::milliseconds(100));
+}
+
+} // namespace
+
+BENCHMARK(BM_ChokerTick)
+    ->ArgNames({"torrents", "batch"})
+    ->ArgsProduct({{1000}, {16, 128, 1 << 20}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_SwarmTail)
+    ->ArgName("endgame")
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_BitfieldConnect)
+    ->ArgNames({"isa", "percent"})
+    ->ArgsProduct({{0, 1, 2}, {5, 50, 100}});
+
+BENCHMARK(BM_PickPieces)->Arg(10000)->Arg(1000000);
+BENCHMARK(BM_PickCommonPieces)->Arg(1000000);
+
+BENCHMARK(BM_FramePeerMessages)
+    ->ArgNames({"block", "chunk"})
+    ->ArgsProduct({{16 * 1024}, {1500, 64 * 1024}});
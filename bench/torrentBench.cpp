@@ -0,0 +1,168 @@
+#include "benchCorpus.h"
+#include <Bencode/bencodeDecoder.h>
+#include <Storage/fileMap.h>
+#include <Torrent/torrentLoader.h>
+#include <Torrent/torrentParser.h>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <threadPool.h>
+#include <unistd.h>
+#include <vector>
+
+using torrentParser = btc::TorrentParser;
+using bencodeDecoder = btc::BencodeDecoder;
+
+namespace {
+
+// A small single-file torrent, a 100k-file torrent and a 50 MB pieces blob.
+const std::string &torrent(std::int64_t index) {
+  static const std::vector<std::string> torrents = {
+      corpus::makeTorrent(0, 64),
+      corpus::makeTorrent(100'000, 16'384),
+      corpus::makeTorrent(0, 50 * 1024 * 1024 / 20),
+  };
+  return torrents[index];
+}
+
+// A directory of this process's own, emptied on entry and removed when the
+// benchmark ends, so files left by another run or build are never measured.
+class ScratchDir {
+
+public:
+  explicit ScratchDir(const std::string &name)
+      : path(std::filesystem::temp_directory_path() /
+             (name + "_" + std::to_string(::getpid()))) {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~ScratchDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+
+  ScratchDir(const ScratchDir &) = delete;
+  ScratchDir &operator=(const ScratchDir &) = delete;
+
+  const std::filesystem::path &get() const { return path; }
+
+private:
+  std::filesystem::path path;
+};
+
+// parseFile goes through the file system, so the generated torrent is
+// written into `dir`; index 3 is the naruto.torrent fixture used by the
+// tests.
+std::filesystem::path torrentPath(std::int64_t index,
+                                  const std::filesystem::path &dir) {
+  if (index == 3)
+    return std::filesystem::path(BTC_TEST_FILES_DIR) / "naruto.torrent";
+
+  std::filesystem::path path =
+      dir / ("corpus" + std::to_string(index) + ".torrent");
+  std::ofstream out(path, std::ios::binary);
+  out << torrent(index);
+  return path;
+}
+
+void BM_ParseContent(benchmark::State &state) {
+  const std::string &input = torrent(state.range(0));
+
+  for (auto _ : state) {
+    auto res = torrentParser::parseContent(input, bencodeDecoder());
+    if (!res) {
+      state.SkipWithError("corpus does not parse");
+      return;
+    }
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void BM_ParseFile(benchmark::State &state) {
+  ScratchDir dir("btc_bench_parse");
+  std::filesystem::path path = torrentPath(state.range(0), dir.get());
+  std::error_code ec;
+  std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    state.SkipWithError("torrent file not found");
+    return;
+  }
+
+  for (auto _ : state) {
+    auto res = torrentParser::parseFile(path, bencodeDecoder());
+    if (!res) {
+      state.SkipWithError("torrent file does not parse");
+      return;
+    }
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+// 2000 small torrents, as loaded by a daemon restart.
+std::vector<std::filesystem::path>
+writeBulk(const std::filesystem::path &dir) {
+  std::vector<std::filesystem::path> paths;
+  for (std::size_t i = 0; i < 2000; i++) {
+    paths.push_back(dir / (std::to_string(i) + ".torrent"));
+    std::ofstream file(paths.back(), std::ios::binary);
+    file << corpus::makeTorrent(i % 10, 256 + i % 1024);
+  }
+  return paths;
+}
+
+void BM_LoadFiles(benchmark::State &state) {
+  ScratchDir dir("btc_bench_bulk");
+  const auto paths = writeBulk(dir.get());
+  btc::ThreadPool pool(state.range(0));
+
+  for (auto _ : state) {
+    auto res = btc::TorrentLoader::loadFiles(paths, pool);
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+}
+
+// Resolves every 16 KiB block of the 100k-file torrent to file segments.
+void BM_FileMapBlocks(benchmark::State &state) {
+  auto torrentRes = torrentParser::parseContent(torrent(1), bencodeDecoder());
+  if (!torrentRes) {
+    state.SkipWithError("corpus does not parse");
+    return;
+  }
+  btc::FileMap files(*torrentRes);
+  const std::size_t blockSize = 16 * 1024;
+
+  std::vector<btc::FileSegment> segments;
+  std::size_t blocks = 0;
+  for (auto _ : state) {
+    for (std::size_t piece = 0; piece < files.getPieceCount(); piece++) {
+      std::size_t size = files.getPieceSize(piece);
+      for (std::size_t offset = 0; offset < size; offset += blockSize) {
+        segments.clear();
+        files.map(piece, offset, std::min(blockSize, size - offset),
+                  segments);
+        benchmark::DoNotOptimize(segments.data());
+        blocks++;
+      }
+    }
+  }
+  state.SetItemsProcessed(blocks);
+}
+
+} // namespace
+
+BENCHMARK(BM_ParseContent)->ArgName("corpus")->DenseRange(0, 2);
+BENCHMARK(BM_ParseFile)->ArgName("corpus")->DenseRange(0, 3);
+BENCHMARK(BM_FileMapBlocks);
+BENCHMARK(BM_LoadFiles)
+    ->ArgName("threads")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime();
@@ -0,0 +1,33 @@
+#include "benchCorpus.h"
+#include <Tracker/trackerManager.h>
+#include <benchmark/benchmark.h>
+#include <string>
+
+using trackerManager = btc::TrackerManager;
+using trackerRequest = btc::TrackerRequest;
+
+namespace {
+
+void BM_ParseAnnounce(benchmark::State &state) {
+  bool compact = state.range(1) != 0;
+  std::string input = corpus::makeAnnounce(state.range(0), compact);
+  trackerRequest req;
+  req.setKind(btc::requestKind::announce);
+
+  for (auto _ : state) {
+    auto res = trackerManager::parseHttp(input, req);
+    if (!res || res->getPeerList().size() != std::size_t(state.range(0))) {
+      state.SkipWithError("announce reply does not parse");
+      return;
+    }
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_ParseAnnounce)
+    ->ArgNames({"peers", "compact"})
+    ->ArgsProduct({{50, 10'000}, {1, 0}});
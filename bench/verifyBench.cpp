@@ -0,0 +1,42 @@
+#include "benchCorpus.h"
+#include <Crypto/sha1.h>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using sha1 = btc::Sha1;
+
+namespace {
+
+const sha1::Isa detectedIsa = sha1::getIsa();
+
+// A batch of `lanes` pieces of `size` bytes, hashed through hashMany as the
+// verifier does.
+void BM_Sha1Pieces(benchmark::State &state) {
+  auto isa = static_cast<sha1::Isa>(state.range(0));
+  if (!sha1::setIsa(isa)) {
+    state.SkipWithError("instruction set not supported on this CPU");
+    return;
+  }
+  std::size_t size = state.range(1);
+  std::vector<std::string> data;
+  for (std::size_t i = 0; i < sha1::lanes; i++)
+    data.push_back(corpus::makeBytes(size, static_cast<std::uint32_t>(i)));
+  std::vector<std::string_view> inputs(data.begin(), data.end());
+  std::vector<sha1::digest_t> digests(inputs.size());
+
+  for (auto _ : state) {
+    sha1::hashMany(inputs, digests);
+    benchmark::DoNotOptimize(digests.data());
+  }
+  state.SetBytesProcessed(state.iterations() * size * inputs.size());
+  sha1::setIsa(detectedIsa);
+}
+
+} // namespace
+
+BENCHMARK(BM_Sha1Pieces)
+    ->ArgNames({"isa", "size"})
+    ->ArgsProduct({{0, 1, 2}, {16 * 1024, 256 * 1024}});
@@ -1,34 +1,45 @@
 #pragma once
 
 #include <Bencode/bencodeValue.h>
+#include <Bencode/bencodeView.h>
 #include <cstddef>
 #include <errors.h>
 #include <expected>
+#include <string_view>
 #include <system_error>
 
 namespace btc {
 
 class Error;
 
+// Decoding keeps all of its state on the calling thread's stack, so any
+// number of threads may decode concurrently. Nesting is tracked with an
+// explicit stack rather than recursion.
 class BencodeDecoder {
 
 private:
   using exp_int = std::expected<BNode::int_t, std::error_code>;
-  using exp_str = std::expected<BNode::string_t, std::error_code>;
-  using exp_list = std::expected<BNode::list_t, std::error_code>;
-  using exp_dict = std::expected<BNode::dict_t, std::error_code>;
+  using exp_str = std::expected<std::string_view, std::error_code>;
   using exp_node = std::expected<BNode, std::error_code>;
+  using exp_document = std::expected<BDocument, std::error_code>;
   using exp_sizet = std::expected<std::size_t, std::error_code>;
+  using exp_void = std::expected<void, std::error_code>;
+
+  class NodeBuilder;
+  class ViewBuilder;
 
 public:
   static exp_node decode(std::string_view input);
 
+  // Borrowed decoding: strings in the returned document point into `input`.
+  static exp_document decodeView(std::string_view input);
+
 private:
-  static exp_node internal_decode(std::string_view *input);
+  template <typename Builder>
+  static exp_void parse(std::string_view *input, Builder &builder);
+
   static exp_int decode_int(std::string_view *input);
   static exp_str decode_str(std::string_view *input);
-  static exp_list decode_list(std::string_view *input);
-  static exp_dict decode_dict(std::string_view *input);
 
   static bool hasLeadingZeroes(std::string_view input);
   static bool isNegativeZero(std::string_view input);
@@ -36,7 +47,6 @@ private:
   inline static exp_sizet isIntegerValid(std::string_view input);
   inline static exp_sizet isStringValid(std::string_view input);
 
-  inline static std::size_t depth = 0;
   inline static const std::uint16_t maxDepth = 256;
 };
 } // namespace btc
@@ -1,20 +1,91 @@
 #pragma once
 
 #include <Bencode/bencodeValue.h>
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 namespace btc {
 
+// Encoding is a single pass that writes straight to an output iterator.
+// encodedSize gives the exact output length up front, so callers can size a
+// buffer once; encode(val) does exactly that and allocates a single string.
 class BencodeEncoder {
 
 public:
-  static std::string encode(BNode val);
+  static std::string encode(const BNode &val);
+  static void encode(const BNode &val, std::string &out);
+  static std::size_t encodedSize(const BNode &val);
+
+  template <typename OutputIt>
+  static OutputIt encode(const BNode &val, OutputIt out);
 
 private:
-  static std::string encode_int(BNode::int_t val);
-  static std::string encode_str(BNode::string_t val);
-  static std::string encode_list(BNode::list_t val);
-  static std::string encode_dict(BNode::dict_t val);
+  template <typename OutputIt>
+  static OutputIt encode_int(BNode::int_t val, OutputIt out);
+  template <typename OutputIt>
+  static OutputIt encode_str(std::string_view val, OutputIt out);
+  template <typename OutputIt>
+  static OutputIt encode_list(const BNode::list_t &val, OutputIt out);
+  template <typename OutputIt>
+  static OutputIt encode_dict(const BNode::dict_t &val, OutputIt out);
+
+  static std::size_t intSize(BNode::int_t val);
+  static std::size_t strSize(std::string_view val);
+
+  // "i" + sign + 19 digits + "e"
+  inline static const std::size_t maxIntSize = 22;
 };
 
+template <typename OutputIt>
+OutputIt BencodeEncoder::encode(const BNode &val, OutputIt out) {
+  if (val.isInt())
+    return encode_int(val.getInt(), out);
+  if (val.isStr())
+    return encode_str(val.getStr(), out);
+  if (val.isList())
+    return encode_list(val.getList(), out);
+  return encode_dict(val.getDict(), out);
+}
+
+template <typename OutputIt>
+OutputIt BencodeEncoder::encode_int(BNode::int_t val, OutputIt out) {
+  char buf[maxIntSize];
+  buf[0] = 'i';
+  char *last = std::to_chars(buf + 1, buf + maxIntSize - 1, val).ptr;
+  *last++ = 'e';
+  return std::copy(buf, last, out);
+}
+
+template <typename OutputIt>
+OutputIt BencodeEncoder::encode_str(std::string_view val, OutputIt out) {
+  char buf[maxIntSize];
+  char *last = std::to_chars(buf, buf + maxIntSize - 1, val.size()).ptr;
+  *last++ = ':';
+  out = std::copy(buf, last, out);
+  return std::copy(val.begin(), val.end(), out);
+}
+
+template <typename OutputIt>
+OutputIt BencodeEncoder::encode_list(const BNode::list_t &val, OutputIt out) {
+  *out++ = 'l';
+  for (const auto &item : val)
+    out = encode(item, out);
+  *out++ = 'e';
+  return out;
+}
+
+template <typename OutputIt>
+OutputIt BencodeEncoder::encode_dict(const BNode::dict_t &val, OutputIt out) {
+  *out++ = 'd';
+  for (const auto &[key, item] : val) {
+    out = encode_str(key, out);
+    out = encode(item, out);
+  }
+  *out++ = 'e';
+  return out;
+}
+
 } // namespace btc
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace btc {
+
+// Token-level scanning used by the decoder. Bencode is length-prefixed, so
+// the work per token is locating the end of a digit run (string lengths and
+// integers); these are done 16 or 32 bytes at a time when the CPU allows.
+// The implementation is selected once at startup from the CPU features; until
+// then, and on other architectures, the portable scalar loop is used.
+class BencodeScanner {
+
+public:
+  enum class Isa : std::uint8_t { scalar, sse2, avx2 };
+
+  // Number of leading ASCII digits in `input`.
+  static std::size_t digitRun(std::string_view input) {
+    return impl(input.data(), input.size());
+  }
+
+  static Isa getIsa() { return isa; }
+  // Forces an implementation (e.g. to compare them); ignored when the CPU
+  // does not support it. Not meant to be called while decoding is running.
+  static bool setIsa(Isa requested);
+  static bool isSupported(Isa requested);
+
+private:
+  using digit_run_fn = std::size_t (*)(const char *, std::size_t);
+
+  static std::size_t digitRunScalar(const char *data, std::size_t size);
+  static std::size_t digitRunSse2(const char *data, std::size_t size);
+  static std::size_t digitRunAvx2(const char *data, std::size_t size);
+
+  static Isa detect();
+
+  inline static Isa isa = Isa::scalar;
+  inline static digit_run_fn impl = &digitRunScalar;
+  static const bool initialized;
+};
+
+} // namespace btc
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Bencode/bencodeValue.h>
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace btc {
+
+// Receives the events produced by a BencodeStreamParser. String values are
+// delivered in pieces as they arrive (begin, zero or more data chunks, end);
+// dictionary keys are short and are delivered whole. Every list or dictionary
+// is closed by a matching onEnd.
+class BencodeHandler {
+
+public:
+  virtual ~BencodeHandler() = default;
+
+  virtual void onInt(BNode::int_t) {}
+  virtual void onStringBegin(std::size_t) {}
+  virtual void onStringData(std::string_view) {}
+  virtual void onStringEnd() {}
+  virtual void onKey(std::string_view) {}
+  virtual void onListBegin() {}
+  virtual void onDictBegin() {}
+  virtual void onEnd() {}
+};
+
+// Incremental push parser: feed() accepts the document in chunks of any size
+// and emits events as soon as they are complete. Memory use is bounded by the
+// nesting limit and maxKeyLength, independently of the document size.
+// Dictionary key order and uniqueness are not checked.
+class BencodeStreamParser {
+
+private:
+  using exp_void = std::expected<void, std::error_code>;
+
+  enum class State : std::uint8_t { value, integer, length, string, done };
+  enum class Frame : std::uint8_t { list, dictKey, dictValue };
+
+public:
+  explicit BencodeStreamParser(BencodeHandler &handler) : handler(handler) {}
+
+  exp_void feed(std::string_view chunk);
+  exp_void finish();
+  void reset();
+
+  bool isDone() const { return state == State::done; }
+
+  inline static const std::size_t maxKeyLength = 4096;
+
+private:
+  exp_void fail(error_code e);
+  exp_void startValue(char c);
+  exp_void endInteger();
+  exp_void endLength();
+  void endString();
+  void endValue();
+
+  BencodeHandler &handler;
+  std::error_code error;
+
+  State state = State::value;
+  std::vector<Frame> stack;
+  bool started = false;
+
+  bool isKey = false;
+  std::size_t remaining = 0;
+  std::string digits;
+  std::string key;
+
+  inline static const std::uint16_t maxDepth = 256;
+  inline static const std::size_t maxDigits = 20;
+};
+
+} // namespace btc
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <map>
-#include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -17,30 +18,38 @@ public:
   using int_t = std::int64_t;
   using string_t = std::string;
   using list_t = std::vector<BNode>;
-  using dict_t = std::map<string_t, BNode>;
+  using dict_t = std::map<string_t, BNode, std::less<>>;
   using b_val = std::variant<int_t, string_t, list_t, dict_t>;
 
   BNode() : val(0) {};
   BNode(b_val val);
 
-  bool isInt();
-  bool isStr();
-  bool isList();
-  bool isDict();
+  bool isInt() const;
+  bool isStr() const;
+  bool isList() const;
+  bool isDict() const;
 
   int_t &getInt();
   string_t &getStr();
   list_t &getList();
   dict_t &getDict();
 
-  BNode dictFindInt(std::string k, int_t def);
-  BNode dictFindString(std::string k, string_t def);
-
-  std::optional<BNode> dictFind(std::string k);
-  std::optional<BNode> dictFindInt(std::string k);
-  std::optional<BNode> dictFindString(std::string k);
-  std::optional<BNode> dictFindList(std::string k);
-  std::optional<BNode> dictFindDict(std::string k);
+  const int_t &getInt() const;
+  const string_t &getStr() const;
+  const list_t &getList() const;
+  const dict_t &getDict() const;
+
+  // Lookups never copy: they return the stored node (or nullptr when the key
+  // is missing or holds another type), valid as long as this node is alive.
+  int_t dictFindInt(std::string_view k, int_t def) const;
+  std::string_view dictFindString(std::string_view k,
+                                  std::string_view def) const;
+
+  const BNode *dictFind(std::string_view k) const;
+  const BNode *dictFindInt(std::string_view k) const;
+  const BNode *dictFindString(std::string_view k) const;
+  const BNode *dictFindList(std::string_view k) const;
+  const BNode *dictFindDict(std::string_view k) const;
 
 private:
   b_val val;
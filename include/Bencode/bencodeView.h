@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Bencode/bencodeValue.h>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+namespace btc {
+
+class BView;
+class BDocument;
+class BencodeDecoder;
+
+// Non-owning counterpart of BNode produced by BencodeDecoder::decodeView.
+// String nodes are slices of the decoded buffer, which must outlive the tree,
+// and every node remembers the exact bytes it was decoded from.
+// Lists and dictionaries are contiguous arrays living in the arena of the
+// owning BDocument; dictionaries are sorted by key and searched by bisection.
+class BView {
+
+public:
+  using int_t = BNode::int_t;
+  using string_t = std::string_view;
+  using list_t = std::span<const BView>;
+  using entry_t = std::pair<string_t, BView>;
+  using dict_t = std::span<const entry_t>;
+  using b_val = std::variant<int_t, string_t, list_t, dict_t>;
+
+  BView() : val(0) {};
+  BView(b_val val, std::string_view raw = {});
+
+  bool isInt() const;
+  bool isStr() const;
+  bool isList() const;
+  bool isDict() const;
+
+  const int_t &getInt() const;
+  const string_t &getStr() const;
+  const list_t &getList() const;
+  const dict_t &getDict() const;
+
+  // The encoded form of this node as it appeared in the source buffer.
+  std::string_view getRaw() const { return raw; }
+
+  int_t dictFindInt(std::string_view k, int_t def) const;
+  string_t dictFindString(std::string_view k, string_t def) const;
+
+  const BView *dictFind(std::string_view k) const;
+  const BView *dictFindInt(std::string_view k) const;
+  const BView *dictFindString(std::string_view k) const;
+  const BView *dictFindList(std::string_view k) const;
+  const BView *dictFindDict(std::string_view k) const;
+
+  BNode toNode() const;
+
+private:
+  b_val val;
+  std::string_view raw;
+};
+
+// A decoded document: the root view plus the arena backing every list and
+// dictionary below it. Destroying the document releases the whole tree at
+// once; nodes are trivially destructible so no per-node teardown happens.
+class BDocument {
+
+public:
+  const BView &getRoot() const { return root; }
+
+private:
+  using arena_t = std::pmr::monotonic_buffer_resource;
+
+  BDocument(std::unique_ptr<arena_t> arena, BView root)
+      : arena(std::move(arena)), root(root) {}
+
+  std::unique_ptr<arena_t> arena;
+  BView root;
+
+  friend class BencodeDecoder;
+};
+
+} // namespace btc
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace btc {
+
+// SHA-1 for piece verification. hash() digests one buffer; hashMany() digests
+// a batch, which lets the AVX2 implementation run up to `lanes` equally long
+// inputs through the compression function side by side. As with
+// BencodeScanner, the implementation is picked once from the CPU features:
+// SHA-NI when present, then AVX2, otherwise OpenSSL.
+class Sha1 {
+
+public:
+  enum class Isa : std::uint8_t { openssl, shaNi, avx2 };
+
+  inline static const std::size_t digestSize = 20;
+  inline static const std::size_t lanes = 8;
+  using digest_t = std::array<unsigned char, digestSize>;
+
+  static digest_t hash(std::string_view input);
+  // `out` must have room for one digest per input.
+  static void hashMany(std::span<const std::string_view> inputs,
+                       std::span<digest_t> out);
+
+  static Isa getIsa() { return isa; }
+  // Forces an implementation (e.g. to compare them); ignored when the CPU
+  // does not support it. Not meant to be called while hashing is running.
+  static bool setIsa(Isa requested);
+  static bool isSupported(Isa requested);
+
+private:
+  using state_t = std::array<std::uint32_t, 5>;
+
+  static digest_t hashOpenssl(std::string_view input);
+  static digest_t hashShaNi(std::string_view input);
+  static void hashLanesAvx2(std::span<const std::string_view> inputs,
+                            std::span<digest_t> out);
+
+  static void compressShaNi(state_t &state, const unsigned char *blocks,
+                            std::size_t count);
+
+  static Isa detect();
+
+  inline static Isa isa = Isa::openssl;
+  static const bool initialized;
+};
+
+} // namespace btc
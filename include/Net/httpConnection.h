@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <expected>
+#include <functional>
 #include <helpers.h>
+#include <string_view>
 #include <system_error>
 
 namespace btc {
@@ -14,12 +17,23 @@ private:
       std::expected<http::response<http::dynamic_body>, std::error_code>;
   using await_exp_connection = net::awaitable<exp_connection>;
   using await_exp_response = net::awaitable<exp_response>;
+  using exp_void = std::expected<void, std::error_code>;
+  using await_exp_void = net::awaitable<exp_void>;
+  using chunk_handler = std::function<exp_void(std::string_view)>;
 
 public:
   await_exp_response get(std::string url);
+  // Like get, but hands the body to `onChunk` piece by piece as it is read
+  // instead of buffering it; an error from the handler aborts the transfer.
+  // A body longer than `bodyLimit` fails with http::error::body_limit, like
+  // one past Beast's default limit does in get.
+  await_exp_void getStreamed(std::string url, chunk_handler onChunk,
+                             std::uint64_t bodyLimit = defaultBodyLimit);
   static await_exp_connection connect(net::io_context &ctx,
                                       std::string hostname, port_t port);
 
+  inline static const std::uint64_t defaultBodyLimit = 8 << 20;
+
 private:
   HttpConnection(net::io_context &ctx, std::string hostname, port_t port)
       : ctx(ctx), resolver(ctx), stream(ctx), hostname(hostname), port(port) {}
@@ -27,6 +41,9 @@ private:
   net::io_context &ctx;
   tcp::resolver resolver;
   beast::tcp_stream stream;
+  // Reused by every request on the connection; it also keeps any bytes read
+  // past the end of one response for the next.
+  beast::flat_buffer buffer;
 
   std::string hostname;
   port_t port;
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace btc {
+
+// A set of pieces, such as the pieces a peer has. Bits are kept in wire
+// order (piece 0 is the high bit of the first byte), so bitfield messages
+// are copied in and out as they are. Storage is padded to 32 bytes and the
+// padding is always clear, so the bulk operations run a whole number of
+// vectors with no tail.
+//
+// count(), the AND-NOT operations, the searches and availability updates
+// are done 32 bytes at a time with AVX2 when the CPU allows, or with the
+// popcnt instruction; as with BencodeScanner, the implementation is picked
+// once at startup.
+class Bitfield {
+
+private:
+  using exp_bitfield = std::expected<Bitfield, std::error_code>;
+
+public:
+  enum class Isa : std::uint8_t { scalar, popcnt, avx2 };
+
+  inline static const std::size_t npos = SIZE_MAX;
+
+  Bitfield() = default;
+  explicit Bitfield(std::size_t size, bool value = false);
+
+  // From the payload of a bitfield message: exactly (size + 7) / 8 bytes
+  // with the spare bits at the end clear.
+  static exp_bitfield fromBytes(std::string_view bytes, std::size_t size);
+  std::string_view bytes() const {
+    return {reinterpret_cast<const char *>(words.data()), (bits + 7) / 8};
+  }
+
+  std::size_t size() const { return bits; }
+  bool test(std::size_t i) const {
+    return byteAt(i) & (0x80 >> (i % 8));
+  }
+  bool operator[](std::size_t i) const { return test(i); }
+  void set(std::size_t i) {
+    byteAt(i) |= static_cast<unsigned char>(0x80 >> (i % 8));
+  }
+  void reset(std::size_t i) {
+    byteAt(i) &= static_cast<unsigned char>(~(0x80 >> (i % 8)));
+  }
+
+  std::size_t count() const;
+  bool all() const { return count() == bits; }
+  bool none() const { return findNext(0) == npos; }
+
+  // Pieces set here and not in `other`, e.g. the pieces a peer has that we
+  // do not. Both must have the same size.
+  std::size_t countAndNot(const Bitfield &other) const;
+  Bitfield &andNot(const Bitfield &other);
+
+  // The first set bit at or after `from`, or npos.
+  std::size_t findNext(std::size_t from) const;
+  // The first bit at or after `from` set both here and in `other`, or npos;
+  // e.g. the next piece a peer has that is still to be started.
+  std::size_t findNextCommon(const Bitfield &other, std::size_t from) const;
+
+  // Adds or subtracts one from counts[i] for every set bit i, e.g. piece
+  // availability when a peer connects or goes away. `counts` must hold
+  // size() elements; decrement() must not take a count below zero.
+  void increment(std::span<std::uint32_t> counts) const;
+  void decrement(std::span<std::uint32_t> counts) const;
+
+  bool operator==(const Bitfield &) const = default;
+
+  static Isa getIsa() { return isa; }
+  // Forces an implementation (e.g. to compare them); ignored when the CPU
+  // does not support it. Not meant to be called while bitfields are in use.
+  static bool setIsa(Isa requested);
+  static bool isSupported(Isa requested);
+
+private:
+  // Words per 32-byte block.
+  inline static const std::size_t blockWords = 4;
+
+  unsigned char &byteAt(std::size_t i) {
+    return reinterpret_cast<unsigned char *>(words.data())[i / 8];
+  }
+  unsigned char byteAt(std::size_t i) const {
+    return reinterpret_cast<const unsigned char *>(words.data())[i / 8];
+  }
+  void clearPadding();
+
+  static std::size_t countScalar(const std::uint64_t *words, std::size_t n);
+  static std::size_t countPopcnt(const std::uint64_t *words, std::size_t n);
+  static std::size_t countAvx2(const std::uint64_t *words, std::size_t n);
+  static std::size_t countAndNotScalar(const std::uint64_t *a,
+                                       const std::uint64_t *b, std::size_t n);
+  static std::size_t countAndNotPopcnt(const std::uint64_t *a,
+                                       const std::uint64_t *b, std::size_t n);
+  static std::size_t countAndNotAvx2(const std::uint64_t *a,
+                                     const std::uint64_t *b, std::size_t n);
+  static void andNotAvx2(std::uint64_t *a, const std::uint64_t *b,
+                         std::size_t n);
+  static std::size_t findBlockAvx2(const std::uint64_t *words,
+                                   std::size_t from, std::size_t n);
+  static std::size_t findCommonBlockAvx2(const std::uint64_t *a,
+                                         const std::uint64_t *b,
+                                         std::size_t from, std::size_t n);
+  static void addScalar(const unsigned char *bytes, std::size_t bits,
+                        std::uint32_t *counts, std::uint32_t delta);
+  static void addAvx2(const unsigned char *bytes, std::size_t bits,
+                      std::uint32_t *counts, std::uint32_t delta);
+
+  static Isa detect();
+
+  std::size_t bits = 0;
+  std::vector<std::uint64_t> words;
+
+  inline static Isa isa = Isa::scalar;
+  static const bool initialized;
+};
+
+} // namespace btc
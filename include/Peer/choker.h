@@ -0,0 +1,97 @@
+#pragma once
+
+#include <Peer/peerConnection.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <helpers.h>
+#include <memory>
+#include <random>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace btc {
+
+struct ChokerOptions {
+  std::chrono::seconds interval = std::chrono::seconds(10);
+  std::chrono::seconds optimisticInterval = std::chrono::seconds(30);
+  std::size_t slotsPerTorrent = 4;
+  bool optimisticUnchoke = true;
+  // Regular slots across all torrents; 0 for no limit.
+  std::size_t globalSlots = 0;
+  // Torrents handled before yielding to the io_context's other handlers.
+  std::size_t batch = 128;
+};
+
+// Decides whom we upload to. Every interval, each torrent's interested peers
+// are ranked by the rate they give us (download rate while leeching, or the
+// rate we upload to them while seeding) and the fastest get the torrent's
+// slots; the global limit then keeps the fastest of those across all
+// torrents. Every optimisticInterval each torrent also unchokes one random
+// other interested peer, so new peers get a chance to show their rate.
+// Ranking takes only the top k of each list, O(n log k) instead of sorting.
+//
+// A round over thousands of torrents runs in batches, and yields to the
+// io_context between them so peer I/O is not held up. Peers are held
+// weakly; closed connections drop out on the next round.
+class Choker {
+
+public:
+  using Options = ChokerOptions;
+  using torrent_id = std::uint32_t;
+
+  struct Candidate {
+    double rate;
+    std::uint32_t index;
+  };
+
+  explicit Choker(net::io_context &ctx, Options options = {});
+
+  torrent_id addTorrent(bool seeding);
+  void removeTorrent(torrent_id torrent);
+  void setSeeding(torrent_id torrent, bool seeding);
+  void addPeer(torrent_id torrent, std::shared_ptr<PeerConnection> conn);
+
+  // Runs a round every interval until stop().
+  net::awaitable<void> run();
+  void stop();
+  // One round; `rotate` picks new optimistic unchokes.
+  net::awaitable<void> tick(bool rotate);
+
+  // Moves the `k` fastest candidates to the front, fastest first, in
+  // O(n log k); returns how many there are.
+  static std::size_t selectTop(std::span<Candidate> candidates,
+                               std::size_t k);
+
+  std::size_t getTorrentCount() const { return torrents.size(); }
+  std::size_t getUnchokedCount() const { return unchoked; }
+
+private:
+  struct Torrent {
+    bool seeding;
+    std::vector<std::weak_ptr<PeerConnection>> peers;
+    std::weak_ptr<PeerConnection> optimistic;
+
+    // Filled during a round: the interested peers, then the slot winners
+    // first among them.
+    std::vector<std::shared_ptr<PeerConnection>> live;
+    std::vector<Candidate> ranked;
+    std::size_t winners = 0;
+  };
+
+  void rank(Torrent &torrent);
+  void apply(Torrent &torrent, bool rotate);
+  net::awaitable<void> yield();
+
+  net::io_context &ctx;
+  Options options;
+  std::unordered_map<torrent_id, Torrent> torrents;
+  torrent_id nextId = 0;
+  std::size_t unchoked = 0;
+  bool running = false;
+  std::minstd_rand rng;
+  net::steady_timer timer;
+};
+
+} // namespace btc
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <Peer/bitfield.h>
+#include <Peer/peerWire.h>
+#include <Peer/rateMeter.h>
+#include <Peer/ringBuffer.h>
+#include <Torrent/peer.h>
+#include <Torrent/torrentFile.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <errors.h>
+#include <expected>
+#include <helpers.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace btc {
+
+class PeerConnection;
+
+// What a PeerConnection asks of the session that owns it. All calls come
+// from the io_context thread running the connection.
+class PeerHandler {
+
+public:
+  virtual ~PeerHandler() = default;
+
+  // The peer announced pieces, by bitfield or have; the connection's
+  // getPeerPieces() is already updated. A bitfield is only accepted as the
+  // first message, so onBitfield() comes at most once and before any
+  // onHave().
+  virtual void onBitfield(PeerConnection &) {}
+  virtual void onHave(PeerConnection &, std::uint32_t) {}
+  virtual void onInterest(PeerConnection &) {}
+
+  // The next block to request from this peer, if any. Called while the
+  // pipeline has room and the peer is not choking us.
+  virtual std::optional<BlockRequest> pickBlock(PeerConnection &conn) = 0;
+  // A requested block arrived; `data` is only valid during the call.
+  virtual void onBlock(PeerConnection &conn, const BlockRequest &block,
+                       std::string_view data) = 0;
+  // Requests that will not be answered, because the peer choked us or the
+  // connection closed.
+  virtual void onRequestsDropped(PeerConnection &,
+                                 std::span<const BlockRequest>) {}
+
+  // The peer wants a block; answer with sendPiece(), now or later.
+  virtual void onRequest(PeerConnection &, const BlockRequest &) {}
+  virtual void onClose(PeerConnection &, std::error_code) {}
+};
+
+struct PeerOptions {
+  std::size_t minOutstanding = 4;
+  std::size_t maxOutstanding = 512;
+  std::chrono::duration<double> queueTime = std::chrono::seconds(3);
+  std::size_t blockSize = 16 * 1024;
+  // Largest request accepted from a peer.
+  std::size_t maxRequestLength = 128 * 1024;
+  // Requests from a peer queued at once; further ones are dropped.
+  std::size_t maxPeerRequests = 500;
+  // Connections are closed when the handshake takes longer than
+  // handshakeTimeout, or when the peer sends nothing for idleTimeout; we
+  // send a keep-alive after keepAliveInterval without writing.
+  std::chrono::milliseconds handshakeTimeout = std::chrono::seconds(20);
+  std::chrono::milliseconds idleTimeout = std::chrono::seconds(120);
+  std::chrono::milliseconds keepAliveInterval = std::chrono::seconds(90);
+};
+
+// One peer wire connection, run as coroutines on an io_context like
+// HttpConnection. Incoming messages are framed in place out of a
+// RingBuffer; outgoing ones are batched into a single write.
+//
+// Requests are pipelined: the connection keeps enough blocks outstanding to
+// cover `queueTime` at the measured download rate, between minOutstanding
+// and maxOutstanding, so the window opens up on fast, high-latency links.
+class PeerConnection : public std::enable_shared_from_this<PeerConnection> {
+
+private:
+  using exp_connection =
+      std::expected<std::shared_ptr<PeerConnection>, std::error_code>;
+  using await_exp_connection = net::awaitable<exp_connection>;
+  using exp_void = std::expected<void, std::error_code>;
+  using await_exp_void = net::awaitable<exp_void>;
+
+public:
+  using Options = PeerOptions;
+
+  // Connects and exchanges handshakes. `peerId` is our 20-byte id.
+  static await_exp_connection connect(net::io_context &ctx, const Peer &peer,
+                                      const TorrentFile &torrent,
+                                      std::string_view peerId,
+                                      PeerHandler &handler,
+                                      Options options = {});
+  // Completes the handshake of an incoming connection.
+  static await_exp_connection accept(tcp::socket socket,
+                                     const TorrentFile &torrent,
+                                     std::string_view peerId,
+                                     PeerHandler &handler,
+                                     Options options = {});
+
+  // Processes messages until the connection fails or is closed; the error
+  // is also passed to PeerHandler::onClose.
+  await_exp_void run();
+  void close();
+
+  // Must be the first message after the handshake, if sent at all.
+  void sendBitfield(const Bitfield &have);
+  void sendHave(std::uint32_t piece);
+  void setInterested(bool interested);
+  void choke();
+  void unchoke();
+  void sendPiece(const BlockRequest &block, std::string_view data);
+  void cancel(const BlockRequest &block);
+  // Asks the handler for more blocks if the pipeline has room.
+  void request();
+
+  const std::string &getPeerId() const { return peerId; }
+  const Bitfield &getPeerPieces() const { return peerPieces; }
+  bool isPeerChoking() const { return peerChoking; }
+  bool isPeerInterested() const { return peerInterested; }
+  bool isChoking() const { return amChoking; }
+  bool isInterested() const { return amInterested; }
+  bool isOpen() const { return open; }
+
+  const std::deque<BlockRequest> &getOutstanding() const {
+    return outstanding;
+  }
+  std::size_t getPipelineDepth() const;
+  double getDownloadRate() const { return downloadRate.get(); }
+  double getUploadRate() const { return uploadRate.get(); }
+
+private:
+  PeerConnection(tcp::socket socket, RingBuffer ring,
+                 const TorrentFile &torrent, std::string peerId,
+                 PeerHandler &handler, Options options);
+
+  static await_exp_connection handshake(tcp::socket socket,
+                                        const TorrentFile &torrent,
+                                        std::string_view peerId,
+                                        PeerHandler &handler, Options options,
+                                        bool initiator);
+
+  exp_void handle(const PeerMessage &message);
+  exp_void handleBitfield(std::string_view payload);
+  bool isValidBlock(const BlockRequest &block) const;
+  void dropOutstanding();
+  void send();
+  net::awaitable<void> writeLoop();
+  net::awaitable<void> watchdog();
+
+  tcp::socket socket;
+  RingBuffer ring;
+  PeerHandler &handler;
+  Options options;
+
+  std::string peerId;
+  std::size_t maxMessage;
+  std::size_t pieceCount;
+  std::uint64_t pieceLength;
+  std::uint64_t totalLength;
+
+  Bitfield peerPieces;
+  bool peerChoking = true;
+  bool peerInterested = false;
+  bool amChoking = true;
+  bool amInterested = false;
+  bool open = true;
+  // Whether any message other than a keep-alive has arrived.
+  bool received = false;
+  bool timedOut = false;
+
+  std::deque<BlockRequest> outstanding;
+  std::deque<BlockRequest> peerRequests;
+  RateMeter downloadRate;
+  RateMeter uploadRate;
+
+  // Messages queued since the last write, and the batch being written.
+  std::string outbox;
+  std::string sending;
+  net::steady_timer wake;
+
+  // Last read from and write to the socket, for the idle timeout and
+  // keep-alives.
+  std::chrono::steady_clock::time_point lastRead;
+  std::chrono::steady_clock::time_point lastWrite;
+  net::steady_timer idle;
+};
+
+} // namespace btc
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Peer/bitfield.h>
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace btc {
+
+enum class MessageType : std::uint8_t {
+  choke = 0,
+  unchoke = 1,
+  interested = 2,
+  notInterested = 3,
+  have = 4,
+  bitfield = 5,
+  request = 6,
+  piece = 7,
+  cancel = 8,
+  port = 9,
+  keepAlive = 0xFF
+};
+
+// A block of a piece, as carried by request, cancel and piece messages.
+struct BlockRequest {
+  std::uint32_t piece;
+  std::uint32_t offset;
+  std::uint32_t length;
+
+  bool operator==(const BlockRequest &) const = default;
+};
+
+// One framed message. The payload points into the caller's input and is only
+// valid until that input is consumed.
+struct PeerMessage {
+  MessageType type;
+  std::string_view payload;
+};
+
+struct Handshake {
+  std::string infoHash;
+  std::string peerId;
+  std::uint64_t reserved = 0;
+};
+
+// Encoding and decoding of the peer wire protocol (BEP 3). Messages are a
+// 4-byte big-endian length followed by a type byte and the payload; the
+// encoders append to an output buffer so a batch of messages goes out in one
+// write.
+class PeerWire {
+
+private:
+  using exp_size = std::expected<std::size_t, std::error_code>;
+  using exp_handshake = std::expected<Handshake, std::error_code>;
+  using exp_block = std::expected<BlockRequest, std::error_code>;
+
+public:
+  inline static const std::string_view protocol = "BitTorrent protocol";
+  inline static const std::size_t handshakeSize = 68;
+  inline static const std::size_t headerSize = 4;
+
+  static void appendHandshake(std::string &out, std::string_view infoHash,
+                              std::string_view peerId);
+  static exp_handshake parseHandshake(std::string_view in);
+
+  // Frames the first message of `in`. Returns the number of bytes it takes,
+  // or 0 when `in` does not hold a whole message yet. Messages longer than
+  // `maxLength` (not counting the length prefix) are an error.
+  static exp_size frame(std::string_view in, std::size_t maxLength,
+                        PeerMessage &out);
+
+  // Payload of a request or cancel; for a piece message the length is that
+  // of the data following the 8-byte header.
+  static exp_block parseBlock(const PeerMessage &message);
+  static std::string_view pieceData(const PeerMessage &message) {
+    return message.payload.substr(8);
+  }
+  static std::uint32_t parseHave(const PeerMessage &message) {
+    return readU32(message.payload.data());
+  }
+
+  static void append(std::string &out, MessageType type);
+  static void appendHave(std::string &out, std::uint32_t piece);
+  static void appendBitfield(std::string &out, const Bitfield &have);
+  static void appendBlock(std::string &out, MessageType type,
+                          const BlockRequest &block);
+  // The header of a piece message; the block's data follows it.
+  static void appendPieceHeader(std::string &out, const BlockRequest &block);
+
+  static std::uint32_t readU32(const char *p) {
+    return static_cast<std::uint32_t>(static_cast<unsigned char>(p[0])) << 24 |
+           static_cast<std::uint32_t>(static_cast<unsigned char>(p[1])) << 16 |
+           static_cast<std::uint32_t>(static_cast<unsigned char>(p[2])) << 8 |
+           static_cast<std::uint32_t>(static_cast<unsigned char>(p[3]));
+  }
+  static void appendU32(std::string &out, std::uint32_t v) {
+    char bytes[4] = {static_cast<char>(v >> 24), static_cast<char>(v >> 16),
+                     static_cast<char>(v >> 8), static_cast<char>(v)};
+    out.append(bytes, 4);
+  }
+};
+
+} // namespace btc
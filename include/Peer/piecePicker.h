@@ -0,0 +1,163 @@
+#pragma once
+
+#include <Peer/bitfield.h>
+#include <Peer/peerWire.h>
+#include <Torrent/torrentFile.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace btc {
+
+// Chooses which blocks to request. Every piece not yet started sits in a
+// bucket holding the pieces of its availability (the number of connected
+// peers that have it); buckets are intrusive doubly linked lists, so a have
+// message moves a piece to the next bucket in O(1), and rarest-first walks
+// the buckets upwards from availability 1 without sorting. Peers that have
+// every piece raise all pieces alike, so they are a single count instead.
+// The walk passes over at most scanLimit pieces the peer does not have; for
+// a peer with few or only common pieces, the rest of the pick is the least
+// available of a few of its own queued pieces, found a vector of bits at a
+// time, so no pick walks every queued piece.
+//
+// Blocks of pieces already in progress are always handed out first, so
+// pieces are finished rather than all started. Until `randomFirst` pieces
+// are complete, new pieces are picked at random instead: rare pieces are
+// slow to get, and the first pieces are what lets us start uploading. Once
+// every block has been requested the picker enters endgame and hands out
+// blocks that are already requested, up to `endgameDuplicates` requests per
+// block.
+class PiecePicker {
+
+public:
+  inline static const std::size_t defaultBlockSize = 16 * 1024;
+  using requested_fn = std::function<bool(const BlockRequest &)>;
+
+  explicit PiecePicker(const TorrentFile &torrent,
+                       std::size_t blockSize = defaultBlockSize);
+  PiecePicker(std::size_t pieceCount, std::uint64_t pieceLength,
+              std::uint64_t totalLength,
+              std::size_t blockSize = defaultBlockSize);
+
+  // Availability: a peer's bitfield on connect and disconnect, and single
+  // have messages. Seeds, peers whose bitfield is complete, are best added
+  // with addSeed(), which is O(1); a peer must be removed the way it was
+  // added. Counts never go below zero; doing so is a bug in the caller.
+  void addPeer(const Bitfield &pieces);
+  void removePeer(const Bitfield &pieces);
+  void addSeed() { seeds++; }
+  void removeSeed() {
+    assert(seeds > 0 && "seed removed twice");
+    seeds--;
+  }
+  void incrementPiece(std::size_t piece);
+  void decrementPiece(std::size_t piece);
+
+  // Appends up to `count` blocks that the peer with `peerPieces` can serve
+  // to `out` and marks them requested; returns how many were added. In
+  // endgame, blocks for which `requested` is true (those already asked of
+  // this peer) are skipped.
+  std::size_t pick(const Bitfield &peerPieces, std::size_t count,
+                   std::vector<BlockRequest> &out,
+                   const requested_fn &requested = {});
+
+  // A request that will not be answered.
+  void abort(const BlockRequest &block);
+  // Records a block; returns true when it was the piece's last missing
+  // block, so the piece can be verified.
+  bool received(const BlockRequest &block);
+  // After hashing a complete piece.
+  void pieceFailed(std::size_t piece);
+  void setHave(std::size_t piece);
+
+  void setRandomFirst(std::size_t pieces) { randomFirst = pieces; }
+  void setEndgameDuplicates(std::size_t requests) {
+    endgameDuplicates = requests;
+  }
+
+  std::size_t getPieceCount() const { return availability.size(); }
+  std::uint32_t getAvailability(std::size_t piece) const {
+    return availability[piece] + seeds;
+  }
+  bool isHave(std::size_t piece) const { return have.test(piece); }
+  // Our pieces, for bitfield messages and for checking interest with
+  // Bitfield::countAndNot().
+  const Bitfield &getHave() const { return have; }
+  std::size_t getHaveCount() const { return haveCount; }
+  std::size_t getDownloadingCount() const { return downloading.size(); }
+  bool isComplete() const { return haveCount == availability.size(); }
+  // Every block is requested or received, and some are still missing.
+  bool isEndgame() const {
+    return queuedCount == 0 && freeBlocks == 0 && !isComplete();
+  }
+
+private:
+  enum class State : std::uint8_t { queued, downloading, have };
+
+  struct Block {
+    std::uint8_t requests = 0;
+    bool received = false;
+  };
+
+  struct Partial {
+    std::size_t piece;
+    std::vector<Block> blocks;
+    std::size_t missing;
+  };
+
+  inline static const std::uint32_t none = UINT32_MAX;
+  // Pieces the peer lacks passed over by one rarest-first walk, and the
+  // candidates compared when it gives up.
+  inline static const std::size_t scanLimit = 256;
+  inline static const std::size_t sampleSize = 8;
+
+  std::size_t getPieceSize(std::size_t piece) const;
+  std::size_t getBlockCount(std::size_t piece) const;
+  BlockRequest makeBlock(std::size_t piece, std::size_t block) const;
+
+  void link(std::uint32_t piece);
+  void unlink(std::uint32_t piece);
+  void unlink(std::uint32_t piece, std::uint32_t bucket);
+  Partial &start(std::size_t piece);
+  Partial *findPartial(std::size_t piece);
+  std::size_t takeFree(Partial &partial, std::size_t count,
+                       std::vector<BlockRequest> &out);
+  std::size_t pickNew(const Bitfield &peerPieces, std::size_t count,
+                      std::vector<BlockRequest> &out);
+  std::size_t pickEndgame(const Bitfield &peerPieces,
+                          std::size_t count, std::vector<BlockRequest> &out,
+                          std::size_t from, const requested_fn &requested);
+  std::uint32_t random();
+
+  std::uint64_t pieceLength;
+  std::uint64_t totalLength;
+  std::size_t blockSize;
+  std::size_t randomFirst = 4;
+  std::size_t endgameDuplicates = 2;
+
+  // Not counting seeds.
+  std::vector<std::uint32_t> availability;
+  std::uint32_t seeds = 0;
+  std::vector<State> state;
+  Bitfield have;
+  // Pieces not yet started.
+  Bitfield queued;
+  // Bucket lists of queued pieces, indexed by availability.
+  std::vector<std::uint32_t> heads;
+  std::vector<std::uint32_t> next;
+  std::vector<std::uint32_t> prev;
+
+  // Pieces in progress, oldest first.
+  std::vector<Partial> downloading;
+  std::unordered_map<std::size_t, std::size_t> partialIndex;
+
+  std::size_t queuedCount;
+  std::size_t freeBlocks = 0;
+  std::size_t haveCount = 0;
+  std::uint32_t seed = 0x9E3779B9;
+};
+
+} // namespace btc
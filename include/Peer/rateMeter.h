@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace btc {
+
+// Transfer rate as an exponentially decaying average: every byte counts for
+// 1/window bytes per second, fading with time constant `window`. Updating and
+// reading are O(1) and need no timer.
+class RateMeter {
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit RateMeter(std::chrono::duration<double> window =
+                         std::chrono::seconds(2))
+      : window(window.count()) {}
+
+  void add(std::uint64_t bytes, clock::time_point now = clock::now()) {
+    rate = get(now) + static_cast<double>(bytes) / window;
+    last = now;
+    total += bytes;
+  }
+
+  // Bytes per second.
+  double get(clock::time_point now = clock::now()) const {
+    double elapsed = std::chrono::duration<double>(now - last).count();
+    return elapsed > 0 ? rate * std::exp(-elapsed / window) : rate;
+  }
+
+  std::uint64_t getTotal() const { return total; }
+
+private:
+  double window;
+  double rate = 0;
+  clock::time_point last{};
+  std::uint64_t total = 0;
+};
+
+} // namespace btc
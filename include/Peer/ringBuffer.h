@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <span>
+#include <string_view>
+#include <system_error>
+
+namespace btc {
+
+// Receive buffer for framing a byte stream. The same memory is mapped twice,
+// back to back, so both the readable data and the free space are always one
+// contiguous range even when they wrap around the end: a message can be
+// parsed in place however the stream was split. Move-only.
+class RingBuffer {
+
+private:
+  using exp_ring = std::expected<RingBuffer, std::error_code>;
+
+public:
+  // `capacity` is rounded up to a multiple of the page size.
+  static exp_ring create(std::size_t capacity);
+
+  RingBuffer(RingBuffer &&other) noexcept;
+  RingBuffer &operator=(RingBuffer &&other) noexcept;
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+  ~RingBuffer();
+
+  std::string_view data() const {
+    return {base + head % capacity, static_cast<std::size_t>(tail - head)};
+  }
+  // Free space to receive into; commit() makes it readable.
+  std::span<char> prepare() const {
+    return {base + tail % capacity, capacity - static_cast<std::size_t>(
+                                                   tail - head)};
+  }
+  void commit(std::size_t n) { tail += n; }
+  void consume(std::size_t n) { head += n; }
+
+  std::size_t size() const { return static_cast<std::size_t>(tail - head); }
+  std::size_t getCapacity() const { return capacity; }
+
+private:
+  RingBuffer(char *base, std::size_t capacity)
+      : base(base), capacity(capacity) {}
+
+  char *base = nullptr;
+  std::size_t capacity = 0;
+  std::uint64_t head = 0;
+  std::uint64_t tail = 0;
+};
+
+} // namespace btc
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Peer/peerConnection.h>
+#include <Peer/piecePicker.h>
+#include <Storage/writeCache.h>
+#include <Torrent/peer.h>
+#include <Torrent/torrentFile.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <errors.h>
+#include <expected>
+#include <helpers.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace btc {
+
+struct SwarmOptions {
+  std::size_t maxPeers = 50;
+  // In endgame, the most peers a block is requested from at once.
+  std::size_t endgameDuplicates = 3;
+  std::size_t randomFirst = 4;
+  PeerOptions peer;
+};
+
+// Downloads one torrent from the peers a tracker hands out, into a
+// WriteCache. Blocks are chosen by a PiecePicker; the swarm keeps its
+// availability up to date from every connection's bitfield and have
+// messages, and keeps us interested in exactly the peers with pieces we
+// lack.
+//
+// For every outstanding block the swarm knows which connections it was
+// requested from. Once every block is requested, the picker's endgame hands
+// out blocks again to peers that have nothing else outstanding, up to
+// endgameDuplicates, so the last pieces do not wait on the slowest peer;
+// the first copy to arrive is kept and the requests still out elsewhere are
+// cancelled.
+//
+// Runs on the io_context's thread and must outlive its handlers.
+class Swarm : public PeerHandler {
+
+private:
+  using exp_void = std::expected<void, std::error_code>;
+  using await_exp_void = net::awaitable<exp_void>;
+
+public:
+  using Options = SwarmOptions;
+
+  struct Stats {
+    std::size_t duplicateRequests; // endgame requests for a block already out
+    std::size_t cancels;
+    std::size_t piecesFailed;
+  };
+
+  Swarm(net::io_context &ctx, const TorrentFile &torrent, WriteCache &cache,
+        std::string peerId, Options options = {});
+
+  Swarm(const Swarm &) = delete;
+  Swarm &operator=(const Swarm &) = delete;
+
+  // Connects to peers, e.g. those of TrackerResponse::getPeerList(), up to
+  // maxPeers at a time; the rest wait for a free slot. Peers already known
+  // are skipped.
+  void addPeers(const std::vector<Peer> &peers);
+
+  // Completes once every piece is verified and flushed, or fails with
+  // swarmExhaustedErr when no peer is left to finish the download.
+  await_exp_void wait();
+
+  const PiecePicker &getPicker() const { return picker; }
+  std::size_t getConnectionCount() const { return peers.size(); }
+  Stats getStats() const { return stats; }
+
+  void onBitfield(PeerConnection &conn) override;
+  void onHave(PeerConnection &conn, std::uint32_t piece) override;
+  std::optional<BlockRequest> pickBlock(PeerConnection &conn) override;
+  void onBlock(PeerConnection &conn, const BlockRequest &block,
+               std::string_view data) override;
+  void onRequestsDropped(PeerConnection &conn,
+                         std::span<const BlockRequest> blocks) override;
+  void onClose(PeerConnection &conn, std::error_code error) override;
+
+private:
+  struct PeerState {
+    std::shared_ptr<PeerConnection> conn;
+    // Whether its pieces are in the picker's availability, and how.
+    bool counted = false;
+    bool seed = false;
+  };
+
+  static std::uint64_t key(const BlockRequest &block) {
+    return static_cast<std::uint64_t>(block.piece) << 32 | block.offset;
+  }
+
+  net::awaitable<void> connectTo(Peer peer);
+  void connectNext();
+  void updateInterest(PeerConnection &conn);
+  void pieceVerified(std::uint32_t piece);
+  void requestAll();
+  void finish(std::error_code error);
+  void dropOwner(PeerConnection &conn, const BlockRequest &block);
+
+  net::io_context &ctx;
+  const TorrentFile &torrent;
+  WriteCache &cache;
+  std::string peerId;
+  Options options;
+  PiecePicker picker;
+
+  std::unordered_map<PeerConnection *, PeerState> peers;
+  std::unordered_set<std::string> known;
+  std::deque<Peer> candidates;
+  std::size_t connecting = 0;
+
+  // The connections each outstanding block is requested from.
+  std::unordered_map<std::uint64_t, std::vector<PeerConnection *>> owners;
+  std::vector<BlockRequest> picked;
+
+  Stats stats{};
+  bool done = false;
+  std::error_code result;
+  net::steady_timer wake;
+};
+
+} // namespace btc
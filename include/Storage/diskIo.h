@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Storage/diskStorage.h>
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <functional>
+#include <helpers.h>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <threadPool.h>
+#include <vector>
+
+namespace btc {
+
+enum class DiskBackend { threadPool, ioUring };
+
+// Asynchronous block I/O on a DiskStorage. Requests are queued by asyncRead
+// and asyncWrite and handed to the backend in one batch by submit(); each
+// completion handler then runs on the io_context. All calls must come from
+// the thread running the io_context, buffers must stay alive until their
+// handler has run, and the object must outlive its pending requests.
+class DiskIo {
+
+protected:
+  using exp_void = std::expected<void, std::error_code>;
+
+public:
+  using completion_handler = std::function<void(exp_void)>;
+
+  virtual ~DiskIo() = default;
+
+  virtual void asyncRead(std::size_t piece, std::size_t offset,
+                         std::span<char> out, completion_handler onDone) = 0;
+  virtual void asyncWrite(std::size_t piece, std::size_t offset,
+                          std::span<const char> data,
+                          completion_handler onDone) = 0;
+  virtual void submit() = 0;
+
+  virtual DiskBackend getBackend() const = 0;
+
+  // io_uring when requested and the kernel supports it, the thread pool
+  // otherwise.
+  static std::unique_ptr<DiskIo>
+  create(net::io_context &ctx, DiskStorage &storage, ThreadPool &pool,
+         DiskBackend preferred = DiskBackend::ioUring);
+};
+
+// Runs each request as a blocking preadv/pwritev task on a ThreadPool and
+// posts the handler back to the io_context.
+class ThreadPoolDiskIo : public DiskIo {
+
+public:
+  ThreadPoolDiskIo(net::io_context &ctx, DiskStorage &storage,
+                   ThreadPool &pool)
+      : ctx(ctx), storage(storage), pool(pool) {}
+
+  void asyncRead(std::size_t piece, std::size_t offset, std::span<char> out,
+                 completion_handler onDone) override;
+  void asyncWrite(std::size_t piece, std::size_t offset,
+                  std::span<const char> data,
+                  completion_handler onDone) override;
+  void submit() override;
+
+  DiskBackend getBackend() const override { return DiskBackend::threadPool; }
+
+private:
+  struct Request {
+    std::size_t piece;
+    std::size_t offset;
+    std::span<char> buffer;
+    bool writing;
+    completion_handler onDone;
+  };
+
+  net::io_context &ctx;
+  DiskStorage &storage;
+  ThreadPool &pool;
+  std::vector<Request> queued;
+};
+
+} // namespace btc
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Storage/fileMap.h>
+#include <Torrent/torrentFile.h>
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace btc {
+
+enum class Allocation { sparse, full };
+
+// Block I/O on the files of one torrent under a download directory. A block
+// is addressed by piece and offset and may cross file boundaries; each file
+// it touches is accessed with one pwritev/preadv carrying all of the
+// caller's buffers. At most maxOpenFiles descriptors are kept open, evicting
+// the least recently used. All methods may be called from several threads.
+class DiskStorage {
+
+private:
+  using exp_storage = std::expected<DiskStorage, std::error_code>;
+  using exp_void = std::expected<void, std::error_code>;
+
+public:
+  // Creates missing directories and files. Files are sized to their final
+  // length, either sparsely or with fallocate (Allocation::full).
+  static exp_storage open(const TorrentFile &torrent,
+                          const std::filesystem::path &root,
+                          Allocation allocation = Allocation::sparse,
+                          std::size_t maxOpenFiles = 128);
+
+  // Writes the concatenation of `buffers` at `offset` within `piece`.
+  exp_void write(std::size_t piece, std::size_t offset,
+                 std::span<const std::string_view> buffers);
+  exp_void write(std::size_t piece, std::size_t offset,
+                 std::string_view data) {
+    return write(piece, offset, std::span(&data, 1));
+  }
+
+  // Fills `buffers` in order from `offset` within `piece`. Never-written
+  // regions of a sparse file read as zeroes.
+  exp_void read(std::size_t piece, std::size_t offset,
+                std::span<const std::span<char>> buffers);
+  exp_void read(std::size_t piece, std::size_t offset, std::span<char> out) {
+    return read(piece, offset, std::span(&out, 1));
+  }
+
+  // An open descriptor for one file; it stays open while any copy of the
+  // pointer is alive, even after eviction from the cache.
+  struct Handle {
+    int fd;
+    explicit Handle(int fd) : fd(fd) {}
+    ~Handle();
+  };
+  using handle_ptr = std::shared_ptr<const Handle>;
+  using exp_handle = std::expected<handle_ptr, std::error_code>;
+
+  exp_handle handle(std::size_t file);
+  // Whether `length` bytes at `offset` within `piece` lie inside the
+  // torrent's data; like reads and writes, they may run on into later pieces.
+  bool isInRange(std::size_t piece, std::size_t offset,
+                 std::size_t length) const;
+
+  const FileMap &getFileMap() const { return files; }
+  std::size_t getOpenFiles() const;
+
+private:
+  // Descriptor cache, kept behind a pointer so DiskStorage stays movable.
+  struct Cache {
+    std::mutex mutex;
+    std::list<std::size_t> lru;
+    std::unordered_map<std::size_t,
+                       std::pair<handle_ptr, std::list<std::size_t>::iterator>>
+        open;
+  };
+
+  DiskStorage(const TorrentFile &torrent, std::filesystem::path root,
+              std::size_t maxOpenFiles)
+      : files(torrent), root(std::move(root)), maxOpenFiles(maxOpenFiles),
+        cache(std::make_unique<Cache>()) {}
+
+  exp_void transfer(std::size_t piece, std::size_t offset,
+                    std::span<const std::span<char>> buffers, bool writing);
+
+  FileMap files;
+  std::filesystem::path root;
+  std::size_t maxOpenFiles;
+  std::unique_ptr<Cache> cache;
+};
+
+} // namespace btc
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Torrent/torrentFile.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace btc {
+
+// A contiguous run of bytes inside one file of a torrent.
+typedef struct {
+  std::size_t file;
+  std::uint64_t offset;
+  std::size_t length;
+} FileSegment;
+
+// Maps byte ranges of a torrent's data (the concatenation of its files) to
+// the files that hold them. File start offsets are kept as prefix sums and
+// the first file of every piece is precomputed, so resolving a block costs a
+// binary search over the few files inside that one piece.
+class FileMap {
+
+public:
+  explicit FileMap(const TorrentFile &torrent);
+
+  std::size_t getFileCount() const { return starts.size() - 1; }
+  std::uint64_t getFileOffset(std::size_t file) const { return starts[file]; }
+  std::uint64_t getFileLength(std::size_t file) const {
+    return starts[file + 1] - starts[file];
+  }
+  std::uint64_t getTotalLength() const { return starts.back(); }
+  std::size_t getPieceLength() const { return pieceLength; }
+  std::size_t getPieceCount() const { return pieceFirstFile.size() - 1; }
+  std::size_t getPieceSize(std::size_t piece) const;
+
+  // Where file `file` lives under a download directory: root/name for a
+  // single-file torrent, root/name/path otherwise.
+  std::filesystem::path getPath(std::size_t file,
+                                const std::filesystem::path &root) const;
+
+  // The file holding byte `offset` of the torrent (offset < total length).
+  std::size_t fileAt(std::uint64_t offset) const;
+
+  // Appends the segments covering `length` bytes at `offset` within `piece`,
+  // in file order; zero-length files are skipped. The range may run on into
+  // later pieces, or start there.
+  void map(std::size_t piece, std::size_t offset, std::size_t length,
+           std::vector<FileSegment> &out) const;
+  std::vector<FileSegment> map(std::size_t piece, std::size_t offset,
+                               std::size_t length) const;
+
+  // Range [first, last] of files overlapped by `piece`.
+  std::size_t getFirstFile(std::size_t piece) const {
+    return pieceFirstFile[piece];
+  }
+  std::size_t getLastFile(std::size_t piece) const;
+
+private:
+  std::filesystem::path name;
+  std::vector<std::filesystem::path> paths;
+  std::vector<std::uint64_t> starts;
+  std::vector<std::uint32_t> pieceFirstFile;
+  std::size_t pieceLength;
+  bool single;
+};
+
+} // namespace btc
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <errors.h>
+#include <expected>
+#include <filesystem>
+#include <string_view>
+#include <system_error>
+
+namespace btc {
+
+// Read-only, private mapping of a whole file. The contents stay valid for as
+// long as the MappedFile is alive; it is move-only and unmaps on destruction.
+// An empty file yields an empty view without creating a mapping.
+class MappedFile {
+
+private:
+  using exp_mapped = std::expected<MappedFile, std::error_code>;
+
+public:
+  static exp_mapped open(const std::filesystem::path &path);
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  std::string_view getData() const {
+    return {static_cast<const char *>(data), size};
+  }
+
+private:
+  MappedFile(void *data, std::size_t size) : data(data), size(size) {}
+
+  void *data = nullptr;
+  std::size_t size = 0;
+};
+
+} // namespace btc
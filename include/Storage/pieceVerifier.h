@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Storage/resumeData.h>
+#include <Torrent/torrentFile.h>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <threadPool.h>
+#include <vector>
+
+namespace btc {
+
+// Rechecks the data of a torrent against its piece hashes. Files are looked
+// up under `root` the same way they are laid out when downloading: a
+// single-file torrent is root/name, a multi-file one root/name/path.
+// Missing, short or unreadable files simply fail the pieces they cover.
+class PieceVerifier {
+
+public:
+  // Called with (pieces done, pieces total) as batches complete. Calls are
+  // serialised but come from the pool's worker threads.
+  using progress_handler = std::function<void(std::size_t, std::size_t)>;
+
+  // One flag per piece, true when the piece matches its hash. Consecutive
+  // pieces are read and hashed together (see Sha1::hashMany) on `pool`.
+  static std::vector<bool> verify(const TorrentFile &torrent,
+                                  const std::filesystem::path &root,
+                                  ThreadPool &pool,
+                                  progress_handler onProgress = {});
+
+  // Fast resume: pieces whose files all still match the size and mtime in
+  // `resume` keep their recorded state; only the others are read and hashed.
+  // Resume data for another torrent is ignored and everything is hashed.
+  static std::vector<bool> verify(const TorrentFile &torrent,
+                                  const std::filesystem::path &root,
+                                  ThreadPool &pool, const ResumeData &resume,
+                                  progress_handler onProgress = {});
+};
+
+} // namespace btc
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <Storage/diskStorage.h>
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace btc {
+
+// Read cache for seeding, shared by all torrents. A block that misses loads
+// its whole readahead window (the whole piece by default) with one read, so
+// the peer's following requests for neighbouring blocks are served from
+// memory.
+//
+// Replacement is ARC weighted by bytes: windows read once and windows read
+// again live on separate lists, and ghost lists of recent evictions move the
+// split between them. One peer streaming a whole torrent therefore does not
+// push the popular pieces out. All methods may be called from several
+// threads; disk reads happen outside the lock, and what a read loads is not
+// cached if its torrent was invalidated or erased meanwhile.
+class ReadCache {
+
+private:
+  using exp_void = std::expected<void, std::error_code>;
+
+public:
+  struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+  };
+
+  // `window` of 0 reads whole pieces; otherwise pieces are cached in
+  // `window`-sized chunks.
+  explicit ReadCache(std::size_t budget, std::size_t window = 0)
+      : budget(budget), window(window) {}
+
+  // Fills `out` from `offset` within `piece` of the torrent `infoHash`,
+  // stored in `storage`.
+  exp_void read(std::string_view infoHash, DiskStorage &storage,
+                std::size_t piece, std::size_t offset, std::span<char> out);
+
+  // Drops cached data after the piece has been rewritten, or every piece of
+  // a removed torrent.
+  void invalidate(std::string_view infoHash, std::size_t piece);
+  void erase(std::string_view infoHash);
+
+  Stats getStats() const;
+  std::size_t getBudget() const { return budget; }
+  std::size_t getMemoryUsage() const;
+
+private:
+  struct Key {
+    std::string infoHash;
+    std::size_t piece;
+    std::size_t chunk;
+
+    bool operator==(const Key &) const = default;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      std::size_t h = std::hash<std::string>()(key.infoHash);
+      h ^= key.piece * 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+      return h ^ (key.chunk + 0x9E3779B9 + (h << 6) + (h >> 2));
+    }
+  };
+
+  // The windows a torrent has in `nodes`, cached or ghost, by piece. Its
+  // generation changes on every invalidate(); a read that loaded data under
+  // an older one does not insert it.
+  struct Torrent {
+    std::uint64_t generation;
+    std::unordered_map<std::size_t, std::vector<std::size_t>> chunks;
+  };
+
+  // recent and frequent hold data; their ghosts only remember what was
+  // evicted from them.
+  enum class Queue { recent, frequent, recentGhost, frequentGhost };
+
+  struct Node {
+    Queue queue;
+    std::list<Key>::iterator position;
+    std::size_t size;
+    std::unique_ptr<char[]> data;
+    // End of the last read served from the window, relative to its start.
+    std::size_t next;
+  };
+
+  std::list<Key> &list(Queue queue);
+  std::size_t &bytes(Queue queue);
+  void move(Node &node, Queue to);
+  void remove(std::unordered_map<Key, Node, KeyHash>::iterator it);
+  void replace(bool frequentGhostHit);
+  void insert(const Key &key, std::unique_ptr<char[]> data, std::size_t size,
+              std::size_t next);
+  Torrent &torrent(const std::string &infoHash);
+  void removePiece(const std::string &infoHash, Torrent &torrent,
+                   std::size_t piece);
+
+  std::size_t budget;
+  std::size_t window;
+
+  mutable std::mutex mutex;
+  std::unordered_map<Key, Node, KeyHash> nodes;
+  std::unordered_map<std::string, Torrent> torrents;
+  std::uint64_t generations = 0;
+  std::list<Key> lists[4];
+  std::size_t sizes[4] = {};
+  // ARC's adaptive target for the bytes held by the recent list.
+  std::size_t target = 0;
+  Stats stats;
+};
+
+} // namespace btc
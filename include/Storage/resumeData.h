@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Torrent/torrentFile.h>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace btc {
+
+// Size and modification time of a file when resume data was captured; a
+// missing file is recorded with size -1.
+typedef struct {
+  std::int64_t size;
+  std::int64_t mtime;
+} FileStamp;
+
+// Piece completion of one torrent, saved between runs so startup does not
+// have to rehash data that has not changed on disk. Stored bencoded, one file
+// per torrent named after the hex info hash:
+//   d 5:files l d 5:mtime i<ns>e 4:size i<bytes>e e ... e
+//     9:info-hash 20:<hash> 11:piece-count i<n>e 6:pieces <bitfield>
+//     7:version i1e e
+// The bitfield has the first piece in the high bit of the first byte.
+class ResumeData {
+
+private:
+  using exp_resume = std::expected<ResumeData, std::error_code>;
+  using exp_void = std::expected<void, std::error_code>;
+
+public:
+  // Records `pieces` together with the current stamps of the torrent's files
+  // under `root` (laid out as for PieceVerifier).
+  static ResumeData capture(const TorrentFile &torrent,
+                            const std::filesystem::path &root,
+                            std::vector<bool> pieces);
+
+  static exp_resume decode(std::string_view input);
+  std::string encode() const;
+
+  static std::filesystem::path pathFor(const std::filesystem::path &dir,
+                                       std::string_view infoHash);
+  static exp_resume load(const std::filesystem::path &dir,
+                         std::string_view infoHash);
+  exp_void save(const std::filesystem::path &dir) const;
+
+  // One flag per file of `torrent`: true when the file still has the size
+  // and mtime recorded here. All false when this data belongs to another
+  // torrent or another layout.
+  std::vector<bool> unchangedFiles(const TorrentFile &torrent,
+                                   const std::filesystem::path &root) const;
+
+  const std::string &getInfoHash() const { return infoHash; }
+  const std::vector<bool> &getPieces() const { return pieces; }
+  const std::vector<FileStamp> &getFiles() const { return files; }
+
+private:
+  ResumeData() {}
+
+  static std::vector<std::filesystem::path>
+  filePaths(const TorrentFile &torrent, const std::filesystem::path &root);
+  static FileStamp stamp(const std::filesystem::path &path);
+
+  std::string infoHash;
+  std::vector<bool> pieces;
+  std::vector<FileStamp> files;
+
+  inline static const std::int64_t version = 1;
+};
+
+} // namespace btc
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Storage/diskIo.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <errors.h>
+#include <expected>
+#include <helpers.h>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <vector>
+
+namespace btc {
+
+// DiskIo on a Linux io_uring, driven through the raw system calls. Every file
+// segment of a block becomes one read or write SQE; submit() pushes the whole
+// batch with a single io_uring_enter. Completions signal an eventfd that the
+// io_context watches, so handlers run on the io_context without any extra
+// thread. Torrents with at most maxRegisteredFiles files have their
+// descriptors registered with the ring, and blocks that lie inside buffers
+// given to registerBuffers use the fixed-buffer opcodes.
+class UringDiskIo : public DiskIo {
+
+private:
+  using exp_uring =
+      std::expected<std::unique_ptr<UringDiskIo>, std::error_code>;
+
+public:
+  static exp_uring create(net::io_context &ctx, DiskStorage &storage,
+                          unsigned entries = 256);
+  ~UringDiskIo() override;
+
+  void asyncRead(std::size_t piece, std::size_t offset, std::span<char> out,
+                 completion_handler onDone) override;
+  void asyncWrite(std::size_t piece, std::size_t offset,
+                  std::span<const char> data,
+                  completion_handler onDone) override;
+  void submit() override;
+
+  DiskBackend getBackend() const override { return DiskBackend::ioUring; }
+
+  // Registers long-lived buffers (e.g. a block pool) with the kernel. May be
+  // called once, before any request uses them.
+  bool registerBuffers(std::span<const std::span<char>> buffers);
+
+  inline static const std::size_t maxRegisteredFiles = 1024;
+
+private:
+  struct Request {
+    completion_handler onDone;
+    std::error_code error;
+    std::size_t pending = 0;
+  };
+
+  // One SQE worth of work; re-queued with the remainder after a short
+  // transfer.
+  struct Operation {
+    Request *request;
+    DiskStorage::handle_ptr handle;
+    std::size_t file;
+    std::uint64_t offset;
+    char *data;
+    std::size_t length;
+    bool writing;
+  };
+
+  struct Ring;
+
+  UringDiskIo(net::io_context &ctx, DiskStorage &storage);
+
+  void enqueue(std::size_t piece, std::size_t offset, std::span<char> buffer,
+               bool writing, completion_handler onDone);
+  void fill();
+  std::vector<Operation *> takeUnsubmitted();
+  void fail(int error);
+  void reap();
+  void wait();
+  void complete(Operation *op, std::int32_t res);
+
+  net::io_context &ctx;
+  DiskStorage &storage;
+  std::unique_ptr<Ring> ring;
+  net::posix::stream_descriptor event;
+  net::steady_timer retry;
+
+  std::vector<DiskStorage::handle_ptr> registeredFiles;
+  std::vector<std::span<char>> registeredBuffers;
+
+  std::deque<Operation *> backlog;
+  std::size_t inFlight = 0;
+  std::size_t unsubmitted = 0;
+  bool waiting = false;
+  bool retrying = false;
+};
+
+} // namespace btc
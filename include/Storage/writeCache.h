@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Storage/diskStorage.h>
+#include <Torrent/pieceHashes.h>
+#include <Torrent/torrentFile.h>
+#include <cstddef>
+#include <errors.h>
+#include <expected>
+#include <list>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace btc {
+
+enum class BlockStatus { stored, pieceVerified, pieceFailed };
+
+// Write-back cache in front of a DiskStorage. Incoming blocks are gathered
+// into a buffer per piece; the piece is hashed as soon as its last block
+// arrives, while the data is still in cache, and a verified piece goes to
+// disk as one write when it is evicted or flushed. Pieces that fail the hash
+// check are dropped without touching the disk.
+//
+// At most `budget` bytes of piece buffers are held; making room evicts the
+// least recently written piece. An evicted partial piece spills its blocks to
+// disk and is completed from there, so nothing is lost. Not thread-safe.
+class WriteCache {
+
+private:
+  using exp_status = std::expected<BlockStatus, std::error_code>;
+  using exp_void = std::expected<void, std::error_code>;
+
+public:
+  inline static const std::size_t defaultBlockSize = 16 * 1024;
+
+  WriteCache(DiskStorage &storage, const TorrentFile &torrent,
+             std::size_t budget, std::size_t blockSize = defaultBlockSize)
+      : storage(storage), hashes(torrent.getPieces()), budget(budget),
+        blockSize(blockSize) {}
+  // Flushes what is left, ignoring errors; call flushAll() to see them.
+  ~WriteCache();
+
+  WriteCache(const WriteCache &) = delete;
+  WriteCache &operator=(const WriteCache &) = delete;
+
+  // Stores one block. Blocks must start on a blockSize boundary and be
+  // blockSize long, except the last block of a piece. Re-sent blocks
+  // overwrite the earlier copy.
+  exp_status write(std::size_t piece, std::size_t offset,
+                   std::string_view data);
+
+  // Copies `out.size()` bytes at `offset` of a cached, verified piece;
+  // returns false if that piece is not in the cache.
+  bool read(std::size_t piece, std::size_t offset, std::span<char> out) const;
+
+  // Writes out one piece (verified or not) and drops it from the cache.
+  exp_void flush(std::size_t piece);
+  exp_void flushAll();
+
+  std::size_t getBudget() const { return budget; }
+  std::size_t getMemoryUsage() const { return usage; }
+  std::size_t getCachedPieces() const { return entries.size(); }
+
+private:
+  struct Entry {
+    std::unique_ptr<char[]> data;
+    std::size_t size;
+    std::vector<bool> received;
+    std::vector<bool> onDisk;
+    std::size_t missing;
+    bool verified = false;
+    std::list<std::size_t>::iterator position;
+  };
+
+  std::size_t getBlockCount(std::size_t piece) const;
+  exp_void makeRoom(std::size_t size);
+  exp_void evict(std::size_t piece);
+  exp_void writeBlocks(std::size_t piece, const Entry &entry);
+  exp_status complete(std::size_t piece, Entry &entry);
+
+  DiskStorage &storage;
+  PieceHashes hashes;
+  std::size_t budget;
+  std::size_t blockSize;
+  std::size_t usage = 0;
+
+  std::list<std::size_t> lru;
+  std::unordered_map<std::size_t, Entry> entries;
+  // Blocks of evicted partial pieces that are already on disk.
+  std::unordered_map<std::size_t, std::vector<bool>> spilled;
+};
+
+} // namespace btc
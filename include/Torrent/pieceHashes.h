@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <errors.h>
+#include <expected>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace btc {
+
+// The SHA-1 piece hashes of a torrent, validated against its total length.
+// The table is immutable and shared: copies only bump a reference count.
+class PieceHashes {
+
+private:
+  using exp_hashes = std::expected<PieceHashes, std::error_code>;
+
+public:
+  inline static const std::size_t hashSize = 20;
+  using hash_view = std::span<const unsigned char, hashSize>;
+
+  PieceHashes() = default;
+
+  // `pieces` is the raw "pieces" field; it must hold exactly one hash per
+  // pieceLength bytes of content, the last piece possibly being shorter.
+  static exp_hashes create(std::string_view pieces, std::size_t pieceLength,
+                           std::size_t totalLength);
+
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  hash_view hash(std::size_t index) const {
+    assert(index < count);
+    return hash_view(data.get() + index * hashSize, hashSize);
+  }
+
+  // All hashes back to back, as they appear in the metainfo file.
+  std::string_view getRaw() const {
+    return {reinterpret_cast<const char *>(data.get()), count * hashSize};
+  }
+
+private:
+  PieceHashes(std::shared_ptr<const unsigned char[]> data, std::size_t count)
+      : data(std::move(data)), count(count) {}
+
+  std::shared_ptr<const unsigned char[]> data;
+  std::size_t count = 0;
+};
+
+} // namespace btc
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <Torrent/pieceHashes.h>
 #include <chrono>
 #include <filesystem>
 #include <optional>
@@ -22,7 +23,8 @@ private:
   std::string announce{};
   std::string name{};
   std::size_t pieceLength{};
-  std::string pieces{};
+  std::size_t totalLength{};
+  PieceHashes pieces{};
   std::string infoHash{};
 
   bool private_{};
@@ -42,10 +44,11 @@ private:
 public:
   const std::string &getAnnounce() const { return announce; }
   const std::string &getName() const { return name; }
-  const std::string &getPieces() const { return pieces; }
+  const PieceHashes &getPieces() const { return pieces; }
   const std::string &getInfoHash() const { return infoHash; }
 
   std::size_t getPieceLength() const { return pieceLength; }
+  std::size_t getTotalLength() const { return totalLength; }
   bool isPrivate() const { return private_; }
 
   const std::optional<std::size_t> &getLength() const { return length; }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Torrent/torrentFile.h>
+#include <cstddef>
+#include <errors.h>
+#include <expected>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <system_error>
+#include <threadPool.h>
+#include <vector>
+
+namespace btc {
+
+typedef struct {
+  std::filesystem::path path;
+  std::expected<TorrentFile, std::error_code> torrent;
+} LoadedTorrent;
+
+// Parses many metainfo files at once on a ThreadPool. Results come back in
+// the order of the input paths, each holding either the torrent or the error
+// for that file; one bad file never fails the batch.
+class TorrentLoader {
+
+private:
+  using exp_paths =
+      std::expected<std::vector<std::filesystem::path>, std::error_code>;
+  using exp_loaded =
+      std::expected<std::vector<LoadedTorrent>, std::error_code>;
+
+public:
+  // Called with (files done, files total) after each file is parsed. Calls
+  // are serialised but come from the pool's worker threads.
+  using progress_handler = std::function<void(std::size_t, std::size_t)>;
+
+  // Blocks until every file is parsed. Called from one of the pool's own
+  // workers, it parses the files on that thread instead, since waiting there
+  // could hold up the tasks it waits for.
+  static std::vector<LoadedTorrent>
+  loadFiles(std::span<const std::filesystem::path> paths, ThreadPool &pool,
+            progress_handler onProgress = {});
+
+  // Every regular *.torrent file directly inside `dir`, sorted by path.
+  static exp_paths listDirectory(const std::filesystem::path &dir);
+  static exp_loaded loadDirectory(const std::filesystem::path &dir,
+                                  ThreadPool &pool,
+                                  progress_handler onProgress = {});
+};
+
+} // namespace btc
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <Bencode/bencodeValue.h>
+#include <Bencode/bencodeView.h>
+#include <Torrent/pieceHashes.h>
 #include <Torrent/torrentFile.h>
 #include <chrono>
 #include <errors.h>
@@ -8,6 +9,7 @@
 #include <filesystem>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <vector>
 
@@ -19,40 +21,44 @@ class TorrentParser {
 private:
   using exp_torrentfile = std::expected<TorrentFile, std::error_code>;
   using exp_string = std::expected<std::string, std::error_code>;
+  using exp_path = std::expected<std::filesystem::path, std::error_code>;
   using exp_sizet = std::expected<std::size_t, std::error_code>;
   using exp_filemode = std::expected<FileMode, std::error_code>;
   using exp_fileinfo = std::expected<FileInfo, std::error_code>;
   using exp_files = std::expected<std::vector<FileInfo>, std::error_code>;
+  using exp_hashes = std::expected<PieceHashes, std::error_code>;
 
   using opt_string = std::optional<std::string>;
   using opt_stringlist = std::optional<std::vector<std::string>>;
   using opt_date = std::optional<std::chrono::year_month_day>;
 
 public:
-  static exp_torrentfile parseContent(std::string content,
+  static exp_torrentfile parseContent(std::string_view content,
                                       BencodeDecoder decoder);
   static exp_torrentfile parseFile(std::filesystem::path path,
                                    BencodeDecoder decoder);
 
 private:
-  static exp_string parseAnnounce(BNode root);
-
-  static exp_sizet parsePieceLength(BNode info);
-  static exp_string parseName(BNode info);
-  static exp_string parsePieces(BNode info);
-  static exp_filemode validateFileMode(BNode info);
-  static exp_sizet parseSingle(BNode info);
-
-  static exp_fileinfo parseFile(BNode file);
-  static exp_sizet parseFileLength(BNode file);
-  static exp_string parseFilePath(BNode file);
-  static exp_files parseMultiple(BNode info);
-
-  static opt_string parseComment(BNode root);
-  static opt_string parseCreatedBy(BNode root);
-  static opt_string parseEncoding(BNode root);
-  static opt_date parseCreationDate(BNode root);
-  static opt_stringlist parseAnnounceList(BNode root);
+  static exp_string parseAnnounce(const BView &root);
+
+  static exp_sizet parsePieceLength(const BView &info);
+  static bool isSafeComponent(std::string_view component);
+  static exp_string parseName(const BView &info);
+  static exp_hashes parsePieces(const BView &info, std::size_t pieceLength,
+                                std::size_t totalLength);
+  static exp_filemode validateFileMode(const BView &info);
+  static exp_sizet parseSingle(const BView &info);
+
+  static exp_fileinfo parseFile(const BView &file);
+  static exp_sizet parseFileLength(const BView &file);
+  static exp_path parseFilePath(const BView &file);
+  static exp_files parseMultiple(const BView &info);
+
+  static opt_string parseComment(const BView &root);
+  static opt_string parseCreatedBy(const BView &root);
+  static opt_string parseEncoding(const BView &root);
+  static opt_date parseCreationDate(const BView &root);
+  static opt_stringlist parseAnnounceList(const BView &root);
 };
 
 } // namespace btc
@@ -1,11 +1,12 @@
 #pragma once
 
-#include <Bencode/bencodeValue.h>
 #include <Torrent/peer.h>
 #include <cstdint>
 #include <expected>
 #include <helpers.h>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <unordered_map>
 #include <vector>
@@ -91,7 +92,6 @@ private:
 class TrackerManager {
 
 private:
-  using opt_peers = std::optional<std::vector<Peer>>;
   using exp_tracker_resp = std::expected<TrackerResponse, std::error_code>;
   using await_exp_tracker_resp = net::awaitable<exp_tracker_resp>;
 
@@ -99,16 +99,17 @@ public:
   TrackerManager(net::io_context &ctx) : ctx(ctx) {}
   await_exp_tracker_resp send(TrackerRequest req);
 
+  // Parses an HTTP tracker reply body for `req`; no I/O is involved.
+  static exp_tracker_resp parseHttp(std::string_view resp,
+                                    TrackerRequest &req);
+
 private:
   net::io_context &ctx;
   std::unordered_map<std::string, std::string> httpUrls;
 
-  await_exp_tracker_resp httpSend(TrackerRequest req);
-  static opt_peers parseCompactPeersHttp(BNode root);
-  static opt_peers parsePeersHttp(BNode root);
+  class ResponseHandler;
 
-  static exp_tracker_resp parseHttp(const std::span<char const> &resp,
-                                    TrackerRequest &req);
+  await_exp_tracker_resp httpSend(TrackerRequest req);
 
   void appendQuery(std::string &q, std::string k, std::string v);
   void appendQuery(std::string &q, std::string k, std::int64_t v);
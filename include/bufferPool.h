@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <errors.h>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace btc {
+
+class BufferPool;
+
+// A reference-counted handle to one pooled buffer. Copies share the buffer,
+// so a block read from a socket can be queued for disk and kept for a peer
+// at the same time without copying; the last handle to go returns it to the
+// pool. Handles may be passed between threads.
+class Buffer {
+
+public:
+  Buffer() = default;
+  Buffer(const Buffer &other) : header(other.header) { retain(); }
+  Buffer(Buffer &&other) noexcept : header(std::exchange(other.header, {})) {}
+  Buffer &operator=(Buffer other) noexcept {
+    std::swap(header, other.header);
+    return *this;
+  }
+  ~Buffer() { release(); }
+
+  char *data() const { return header->data; }
+  std::size_t size() const;
+  std::span<char> span() const { return {data(), size()}; }
+  std::string_view view(std::size_t length) const { return {data(), length}; }
+
+  explicit operator bool() const { return header != nullptr; }
+  std::uint32_t useCount() const {
+    return header ? header->refs.load(std::memory_order_relaxed) : 0;
+  }
+
+private:
+  friend class BufferPool;
+
+  struct Header {
+    BufferPool *pool;
+    char *data;
+    std::atomic<std::uint32_t> refs;
+  };
+
+  explicit Buffer(Header *header) : header(header) {}
+  void retain() {
+    if (header)
+      header->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  void release();
+
+  Header *header = nullptr;
+};
+
+// Fixed-size, page-aligned buffers for network blocks (16 KiB) or whole
+// pieces. Buffers are carved from slabs allocated on demand, up to
+// maxBuffers, and recycled rather than freed. Threads are spread over a
+// fixed set of free lists, twice as many as hardware threads, so a list is
+// shared only when there are more threads than that. A thread releases into
+// and acquires from its own list; when that is empty it takes half of
+// another list. Whether a buffer is free at all is decided by an atomic
+// count of free buffers, reserved from before any list is scanned; the pool
+// grows only when that count is zero. The pool must outlive all of its
+// buffers.
+class BufferPool {
+
+private:
+  using exp_buffer = std::expected<Buffer, std::error_code>;
+
+public:
+  struct Stats {
+    std::size_t bufferSize;
+    std::size_t capacity;  // buffers allocated so far
+    std::size_t inUse;     // buffers held by handles
+    std::size_t peakInUse;
+    std::size_t maxBuffers;
+  };
+
+  inline static const std::size_t pageSize = 4096;
+  inline static const std::size_t buffersPerSlab = 64;
+
+  BufferPool(std::size_t bufferSize, std::size_t maxBuffers);
+  ~BufferPool();
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // Fails with bufferPoolExhaustedErr once maxBuffers are in use.
+  exp_buffer acquire();
+
+  std::size_t getBufferSize() const { return bufferSize; }
+  Stats getStats() const;
+
+private:
+  friend class Buffer;
+
+  struct FreeList {
+    std::mutex mutex;
+    std::vector<Buffer::Header *> buffers;
+  };
+
+  struct Slab {
+    std::unique_ptr<char, void (*)(void *)> memory;
+    std::unique_ptr<Buffer::Header[]> headers;
+  };
+
+  FreeList &localList();
+  bool grow();
+  void recycle(Buffer::Header *header);
+
+  std::size_t bufferSize;
+  std::size_t maxBuffers;
+  std::vector<std::unique_ptr<FreeList>> lists;
+
+  std::mutex slabMutex;
+  std::vector<Slab> slabs;
+  std::atomic<std::size_t> capacity = 0;
+  // Buffers in the free lists not yet reserved by an acquire().
+  std::atomic<std::size_t> available = 0;
+  std::atomic<std::size_t> inUse = 0;
+  std::atomic<std::size_t> peakInUse = 0;
+};
+
+inline std::size_t Buffer::size() const {
+  return header->pool->getBufferSize();
+}
+
+inline void Buffer::release() {
+  if (header && header->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    header->pool->recycle(header);
+  header = nullptr;
+}
+
+} // namespace btc
@@ -65,6 +65,7 @@ enum error_code {
   filePathNotListErr,
   filePathFragmentNotStrErr,
   filesFieldItemNotDictErr,
+  filesFieldEmptyErr,
 
   pieceLengthNegativeErr,
   pieceLengthZeroErr,
@@ -72,8 +73,10 @@ enum error_code {
   singleLengthZeroErr,
   multiLengthNegativeErr,
   multiLengthZeroErr,
+  totalLengthOverflowErr,
 
   piecesFieldLengthNonDivisibleBy20Err,
+  pieceCountMismatchErr,
 
   bothLengthAndFilesFieldsMissingErr,
   bothLengthAndFilesFieldsPresentErr,
@@ -84,7 +87,33 @@ enum error_code {
 
   invalidUrlSchemeErr,
   invalidTrackerResponseErr,
-  scrapeNotSupported
+  scrapeNotSupported,
+
+  // ---------------------------------
+  // STORAGE
+  // ---------------------------------
+
+  errorWritingFileErr,
+  errorReadingFileErr,
+  invalidResumeDataErr,
+  invalidBlockRangeErr,
+  unsafeFilePathErr,
+  ioUringUnavailableErr,
+  bufferPoolExhaustedErr,
+
+  // ---------------------------------
+  // PEER
+  // ---------------------------------
+
+  invalidHandshakeErr,
+  infoHashMismatchErr,
+  invalidPeerMessageErr,
+  peerMessageTooLargeErr,
+  peerConnectionClosedErr,
+  ringBufferMappingErr,
+  invalidBitfieldErr,
+  swarmExhaustedErr,
+  peerTimeoutErr
 };
 
 static const std::unordered_map<error_code, std::string> err_mess = {
@@ -139,6 +168,7 @@ static const std::unordered_map<error_code, std::string> err_mess = {
     {filePathNotListErr, "Path field in file item is not a list."},
     {filePathFragmentNotStrErr, "Path fragment in file item is not a string."},
     {filesFieldItemNotDictErr, "An item in files field is not a dictionary."},
+    {filesFieldEmptyErr, "Files field in multi-file mode is empty."},
 
     {pieceLengthNegativeErr, "Piece length is negative."},
     {pieceLengthZeroErr, "Piece length is zero."},
@@ -146,9 +176,12 @@ static const std::unordered_map<error_code, std::string> err_mess = {
     {singleLengthZeroErr, "Length field in single-file mode is zero."},
     {multiLengthNegativeErr, "Length field in multi-file mode is negative."},
     {multiLengthZeroErr, "Length field in multi-file mode is zero."},
+    {totalLengthOverflowErr, "Total length of the files is too large."},
 
     {piecesFieldLengthNonDivisibleBy20Err,
      "Pieces field length is not divisible by 20."},
+    {pieceCountMismatchErr,
+     "Number of piece hashes does not match the total length."},
 
     {bothLengthAndFilesFieldsMissingErr,
      "Both length and files fields are missing."},
@@ -161,5 +194,31 @@ static const std::unordered_map<error_code, std::string> err_mess = {
 
     {invalidUrlSchemeErr, "the announce url scheme was neither http or udp"},
     {scrapeNotSupported, "the tracker does not support scrape requests "},
-    {invalidTrackerResponseErr, "the tracker response is invalid"}};
+    {invalidTrackerResponseErr, "the tracker response is invalid"},
+
+    // ---------------------------------
+    // STORAGE
+    // ---------------------------------
+
+    {errorWritingFileErr, "Error writing file"},
+    {errorReadingFileErr, "Error reading file"},
+    {invalidResumeDataErr, "Resume data is invalid or malformed"},
+    {invalidBlockRangeErr, "Block lies outside the torrent's data"},
+    {unsafeFilePathErr, "File path escapes the download directory"},
+    {ioUringUnavailableErr, "io_uring is not available on this system"},
+    {bufferPoolExhaustedErr, "All buffers of the pool are in use"},
+
+    // ---------------------------------
+    // PEER
+    // ---------------------------------
+
+    {invalidHandshakeErr, "The peer handshake is invalid"},
+    {infoHashMismatchErr, "The peer handshake is for another torrent"},
+    {invalidPeerMessageErr, "The peer sent an invalid message"},
+    {peerMessageTooLargeErr, "The peer sent a message that is too large"},
+    {peerConnectionClosedErr, "The peer connection was closed"},
+    {ringBufferMappingErr, "Could not map the receive ring buffer"},
+    {invalidBitfieldErr, "The bitfield does not match the piece count"},
+    {swarmExhaustedErr, "No peer is left to complete the download"},
+    {peerTimeoutErr, "The peer did not answer in time"}};
 } // namespace btc
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace btc {
+
+// Fixed-size pool with one task deque per worker. A worker takes its own
+// newest task first and, when it runs dry, steals the oldest task of another
+// worker, so uneven batches even out without a single contended queue.
+// Tasks submitted from a worker go to that worker's deque; others are spread
+// round-robin. Submitting and claiming a task touch only the deques and an
+// atomic count; the pool-wide lock is taken only to park an idle worker or
+// to wake one. Destruction drains all queued tasks before joining.
+class ThreadPool {
+
+public:
+  using task_t = std::function<void()>;
+
+  explicit ThreadPool(
+      std::size_t threads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(task_t task);
+  std::size_t size() const { return workers.size(); }
+  // Whether the caller is one of this pool's workers, which must not block
+  // on tasks it submits.
+  bool isWorkerThread() const { return currentPool == this; }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<task_t> tasks;
+  };
+
+  void run(std::size_t index);
+  bool take(std::size_t index, task_t &task);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<std::size_t> next = 0;
+
+  // Tasks in the deques, and workers parked on `wake` waiting for one.
+  std::atomic<std::size_t> queued = 0;
+  std::atomic<std::size_t> sleeping = 0;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  inline static thread_local const ThreadPool *currentPool = nullptr;
+  inline static thread_local std::size_t currentIndex = 0;
+};
+
+} // namespace btc
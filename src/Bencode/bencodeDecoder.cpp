@@ -1,75 +1,297 @@
 #include "Bencode/bencodeValue.h"
+#include "Bencode/bencodeView.h"
 #include <Bencode/bencodeDecoder.h>
+#include <Bencode/bencodeScanner.h>
+#include <algorithm>
+#include <charconv>
 #include <cstddef>
 #include <errors.h>
 #include <expected>
-#include <stdexcept>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <vector>
 
 namespace btc {
 
-BencodeDecoder::exp_node BencodeDecoder::decode(std::string_view input) {
-  depth = 0;
-  auto result = internal_decode(&input);
-  if (result && !input.empty())
-    return std::unexpected(error_code::trailingInputErr);
-  return result;
-}
+// Builds an owning BNode tree. Open containers are kept on a stack and moved
+// into their parent when they close.
+class BencodeDecoder::NodeBuilder {
 
-BencodeDecoder::exp_node
-BencodeDecoder::internal_decode(std::string_view *input) {
-  if (++depth == maxDepth)
-    return std::unexpected(error_code::maximumNestingLimitExcedeedErr);
-  if (input->empty())
-    return std::unexpected(error_code::emptyInputErr);
-
-  switch (input->at(0)) {
-  case '0':
-  case '1':
-  case '2':
-  case '3':
-  case '4':
-  case '5':
-  case '6':
-  case '7':
-  case '8':
-  case '9':
-  case '+':
-  case '-': {
-    auto result = decode_str(input);
-    depth--;
-    return result.has_value()
-               ? std::expected<BNode, std::error_code>(BNode(result.value()))
-               : std::unexpected(result.error());
+public:
+  exp_void integer(BNode::int_t val, std::string_view) {
+    return add(BNode(val));
+  }
+  exp_void string(std::string_view val, std::string_view) {
+    return add(BNode(BNode::string_t(val)));
+  }
+  void beginList() { open.emplace_back(BNode::list_t{}); }
+  void beginDict() { open.emplace_back(BNode::dict_t{}); }
+  void key(std::string_view k) { keys.emplace_back(k); }
+  exp_void endList(std::string_view) { return close(); }
+  exp_void endDict(std::string_view) { return close(); }
+
+  BNode take() { return std::move(root); }
+
+private:
+  exp_void add(BNode node) {
+    if (open.empty()) {
+      root = std::move(node);
+      return {};
+    }
+    BNode &parent = open.back();
+    if (parent.isList()) {
+      parent.getList().push_back(std::move(node));
+      return {};
+    }
+    auto inserted =
+        parent.getDict().emplace(std::move(keys.back()), std::move(node));
+    keys.pop_back();
+    if (!inserted.second)
+      return std::unexpected(error_code::duplicateKeyErr);
+    return {};
   }
 
-  case 'i': {
-    auto result = decode_int(input);
-    depth--;
-    return result.has_value()
-               ? std::expected<BNode, std::error_code>(BNode(result.value()))
-               : std::unexpected(result.error());
+  exp_void close() {
+    BNode node = std::move(open.back());
+    open.pop_back();
+    return add(std::move(node));
   }
 
-  case 'l': {
-    auto result = decode_list(input);
-    depth--;
-    return result.has_value()
-               ? std::expected<BNode, std::error_code>(BNode(result.value()))
-               : std::unexpected(result.error());
+  std::vector<BNode> open;
+  std::vector<BNode::string_t> keys;
+  BNode root;
+};
+
+// Builds a BView tree inside a document arena. Children of the open
+// containers are staged on shared stacks and copied into the arena in one
+// block when their container closes.
+class BencodeDecoder::ViewBuilder {
+
+public:
+  explicit ViewBuilder(std::pmr::memory_resource *memory) : memory(memory) {}
+
+  exp_void integer(BNode::int_t val, std::string_view raw) {
+    return add(BView(val, raw));
+  }
+  exp_void string(std::string_view val, std::string_view raw) {
+    return add(BView(val, raw));
+  }
+  void beginList() { open.push_back({true, true, items.size()}); }
+  void beginDict() { open.push_back({false, true, entries.size()}); }
+  void key(std::string_view k) { keys.push_back(k); }
+
+  exp_void endList(std::string_view raw) {
+    std::size_t first = open.back().first;
+    open.pop_back();
+    return add(BView(commit(items, first), raw));
   }
 
-  case 'd': {
-    auto result = decode_dict(input);
-    depth--;
-    return result.has_value()
-               ? std::expected<BNode, std::error_code>(BNode(result.value()))
-               : std::unexpected(result.error());
+  // Keys are expected in sorted order as mandated by the spec; out-of-order
+  // dictionaries are still accepted and sorted once they are complete.
+  exp_void endDict(std::string_view raw) {
+    auto [isList, sorted, first] = open.back();
+    open.pop_back();
+
+    if (!sorted) {
+      auto begin = entries.begin() + first;
+      auto byKey = [](const BView::entry_t &a, const BView::entry_t &b) {
+        return a.first < b.first;
+      };
+      auto sameKey = [](const BView::entry_t &a, const BView::entry_t &b) {
+        return a.first == b.first;
+      };
+      std::sort(begin, entries.end(), byKey);
+      if (std::adjacent_find(begin, entries.end(), sameKey) != entries.end())
+        return std::unexpected(error_code::duplicateKeyErr);
+    }
+    return add(BView(commit(entries, first), raw));
   }
+
+  BView take() { return root; }
+
+private:
+  struct Container {
+    bool isList;
+    bool sorted;
+    std::size_t first;
+  };
+
+  exp_void add(BView node) {
+    if (open.empty()) {
+      root = node;
+      return {};
+    }
+    Container &parent = open.back();
+    if (parent.isList) {
+      items.push_back(node);
+      return {};
+    }
+
+    std::string_view k = keys.back();
+    keys.pop_back();
+    if (entries.size() > parent.first && k <= entries.back().first) {
+      if (k == entries.back().first)
+        return std::unexpected(error_code::duplicateKeyErr);
+      parent.sorted = false;
+    }
+    entries.emplace_back(k, node);
+    return {};
   }
 
-  depth--;
-  return std::unexpected(error_code::invalidTypeEncounterErr);
+  template <typename T>
+  std::span<const T> commit(std::vector<T> &stack, std::size_t first) {
+    std::size_t count = stack.size() - first;
+    if (count == 0)
+      return {};
+    T *out = static_cast<T *>(memory->allocate(count * sizeof(T), alignof(T)));
+    std::uninitialized_copy(stack.begin() + first, stack.end(), out);
+    stack.resize(first);
+    return {out, count};
+  }
+
+  std::pmr::memory_resource *memory;
+  std::vector<Container> open;
+  std::vector<std::string_view> keys;
+  std::vector<BView> items;
+  std::vector<BView::entry_t> entries;
+  BView root;
+};
+
+BencodeDecoder::exp_node BencodeDecoder::decode(std::string_view input) {
+  NodeBuilder builder;
+  auto result = parse(&input, builder);
+  if (!result)
+    return std::unexpected(result.error());
+  if (!input.empty())
+    return std::unexpected(error_code::trailingInputErr);
+  return builder.take();
+}
+
+BencodeDecoder::exp_document
+BencodeDecoder::decodeView(std::string_view input) {
+  auto memory = std::make_unique<BDocument::arena_t>(
+      std::clamp<std::size_t>(input.size() / 16, 512, 64 * 1024));
+  ViewBuilder builder(memory.get());
+
+  auto result = parse(&input, builder);
+  if (!result)
+    return std::unexpected(result.error());
+  if (!input.empty())
+    return std::unexpected(error_code::trailingInputErr);
+  return BDocument(std::move(memory), builder.take());
+}
+
+// Walks the input once, reporting values and container boundaries to the
+// builder. An error raised anywhere inside a list is reported as an invalid
+// list element, except for the nesting limit which always surfaces as is.
+template <typename Builder>
+BencodeDecoder::exp_void BencodeDecoder::parse(std::string_view *input,
+                                               Builder &builder) {
+  struct Frame {
+    bool isList;
+    bool atKey;
+    bool badKey;
+    const char *start;
+  };
+  std::vector<Frame> frames;
+  std::size_t lists = 0;
+
+  auto fail = [](std::error_code e, std::size_t enclosingLists) -> exp_void {
+    if (enclosingLists > 0 && e != error_code::maximumNestingLimitExcedeedErr)
+      return std::unexpected(error_code::invalidListElementErr);
+    return std::unexpected(e);
+  };
+  auto isStringStart = [](char c) {
+    return (c >= '0' && c <= '9') || c == '+' || c == '-';
+  };
+
+  for (;;) {
+    exp_void added;
+
+    if (!frames.empty() && (frames.back().isList || frames.back().atKey)) {
+      Frame &top = frames.back();
+      if (input->empty())
+        return fail(top.isList ? error_code::missingListTerminatorErr
+                               : error_code::missingDictTerminatorErr,
+                    lists - top.isList);
+
+      if (input->front() != 'e' && !top.isList) {
+        if (frames.size() + 1 >= maxDepth)
+          return fail(error_code::maximumNestingLimitExcedeedErr, lists);
+        char c = input->front();
+        top.atKey = false;
+        if (c == 'i' || c == 'l' || c == 'd')
+          // Decoded like any value so errors inside it win, then rejected.
+          top.badKey = true;
+        else if (!isStringStart(c))
+          return fail(error_code::invalidTypeEncounterErr, lists);
+        else {
+          auto keyRes = decode_str(input);
+          if (!keyRes)
+            return fail(keyRes.error(), lists);
+          builder.key(*keyRes);
+          continue;
+        }
+      }
+
+      if (input->front() == 'e') {
+        input->remove_prefix(1);
+        std::string_view raw(top.start, input->data());
+        bool isList = top.isList;
+        frames.pop_back();
+        lists -= isList;
+        if (!frames.empty() && frames.back().badKey)
+          return fail(error_code::nonStringKeyErr, lists);
+        added = isList ? builder.endList(raw) : builder.endDict(raw);
+        if (!added)
+          return fail(added.error(), lists);
+        if (frames.empty())
+          return {};
+        if (!frames.back().isList)
+          frames.back().atKey = true;
+        continue;
+      }
+    }
+
+    if (frames.size() + 1 >= maxDepth)
+      return fail(error_code::maximumNestingLimitExcedeedErr, lists);
+    if (input->empty())
+      return fail(error_code::emptyInputErr, lists);
+
+    const char *start = input->data();
+    char c = input->front();
+    if (isStringStart(c)) {
+      auto result = decode_str(input);
+      if (!result)
+        return fail(result.error(), lists);
+      added = builder.string(*result, std::string_view(start, input->data()));
+    } else if (c == 'i') {
+      auto result = decode_int(input);
+      if (!result)
+        return fail(result.error(), lists);
+      if (!frames.empty() && frames.back().badKey)
+        return fail(error_code::nonStringKeyErr, lists);
+      added = builder.integer(*result, std::string_view(start, input->data()));
+    } else if (c == 'l' || c == 'd') {
+      input->remove_prefix(1);
+      frames.push_back({c == 'l', c == 'd', false, start});
+      if (c == 'l') {
+        lists++;
+        builder.beginList();
+      } else
+        builder.beginDict();
+      continue;
+    } else
+      return fail(error_code::invalidTypeEncounterErr, lists);
+
+    if (!added)
+      return fail(added.error(), lists);
+    if (frames.empty())
+      return {};
+    if (!frames.back().isList)
+      frames.back().atKey = true;
+  }
 }
 
 BencodeDecoder::exp_int BencodeDecoder::decode_int(std::string_view *input) {
@@ -79,100 +301,46 @@ BencodeDecoder::exp_int BencodeDecoder::decode_int(std::string_view *input) {
   if (!int_end)
     return std::unexpected(int_end.error());
 
-  try {
-    std::size_t read_bytes = 0;
-    int_ = std::stoll(std::string(*input), &read_bytes);
-    if (read_bytes < *int_end)
-      return std::unexpected(error_code::invalidIntegerErr);
-  } catch (std::invalid_argument &) {
-    return std::unexpected(error_code::invalidIntegerErr);
-  } catch (std::out_of_range &) {
+  const char *last = input->data() + *int_end;
+  auto [ptr, ec] = std::from_chars(input->data(), last, int_);
+  if (ec == std::errc::result_out_of_range)
     return std::unexpected(error_code::outOfRangeIntegerErr);
-  }
+  if (ec != std::errc() || ptr != last)
+    return std::unexpected(error_code::invalidIntegerErr);
 
   input->remove_prefix(*int_end + 1);
   return int_;
 }
 
 BencodeDecoder::exp_str BencodeDecoder::decode_str(std::string_view *input) {
-  BNode::string_t str;
   std::size_t str_len;
   auto len_end = isStringValid(*input);
   if (!len_end)
     return std::unexpected(len_end.error());
 
-  try {
-    std::size_t read_bytes = 0;
-    str_len = std::stoll(std::string(*input), &read_bytes);
-    if (read_bytes < *len_end)
-      return std::unexpected(error_code::invalidStringLengthErr);
-  } catch (std::invalid_argument &) {
-    return std::unexpected(error_code::invalidStringLengthErr);
-  } catch (std::out_of_range &) {
+  const char *last = input->data() + *len_end;
+  auto [ptr, ec] = std::from_chars(input->data(), last, str_len);
+  if (ec == std::errc::result_out_of_range)
     return std::unexpected(error_code::stringTooLargeErr);
-  }
+  if (ec != std::errc() || ptr != last)
+    return std::unexpected(error_code::invalidStringLengthErr);
 
-  std::string_view read_str = input->substr(*len_end + 1, str_len);
-  if (read_str.length() < str_len)
+  if (input->length() - (*len_end + 1) < str_len)
     return std::unexpected(error_code::lengthMismatchErr);
 
-  str.append(input->substr(*len_end + 1, str_len));
+  std::string_view str = input->substr(*len_end + 1, str_len);
   input->remove_prefix(*len_end + 1 + str_len);
   return str;
 }
 
-BencodeDecoder::exp_list BencodeDecoder::decode_list(std::string_view *input) {
-  BNode::list_t list;
-  input->remove_prefix(1);
-
-  for (;;) {
-    if (input->length() == 0)
-      return std::unexpected(error_code::missingListTerminatorErr);
-    if (input->at(0) == 'e') {
-      input->remove_prefix(1);
-      return list;
-    }
-
-    auto result = internal_decode(input);
-    if (!result)
-      return (result.error() == error_code::maximumNestingLimitExcedeedErr)
-                 ? std::unexpected(error_code::maximumNestingLimitExcedeedErr)
-                 : std::unexpected(error_code::invalidListElementErr);
-    list.push_back(result.value());
-  }
-}
-
-BencodeDecoder::exp_dict BencodeDecoder::decode_dict(std::string_view *input) {
-  BNode::dict_t dict;
-  input->remove_prefix(1);
-
-  for (;;) {
-    if (input->length() == 0)
-      return std::unexpected(error_code::missingDictTerminatorErr);
-    if (input->at(0) == 'e') {
-      input->remove_prefix(1);
-      return dict;
-    }
-
-    auto key_result = internal_decode(input);
-    if (!key_result)
-      return std::unexpected(key_result.error());
-    if (!key_result->isStr())
-      return std::unexpected(error_code::nonStringKeyErr);
-
-    auto val_result = internal_decode(input);
-    if (!val_result)
-      return std::unexpected(val_result.error());
-
-    auto insert_result = dict.emplace(key_result->getStr(), *val_result);
-    if (!insert_result.second)
-      return std::unexpected(error_code::duplicateKeyErr);
-  }
-}
-
 BencodeDecoder::exp_sizet
 BencodeDecoder::isIntegerValid(std::string_view input) {
-  std::size_t int_end = input.find('e');
+  // Well-formed integers end right after their digits; anything else goes
+  // through the full search so errors are classified as before.
+  std::size_t sign = !input.empty() && input.front() == '-';
+  std::size_t int_end = sign + BencodeScanner::digitRun(input.substr(sign));
+  if (int_end == sign || int_end == input.size() || input[int_end] != 'e')
+    int_end = input.find('e');
 
   if (int_end == std::string::npos)
     return std::unexpected(error_code::missingIntegerTerminatorErr);
@@ -187,7 +355,9 @@ BencodeDecoder::isIntegerValid(std::string_view input) {
 
 BencodeDecoder::exp_sizet
 BencodeDecoder::isStringValid(std::string_view input) {
-  std::size_t len_end = input.find(':');
+  std::size_t len_end = BencodeScanner::digitRun(input);
+  if (len_end == 0 || len_end == input.size() || input[len_end] != ':')
+    len_end = input.find(':');
 
   if (len_end == std::string::npos)
     return std::unexpected(error_code::missingColonErr);
@@ -210,4 +380,3 @@ bool BencodeDecoder::isNegativeZero(std::string_view input) {
 }
 
 } // namespace btc
-  // namespace btc
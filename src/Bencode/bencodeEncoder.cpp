@@ -1,49 +1,48 @@
 #include "Bencode/bencodeEncoder.h"
 #include "Bencode/bencodeValue.h"
 
-#include <format>
 #include <string>
 
 namespace btc {
 
-std::string BencodeEncoder::encode(BNode val) {
-  std::string result = "";
-
-  if (val.isInt())
-    result.append(encode_int(val.getInt()));
-  else if (val.isStr())
-    result.append(encode_str(val.getStr()));
-  else if (val.isList())
-    result.append(encode_list(val.getList()));
-  else if (val.isDict())
-    result.append(encode_dict(val.getDict()));
-
+std::string BencodeEncoder::encode(const BNode &val) {
+  std::string result;
+  encode(val, result);
   return result;
 }
 
-std::string BencodeEncoder::encode_int(BNode::int_t val) {
-  return std::format("i{}e", val);
+void BencodeEncoder::encode(const BNode &val, std::string &out) {
+  std::size_t offset = out.size();
+  out.resize(offset + encodedSize(val));
+  encode(val, out.data() + offset);
 }
 
-std::string BencodeEncoder::encode_str(BNode::string_t val) {
-  return std::format("{}:{}", val.length(), val);
+std::size_t BencodeEncoder::encodedSize(const BNode &val) {
+  if (val.isInt())
+    return intSize(val.getInt());
+  if (val.isStr())
+    return strSize(val.getStr());
+
+  std::size_t size = 2;
+  if (val.isList()) {
+    for (const auto &item : val.getList())
+      size += encodedSize(item);
+  } else {
+    for (const auto &[key, item] : val.getDict())
+      size += strSize(key) + encodedSize(item);
+  }
+  return size;
 }
 
-std::string BencodeEncoder::encode_list(BNode::list_t val) {
-  std::string result = "l";
-  for (auto items : val)
-    result.append(encode(items));
-  result.append("e");
-  return result;
+std::size_t BencodeEncoder::intSize(BNode::int_t val) {
+  char buf[maxIntSize];
+  return std::to_chars(buf, buf + maxIntSize, val).ptr - buf + 2;
 }
 
-std::string BencodeEncoder::encode_dict(BNode::dict_t val) {
-  std::string result = "d";
-  for (auto [first, second] : val) {
-    result.append(encode_str(first));
-    result.append(encode(second));
-  }
-  result.append("e");
-  return result;
+std::size_t BencodeEncoder::strSize(std::string_view val) {
+  char buf[maxIntSize];
+  return std::to_chars(buf, buf + maxIntSize, val.size()).ptr - buf + 1 +
+         val.size();
 }
+
 } // namespace btc
@@ -0,0 +1,142 @@
+#include <Bencode/bencodeScanner.h>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BTC_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace btc {
+
+const bool BencodeScanner::initialized = BencodeScanner::setIsa(detect());
+
+bool BencodeScanner::isSupported(Isa requested) {
+  switch (requested) {
+  case Isa::scalar:
+    return true;
+#ifdef BTC_SCANNER_X86
+  case Isa::sse2:
+    return __builtin_cpu_supports("sse2");
+  case Isa::avx2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+bool BencodeScanner::setIsa(Isa requested) {
+  if (!isSupported(requested))
+    return false;
+
+  isa = requested;
+  switch (requested) {
+  case Isa::scalar:
+    impl = &digitRunScalar;
+    break;
+  case Isa::sse2:
+    impl = &digitRunSse2;
+    break;
+  case Isa::avx2:
+    impl = &digitRunAvx2;
+    break;
+  }
+  return true;
+}
+
+BencodeScanner::Isa BencodeScanner::detect() {
+  if (isSupported(Isa::avx2))
+    return Isa::avx2;
+  if (isSupported(Isa::sse2))
+    return Isa::sse2;
+  return Isa::scalar;
+}
+
+std::size_t BencodeScanner::digitRunScalar(const char *data,
+                                           std::size_t size) {
+  std::size_t i = 0;
+  while (i < size && static_cast<unsigned char>(data[i] - '0') < 10)
+    i++;
+  return i;
+}
+
+#ifdef BTC_SCANNER_X86
+
+// Most runs are one or two digits long, too short to pay for a vector load
+// and mask extraction; the first eight bytes are checked as one 64-bit word.
+// A byte is a digit when its high nibble is 3 and adding 6 keeps it so; a
+// carry can only start at a non-digit byte, so it never hides the first one.
+static bool digitRunWord(const char *data, std::size_t size,
+                         std::size_t *run) {
+  if (size < 8)
+    return false;
+  std::uint64_t word;
+  std::memcpy(&word, data, 8);
+  const std::uint64_t high = 0xF0F0F0F0F0F0F0F0ull;
+  const std::uint64_t three = 0x3030303030303030ull;
+  const std::uint64_t six = 0x0606060606060606ull;
+  std::uint64_t nonDigits =
+      ((word & high) ^ three) | (((word + six) & high) ^ three);
+  if (nonDigits == 0)
+    return false;
+  *run = __builtin_ctzll(nonDigits) / 8;
+  return true;
+}
+
+// A byte is a digit when it is greater than '0' - 1 and less than '9' + 1.
+// Bytes >= 0x80 are negative as signed chars and fail the first comparison.
+__attribute__((target("sse2"))) std::size_t
+BencodeScanner::digitRunSse2(const char *data, std::size_t size) {
+  std::size_t i = 0;
+  if (digitRunWord(data, size, &i))
+    return i;
+
+  const __m128i lo = _mm_set1_epi8('0' - 1);
+  const __m128i hi = _mm_set1_epi8('9' + 1);
+
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chunk, lo),
+                                   _mm_cmplt_epi8(chunk, hi));
+    unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(digits)) & 0xFFFF;
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return i + digitRunScalar(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) std::size_t
+BencodeScanner::digitRunAvx2(const char *data, std::size_t size) {
+  std::size_t i = 0;
+  if (digitRunWord(data, size, &i))
+    return i;
+
+  const __m256i lo = _mm256_set1_epi8('0' - 1);
+  const __m256i hi = _mm256_set1_epi8('9' + 1);
+
+  for (; i + 32 <= size; i += 32) {
+    __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    __m256i digits = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, lo),
+                                      _mm256_cmpgt_epi8(hi, chunk));
+    unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(digits));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return i + digitRunSse2(data + i, size - i);
+}
+
+#else
+
+std::size_t BencodeScanner::digitRunSse2(const char *data, std::size_t size) {
+  return digitRunScalar(data, size);
+}
+
+std::size_t BencodeScanner::digitRunAvx2(const char *data, std::size_t size) {
+  return digitRunScalar(data, size);
+}
+
+#endif
+
+} // namespace btc
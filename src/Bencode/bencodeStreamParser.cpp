@@ -0,0 +1,221 @@
+#include <Bencode/bencodeStreamParser.h>
+#include <algorithm>
+#include <charconv>
+#include <errors.h>
+
+namespace btc {
+
+BencodeStreamParser::exp_void
+BencodeStreamParser::feed(std::string_view chunk) {
+  if (error)
+    return std::unexpected(error);
+
+  while (!chunk.empty()) {
+    switch (state) {
+    case State::done:
+      return fail(error_code::trailingInputErr);
+
+    case State::value: {
+      started = true;
+      char c = chunk.front();
+      chunk.remove_prefix(1);
+      if (auto res = startValue(c); !res)
+        return res;
+      break;
+    }
+
+    case State::integer: {
+      char c = chunk.front();
+      chunk.remove_prefix(1);
+      if (c == 'e') {
+        if (auto res = endInteger(); !res)
+          return res;
+      } else if (digits.size() == maxDigits)
+        return fail((c >= '0' && c <= '9') ? error_code::outOfRangeIntegerErr
+                                           : error_code::invalidIntegerErr);
+      else
+        digits.push_back(c);
+      break;
+    }
+
+    case State::length: {
+      char c = chunk.front();
+      chunk.remove_prefix(1);
+      if (c == ':') {
+        if (auto res = endLength(); !res)
+          return res;
+      } else if (c < '0' || c > '9')
+        return fail(error_code::invalidStringLengthErr);
+      else if (digits.size() == maxDigits)
+        return fail(error_code::stringTooLargeErr);
+      else
+        digits.push_back(c);
+      break;
+    }
+
+    case State::string: {
+      std::size_t n = std::min(remaining, chunk.size());
+      if (isKey)
+        key.append(chunk.substr(0, n));
+      else
+        handler.onStringData(chunk.substr(0, n));
+      remaining -= n;
+      chunk.remove_prefix(n);
+      if (remaining == 0)
+        endString();
+      break;
+    }
+    }
+  }
+  return {};
+}
+
+BencodeStreamParser::exp_void BencodeStreamParser::finish() {
+  if (error)
+    return std::unexpected(error);
+
+  switch (state) {
+  case State::done:
+    return {};
+  case State::integer:
+    return fail(error_code::missingIntegerTerminatorErr);
+  case State::length:
+    return fail(error_code::missingColonErr);
+  case State::string:
+    return fail(error_code::lengthMismatchErr);
+  case State::value:
+    break;
+  }
+
+  if (!started || stack.empty() || stack.back() == Frame::dictValue)
+    return fail(error_code::emptyInputErr);
+  return fail(stack.back() == Frame::list
+                  ? error_code::missingListTerminatorErr
+                  : error_code::missingDictTerminatorErr);
+}
+
+void BencodeStreamParser::reset() {
+  error.clear();
+  state = State::value;
+  stack.clear();
+  started = false;
+  isKey = false;
+  remaining = 0;
+  digits.clear();
+  key.clear();
+}
+
+BencodeStreamParser::exp_void BencodeStreamParser::fail(error_code e) {
+  error = e;
+  return std::unexpected(error);
+}
+
+BencodeStreamParser::exp_void BencodeStreamParser::startValue(char c) {
+  if (c == 'e' && !stack.empty() && stack.back() != Frame::dictValue) {
+    stack.pop_back();
+    handler.onEnd();
+    endValue();
+    return {};
+  }
+
+  if (stack.size() + 1 >= maxDepth)
+    return fail(error_code::maximumNestingLimitExcedeedErr);
+
+  bool atKey = !stack.empty() && stack.back() == Frame::dictKey;
+  if (c >= '0' && c <= '9') {
+    isKey = atKey;
+    digits.assign(1, c);
+    state = State::length;
+    return {};
+  }
+  if (c == '-')
+    return fail(error_code::negativeStringLengthErr);
+  if (c == '+')
+    return fail(error_code::signedStringLengthErr);
+  if (atKey && (c == 'i' || c == 'l' || c == 'd'))
+    return fail(error_code::nonStringKeyErr);
+
+  switch (c) {
+  case 'i':
+    digits.clear();
+    state = State::integer;
+    return {};
+  case 'l':
+    stack.push_back(Frame::list);
+    handler.onListBegin();
+    return {};
+  case 'd':
+    stack.push_back(Frame::dictKey);
+    handler.onDictBegin();
+    return {};
+  }
+  return fail(error_code::invalidTypeEncounterErr);
+}
+
+BencodeStreamParser::exp_void BencodeStreamParser::endInteger() {
+  bool negative = !digits.empty() && digits.front() == '-';
+  std::string_view magnitude = std::string_view(digits).substr(negative);
+  if (magnitude.size() > 1 && magnitude.front() == '0')
+    return fail(error_code::invalidIntegerErr);
+  if (negative && magnitude == "0")
+    return fail(error_code::invalidIntegerErr);
+
+  BNode::int_t val;
+  const char *last = digits.data() + digits.size();
+  auto [ptr, ec] = std::from_chars(digits.data(), last, val);
+  if (ec == std::errc::result_out_of_range)
+    return fail(error_code::outOfRangeIntegerErr);
+  if (ec != std::errc() || ptr != last)
+    return fail(error_code::invalidIntegerErr);
+
+  handler.onInt(val);
+  endValue();
+  return {};
+}
+
+BencodeStreamParser::exp_void BencodeStreamParser::endLength() {
+  if (digits.size() > 1 && digits.front() == '0')
+    return fail(error_code::invalidStringLengthErr);
+
+  const char *last = digits.data() + digits.size();
+  auto [ptr, ec] = std::from_chars(digits.data(), last, remaining);
+  if (ec == std::errc::result_out_of_range)
+    return fail(error_code::stringTooLargeErr);
+  if (ec != std::errc() || ptr != last)
+    return fail(error_code::invalidStringLengthErr);
+
+  if (isKey) {
+    if (remaining > maxKeyLength)
+      return fail(error_code::stringTooLargeErr);
+    key.clear();
+  } else
+    handler.onStringBegin(remaining);
+
+  state = State::string;
+  if (remaining == 0)
+    endString();
+  return {};
+}
+
+void BencodeStreamParser::endString() {
+  if (isKey) {
+    stack.back() = Frame::dictValue;
+    state = State::value;
+    handler.onKey(key);
+    return;
+  }
+  handler.onStringEnd();
+  endValue();
+}
+
+void BencodeStreamParser::endValue() {
+  if (stack.empty()) {
+    state = State::done;
+    return;
+  }
+  if (stack.back() == Frame::dictValue)
+    stack.back() = Frame::dictKey;
+  state = State::value;
+}
+
+} // namespace btc
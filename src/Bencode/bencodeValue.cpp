@@ -1,60 +1,63 @@
 #include "Bencode/bencodeValue.h"
-#include <optional>
 
 namespace btc {
 
 BNode::BNode(b_val val) : val(std::move(val)) {}
 
-bool BNode::isInt() { return std::holds_alternative<int_t>(this->val); }
-bool BNode::isStr() { return std::holds_alternative<string_t>(this->val); }
-bool BNode::isList() { return std::holds_alternative<list_t>(this->val); }
-bool BNode::isDict() { return std::holds_alternative<dict_t>(this->val); }
+bool BNode::isInt() const { return std::holds_alternative<int_t>(this->val); }
+bool BNode::isStr() const {
+  return std::holds_alternative<string_t>(this->val);
+}
+bool BNode::isList() const { return std::holds_alternative<list_t>(this->val); }
+bool BNode::isDict() const { return std::holds_alternative<dict_t>(this->val); }
 
 BNode::int_t &BNode::getInt() { return std::get<int_t>(this->val); }
 BNode::string_t &BNode::getStr() { return std::get<string_t>(this->val); }
 BNode::list_t &BNode::getList() { return std::get<list_t>(this->val); }
 BNode::dict_t &BNode::getDict() { return std::get<dict_t>(this->val); }
 
-std::optional<BNode> BNode::dictFind(std::string k) {
-  BNode::dict_t node = getDict();
-  return node.contains(k) ? std::optional<BNode>(BNode(node.at(k)))
-                          : std::nullopt;
-}
-
-BNode BNode::dictFindInt(std::string k, BNode::int_t def) {
-  BNode::dict_t node = getDict();
-  return node.contains(k) && node.at(k).isInt() ? BNode(node.at(k).getInt())
-                                                : BNode(def);
-}
-BNode BNode::dictFindString(std::string k, BNode::string_t def) {
-  BNode::dict_t node = getDict();
-  return node.contains(k) && node.at(k).isStr() ? BNode(node.at(k).getStr())
-                                                : BNode(def);
-}
-
-std::optional<BNode> BNode::dictFindInt(std::string k) {
-  BNode::dict_t node = getDict();
-  if (node.contains(k) && node.at(k).isInt())
-    return BNode(node.at(k).getInt());
-  return std::nullopt;
-}
-std::optional<BNode> BNode::dictFindString(std::string k) {
-  BNode::dict_t node = getDict();
-  if (node.contains(k) && node.at(k).isStr())
-    return BNode(node.at(k).getStr());
-  return std::nullopt;
-}
-std::optional<BNode> BNode::dictFindList(std::string k) {
-  BNode::dict_t node = getDict();
-  if (node.contains(k) && node.at(k).isList())
-    return BNode(node.at(k).getList());
-  return std::nullopt;
-}
-std::optional<BNode> BNode::dictFindDict(std::string k) {
-  BNode::dict_t node = getDict();
-  if (node.contains(k) && node.at(k).isDict())
-    return BNode(node.at(k).getDict());
-  return std::nullopt;
+const BNode::int_t &BNode::getInt() const { return std::get<int_t>(this->val); }
+const BNode::string_t &BNode::getStr() const {
+  return std::get<string_t>(this->val);
+}
+const BNode::list_t &BNode::getList() const {
+  return std::get<list_t>(this->val);
+}
+const BNode::dict_t &BNode::getDict() const {
+  return std::get<dict_t>(this->val);
+}
+
+const BNode *BNode::dictFind(std::string_view k) const {
+  const dict_t &dict = getDict();
+  auto it = dict.find(k);
+  return it != dict.end() ? &it->second : nullptr;
+}
+
+BNode::int_t BNode::dictFindInt(std::string_view k, BNode::int_t def) const {
+  auto node = dictFindInt(k);
+  return node ? node->getInt() : def;
+}
+std::string_view BNode::dictFindString(std::string_view k,
+                                       std::string_view def) const {
+  auto node = dictFindString(k);
+  return node ? std::string_view(node->getStr()) : def;
+}
+
+const BNode *BNode::dictFindInt(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isInt() ? node : nullptr;
+}
+const BNode *BNode::dictFindString(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isStr() ? node : nullptr;
+}
+const BNode *BNode::dictFindList(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isList() ? node : nullptr;
+}
+const BNode *BNode::dictFindDict(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isDict() ? node : nullptr;
 }
 
 } // namespace btc
@@ -0,0 +1,84 @@
+#include "Bencode/bencodeView.h"
+#include <algorithm>
+#include <type_traits>
+
+namespace btc {
+
+static_assert(std::is_trivially_destructible_v<BView>,
+              "BView nodes are released with their arena, never destroyed");
+
+BView::BView(b_val val, std::string_view raw)
+    : val(std::move(val)), raw(raw) {}
+
+bool BView::isInt() const { return std::holds_alternative<int_t>(this->val); }
+bool BView::isStr() const {
+  return std::holds_alternative<string_t>(this->val);
+}
+bool BView::isList() const { return std::holds_alternative<list_t>(this->val); }
+bool BView::isDict() const { return std::holds_alternative<dict_t>(this->val); }
+
+const BView::int_t &BView::getInt() const { return std::get<int_t>(this->val); }
+const BView::string_t &BView::getStr() const {
+  return std::get<string_t>(this->val);
+}
+const BView::list_t &BView::getList() const {
+  return std::get<list_t>(this->val);
+}
+const BView::dict_t &BView::getDict() const {
+  return std::get<dict_t>(this->val);
+}
+
+const BView *BView::dictFind(std::string_view k) const {
+  const dict_t &dict = getDict();
+  auto it = std::lower_bound(dict.begin(), dict.end(), k,
+                             [](const entry_t &entry, std::string_view key) {
+                               return entry.first < key;
+                             });
+  return (it != dict.end() && it->first == k) ? &it->second : nullptr;
+}
+
+BView::int_t BView::dictFindInt(std::string_view k, int_t def) const {
+  auto node = dictFindInt(k);
+  return node ? node->getInt() : def;
+}
+BView::string_t BView::dictFindString(std::string_view k, string_t def) const {
+  auto node = dictFindString(k);
+  return node ? node->getStr() : def;
+}
+
+const BView *BView::dictFindInt(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isInt() ? node : nullptr;
+}
+const BView *BView::dictFindString(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isStr() ? node : nullptr;
+}
+const BView *BView::dictFindList(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isList() ? node : nullptr;
+}
+const BView *BView::dictFindDict(std::string_view k) const {
+  auto node = dictFind(k);
+  return node && node->isDict() ? node : nullptr;
+}
+
+BNode BView::toNode() const {
+  if (isInt())
+    return BNode(getInt());
+  if (isStr())
+    return BNode(BNode::string_t(getStr()));
+  if (isList()) {
+    BNode::list_t list;
+    list.reserve(getList().size());
+    for (const auto &item : getList())
+      list.push_back(item.toNode());
+    return BNode(std::move(list));
+  }
+  BNode::dict_t dict;
+  for (const auto &[key, value] : getDict())
+    dict.emplace_hint(dict.end(), key, value.toNode());
+  return BNode(std::move(dict));
+}
+
+} // namespace btc
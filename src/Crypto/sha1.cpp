@@ -0,0 +1,318 @@
+#include <Crypto/sha1.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <openssl/sha.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BTC_SHA1_X86 1
+#include <immintrin.h>
+#endif
+
+namespace btc {
+
+namespace {
+
+const std::size_t blockSize = 64;
+const std::array<std::uint32_t, 5> initialState = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+// Copies the bytes after the last full block into `tail`, followed by the
+// padding and the message length in bits; returns the number of tail blocks.
+std::size_t padTail(std::string_view input, unsigned char (&tail)[128]) {
+  std::size_t rest = input.size() % blockSize;
+  std::size_t blocks = rest < blockSize - 8 ? 1 : 2;
+
+  std::memset(tail, 0, sizeof(tail));
+  std::memcpy(tail, input.data() + input.size() - rest, rest);
+  tail[rest] = 0x80;
+
+  std::uint64_t bits = static_cast<std::uint64_t>(input.size()) * 8;
+  unsigned char *end = tail + blocks * blockSize;
+  for (std::size_t i = 0; i < 8; i++)
+    end[-1 - static_cast<std::ptrdiff_t>(i)] =
+        static_cast<unsigned char>(bits >> 8 * i);
+  return blocks;
+}
+
+Sha1::digest_t toDigest(const std::array<std::uint32_t, 5> &state) {
+  Sha1::digest_t digest;
+  for (std::size_t i = 0; i < state.size(); i++) {
+    digest[i * 4] = static_cast<unsigned char>(state[i] >> 24);
+    digest[i * 4 + 1] = static_cast<unsigned char>(state[i] >> 16);
+    digest[i * 4 + 2] = static_cast<unsigned char>(state[i] >> 8);
+    digest[i * 4 + 3] = static_cast<unsigned char>(state[i]);
+  }
+  return digest;
+}
+
+} // namespace
+
+const bool Sha1::initialized = Sha1::setIsa(detect());
+
+bool Sha1::isSupported(Isa requested) {
+  switch (requested) {
+  case Isa::openssl:
+    return true;
+#ifdef BTC_SHA1_X86
+  case Isa::shaNi:
+    return __builtin_cpu_supports("sha") &&
+           __builtin_cpu_supports("sse4.1");
+  case Isa::avx2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+bool Sha1::setIsa(Isa requested) {
+  if (!isSupported(requested))
+    return false;
+  isa = requested;
+  return true;
+}
+
+Sha1::Isa Sha1::detect() {
+  if (isSupported(Isa::shaNi))
+    return Isa::shaNi;
+  if (isSupported(Isa::avx2))
+    return Isa::avx2;
+  return Isa::openssl;
+}
+
+Sha1::digest_t Sha1::hash(std::string_view input) {
+  if (isa == Isa::shaNi)
+    return hashShaNi(input);
+  return hashOpenssl(input);
+}
+
+void Sha1::hashMany(std::span<const std::string_view> inputs,
+                    std::span<digest_t> out) {
+  if (isa != Isa::avx2) {
+    for (std::size_t i = 0; i < inputs.size(); i++)
+      out[i] = hash(inputs[i]);
+    return;
+  }
+
+  // Lanes advance in lock step, so only inputs of the same length share a
+  // batch. Pieces are all the same size except the last one.
+  std::vector<std::size_t> order(inputs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](auto l, auto r) {
+    return inputs[l].size() < inputs[r].size();
+  });
+
+  std::string_view batch[lanes];
+  digest_t digests[lanes];
+  for (std::size_t i = 0; i < order.size();) {
+    std::size_t count = 0;
+    while (i + count < order.size() && count < lanes &&
+           inputs[order[i + count]].size() == inputs[order[i]].size()) {
+      batch[count] = inputs[order[i + count]];
+      count++;
+    }
+
+    if (count == 1) {
+      out[order[i]] = hashOpenssl(batch[0]);
+    } else {
+      hashLanesAvx2({batch, count}, {digests, count});
+      for (std::size_t l = 0; l < count; l++)
+        out[order[i + l]] = digests[l];
+    }
+    i += count;
+  }
+}
+
+Sha1::digest_t Sha1::hashOpenssl(std::string_view input) {
+  digest_t digest;
+  SHA1(reinterpret_cast<const unsigned char *>(input.data()), input.size(),
+       digest.data());
+  return digest;
+}
+
+Sha1::digest_t Sha1::hashShaNi(std::string_view input) {
+  state_t state = initialState;
+  compressShaNi(state,
+                reinterpret_cast<const unsigned char *>(input.data()),
+                input.size() / blockSize);
+
+  unsigned char tail[128];
+  std::size_t tailBlocks = padTail(input, tail);
+  compressShaNi(state, tail, tailBlocks);
+  return toDigest(state);
+}
+
+#ifdef BTC_SHA1_X86
+
+// One 64-byte block is 20 groups of four rounds. Group g consumes message
+// words 4g..4g+3 and uses round function g / 5; sha1nexte derives the group's
+// E from the state as it was two groups earlier.
+__attribute__((target("sha,sse4.1"))) void
+Sha1::compressShaNi(state_t &state, const unsigned char *blocks,
+                    std::size_t count) {
+  const __m128i byteSwap =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+
+  __m128i abcd = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state));
+  abcd = _mm_shuffle_epi32(abcd, 0x1B);
+  __m128i e = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+  for (std::size_t b = 0; b < count; b++, blocks += blockSize) {
+    __m128i abcdSave = abcd;
+    __m128i eSave = e;
+    __m128i msg[4];
+    __m128i previous = abcd;
+
+#pragma GCC unroll 20
+    for (int g = 0; g < 20; g++) {
+      __m128i &w = msg[g % 4];
+      if (g < 4) {
+        w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + g * 16));
+        w = _mm_shuffle_epi8(w, byteSwap);
+      } else {
+        w = _mm_sha1msg1_epu32(w, msg[(g + 1) % 4]);
+        w = _mm_xor_si128(w, msg[(g + 2) % 4]);
+        w = _mm_sha1msg2_epu32(w, msg[(g + 3) % 4]);
+      }
+
+      __m128i we =
+          g == 0 ? _mm_add_epi32(e, w) : _mm_sha1nexte_epu32(previous, w);
+      previous = abcd;
+      switch (g / 5) {
+      case 0:
+        abcd = _mm_sha1rnds4_epu32(abcd, we, 0);
+        break;
+      case 1:
+        abcd = _mm_sha1rnds4_epu32(abcd, we, 1);
+        break;
+      case 2:
+        abcd = _mm_sha1rnds4_epu32(abcd, we, 2);
+        break;
+      default:
+        abcd = _mm_sha1rnds4_epu32(abcd, we, 3);
+        break;
+      }
+    }
+
+    e = _mm_sha1nexte_epu32(previous, eSave);
+    abcd = _mm_add_epi32(abcd, abcdSave);
+  }
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1B);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state), abcd);
+  state[4] = static_cast<std::uint32_t>(_mm_extract_epi32(e, 3));
+}
+
+namespace {
+
+__attribute__((target("avx2"))) inline __m256i rotl(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+__attribute__((target("avx2"))) inline std::uint32_t
+loadBigEndian(const unsigned char *p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return __builtin_bswap32(v);
+}
+
+} // namespace
+
+// Each 32-bit lane of the vectors carries the state of a different input; all
+// inputs have the same length, so they need the same number of blocks.
+__attribute__((target("avx2"))) void
+Sha1::hashLanesAvx2(std::span<const std::string_view> inputs,
+                    std::span<digest_t> out) {
+  const unsigned char *data[lanes];
+  unsigned char tails[lanes][128];
+  std::size_t fullBlocks = inputs[0].size() / blockSize;
+  std::size_t tailBlocks = 0;
+  for (std::size_t l = 0; l < lanes; l++) {
+    // Unused lanes repeat the first input; their digests are dropped.
+    std::string_view input = l < inputs.size() ? inputs[l] : inputs[0];
+    data[l] = reinterpret_cast<const unsigned char *>(input.data());
+    tailBlocks = padTail(input, tails[l]);
+  }
+
+  __m256i h[5];
+  for (std::size_t i = 0; i < 5; i++)
+    h[i] = _mm256_set1_epi32(static_cast<int>(initialState[i]));
+
+  const __m256i k[4] = {
+      _mm256_set1_epi32(0x5A827999), _mm256_set1_epi32(0x6ED9EBA1),
+      _mm256_set1_epi32(static_cast<int>(0x8F1BBCDC)),
+      _mm256_set1_epi32(static_cast<int>(0xCA62C1D6))};
+
+  for (std::size_t b = 0; b < fullBlocks + tailBlocks; b++) {
+    const unsigned char *block[lanes];
+    for (std::size_t l = 0; l < lanes; l++)
+      block[l] = b < fullBlocks ? data[l] + b * blockSize
+                                : tails[l] + (b - fullBlocks) * blockSize;
+
+    __m256i w[16];
+    for (std::size_t t = 0; t < 16; t++) {
+      int words[lanes];
+      for (std::size_t l = 0; l < lanes; l++)
+        words[l] = static_cast<int>(loadBigEndian(block[l] + t * 4));
+      w[t] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words));
+    }
+
+    __m256i a = h[0], bb = h[1], c = h[2], d = h[3], e = h[4];
+#pragma GCC unroll 80
+    for (std::size_t t = 0; t < 80; t++) {
+      if (t >= 16) {
+        __m256i x = _mm256_xor_si256(
+            _mm256_xor_si256(w[(t - 3) % 16], w[(t - 8) % 16]),
+            _mm256_xor_si256(w[(t - 14) % 16], w[t % 16]));
+        w[t % 16] = rotl(x, 1);
+      }
+
+      __m256i f;
+      if (t < 20)
+        f = _mm256_xor_si256(d, _mm256_and_si256(bb, _mm256_xor_si256(c, d)));
+      else if (t < 40 || t >= 60)
+        f = _mm256_xor_si256(_mm256_xor_si256(bb, c), d);
+      else
+        f = _mm256_or_si256(_mm256_and_si256(bb, c),
+                            _mm256_and_si256(d, _mm256_or_si256(bb, c)));
+
+      __m256i temp = _mm256_add_epi32(
+          _mm256_add_epi32(rotl(a, 5), f),
+          _mm256_add_epi32(_mm256_add_epi32(e, k[t / 20]), w[t % 16]));
+      e = d;
+      d = c;
+      c = rotl(bb, 30);
+      bb = a;
+      a = temp;
+    }
+
+    h[0] = _mm256_add_epi32(h[0], a);
+    h[1] = _mm256_add_epi32(h[1], bb);
+    h[2] = _mm256_add_epi32(h[2], c);
+    h[3] = _mm256_add_epi32(h[3], d);
+    h[4] = _mm256_add_epi32(h[4], e);
+  }
+
+  std::uint32_t words[5][lanes];
+  for (std::size_t i = 0; i < 5; i++)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(words[i]), h[i]);
+  for (std::size_t l = 0; l < inputs.size(); l++)
+    out[l] = toDigest({words[0][l], words[1][l], words[2][l], words[3][l],
+                       words[4][l]});
+}
+
+#else
+
+void Sha1::compressShaNi(state_t &, const unsigned char *, std::size_t) {}
+
+void Sha1::hashLanesAvx2(std::span<const std::string_view> inputs,
+                         std::span<digest_t> out) {
+  for (std::size_t i = 0; i < inputs.size(); i++)
+    out[i] = hashOpenssl(inputs[i]);
+}
+
+#endif
+
+} // namespace btc
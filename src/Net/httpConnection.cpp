@@ -1,6 +1,7 @@
 #include <Net/httpConnection.h>
 #include <boost/beast/http/field.hpp>
 #include <boost/beast/version.hpp>
+#include <array>
 
 namespace btc {
 
@@ -42,9 +43,8 @@ HttpConnection::await_exp_response HttpConnection::get(std::string url) {
   if (ec)
     co_return std::unexpected(ec);
 
-  beast::flat_buffer buf;
   http::response<http::dynamic_body> resp;
-  co_await http::async_read(stream, buf, resp,
+  co_await http::async_read(stream, buffer, resp,
                             net::redirect_error(net::use_awaitable, ec));
   if (ec)
     co_return std::unexpected(ec);
@@ -52,4 +52,51 @@ HttpConnection::await_exp_response HttpConnection::get(std::string url) {
   co_return resp;
 }
 
+HttpConnection::await_exp_void
+HttpConnection::getStreamed(std::string url, chunk_handler onChunk,
+                            std::uint64_t bodyLimit) {
+  sys::result<url_view> r = urls::parse_uri(std::string_view(url));
+  if (r.has_error())
+    co_return std::unexpected(r.error());
+
+  http::request<http::string_body> req{http::verb::get, r->encoded_target(),
+                                       11};
+  req.set(http::field::host, hostname);
+  req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+
+  sys::error_code ec;
+  co_await http::async_write(stream, req,
+                             net::redirect_error(net::use_awaitable, ec));
+  if (ec)
+    co_return std::unexpected(ec);
+
+  http::response_parser<http::buffer_body> parser;
+  parser.body_limit(bodyLimit);
+  co_await http::async_read_header(stream, buffer, parser,
+                                   net::redirect_error(net::use_awaitable, ec));
+  if (ec)
+    co_return std::unexpected(ec);
+
+  std::array<char, 16 * 1024> chunk;
+  while (!parser.is_done()) {
+    parser.get().body().data = chunk.data();
+    parser.get().body().size = chunk.size();
+    co_await http::async_read(stream, buffer, parser,
+                              net::redirect_error(net::use_awaitable, ec));
+    if (ec == http::error::need_buffer)
+      ec = {};
+    if (ec)
+      co_return std::unexpected(ec);
+
+    std::size_t read = chunk.size() - parser.get().body().size;
+    if (read == 0)
+      continue;
+    auto handled = onChunk(std::string_view(chunk.data(), read));
+    if (!handled)
+      co_return std::unexpected(handled.error());
+  }
+
+  co_return exp_void{};
+}
+
 } // namespace btc
@@ -0,0 +1,167 @@
+#include <Peer/choker.h>
+#include <algorithm>
+
+namespace btc {
+
+Choker::Choker(net::io_context &ctx, Options options)
+    : ctx(ctx), options(options), timer(ctx) {}
+
+Choker::torrent_id Choker::addTorrent(bool seeding) {
+  torrent_id id = nextId++;
+  torrents[id].seeding = seeding;
+  return id;
+}
+
+void Choker::removeTorrent(torrent_id torrent) { torrents.erase(torrent); }
+
+void Choker::setSeeding(torrent_id torrent, bool seeding) {
+  auto it = torrents.find(torrent);
+  if (it != torrents.end())
+    it->second.seeding = seeding;
+}
+
+void Choker::addPeer(torrent_id torrent,
+                     std::shared_ptr<PeerConnection> conn) {
+  auto it = torrents.find(torrent);
+  if (it != torrents.end())
+    it->second.peers.push_back(std::move(conn));
+}
+
+std::size_t Choker::selectTop(std::span<Candidate> candidates,
+                              std::size_t k) {
+  k = std::min(k, candidates.size());
+  std::partial_sort(
+      candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(k),
+      candidates.end(),
+      [](const Candidate &a, const Candidate &b) { return a.rate > b.rate; });
+  return k;
+}
+
+net::awaitable<void> Choker::run() {
+  running = true;
+  std::size_t every = std::max<std::size_t>(
+      1, static_cast<std::size_t>(options.optimisticInterval /
+                                  options.interval));
+  for (std::size_t round = 0; running; round++) {
+    co_await tick(round % every == 0);
+    // stop() may have come while the round yielded; the timer it cancelled
+    // must not be armed again.
+    if (!running)
+      break;
+    timer.expires_after(options.interval);
+    sys::error_code ec;
+    co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+  }
+}
+
+void Choker::stop() {
+  running = false;
+  timer.cancel();
+}
+
+net::awaitable<void> Choker::yield() {
+  co_await net::post(ctx, net::use_awaitable);
+}
+
+// Drops closed peers, and ranks the interested ones by the rate they give
+// us; the torrent's slot winners end up first.
+void Choker::rank(Torrent &torrent) {
+  torrent.live.clear();
+  torrent.ranked.clear();
+  std::erase_if(torrent.peers, [&](const std::weak_ptr<PeerConnection> &p) {
+    auto conn = p.lock();
+    if (!conn || !conn->isOpen())
+      return true;
+    torrent.live.push_back(std::move(conn));
+    return false;
+  });
+
+  for (std::uint32_t i = 0; i < torrent.live.size(); i++) {
+    const PeerConnection &conn = *torrent.live[i];
+    if (conn.isPeerInterested())
+      torrent.ranked.push_back(
+          {torrent.seeding ? conn.getUploadRate() : conn.getDownloadRate(),
+           i});
+  }
+  torrent.winners = selectTop(torrent.ranked, options.slotsPerTorrent);
+}
+
+void Choker::apply(Torrent &torrent, bool rotate) {
+  std::vector<bool> unchoke(torrent.live.size(), false);
+  for (std::size_t i = 0; i < torrent.winners; i++)
+    unchoke[torrent.ranked[i].index] = true;
+
+  // The optimistic unchoke: a random interested peer without a slot, kept
+  // until the next rotation while it stays interested.
+  auto current = torrent.optimistic.lock();
+  if (rotate || !current || !current->isOpen() ||
+      !current->isPeerInterested()) {
+    current.reset();
+    std::size_t others = torrent.ranked.size() - torrent.winners;
+    if (options.optimisticUnchoke && others > 0) {
+      std::size_t pick = torrent.winners + rng() % others;
+      current = torrent.live[torrent.ranked[pick].index];
+    }
+    torrent.optimistic = current;
+  }
+
+  for (std::size_t i = 0; i < torrent.live.size(); i++) {
+    PeerConnection &conn = *torrent.live[i];
+    if (unchoke[i] || torrent.live[i] == current) {
+      conn.unchoke();
+      unchoked++;
+    } else {
+      conn.choke();
+    }
+  }
+  torrent.live.clear();
+}
+
+net::awaitable<void> Choker::tick(bool rotate) {
+  std::vector<torrent_id> ids;
+  ids.reserve(torrents.size());
+  for (const auto &[id, torrent] : torrents)
+    ids.push_back(id);
+
+  for (std::size_t i = 0; i < ids.size(); i++) {
+    if (i > 0 && i % options.batch == 0)
+      co_await yield();
+    auto it = torrents.find(ids[i]);
+    if (it != torrents.end())
+      rank(it->second);
+  }
+
+  // Over the global limit, the fastest of every torrent's winners keep
+  // their slots. Within a torrent the winners are fastest first, so the
+  // ones that stay are always a prefix.
+  if (options.globalSlots > 0) {
+    std::vector<Candidate> all;
+    std::vector<Torrent *> owner;
+    for (torrent_id id : ids) {
+      auto it = torrents.find(id);
+      if (it == torrents.end())
+        continue;
+      Torrent &torrent = it->second;
+      for (std::size_t i = 0; i < torrent.winners; i++) {
+        all.push_back({torrent.ranked[i].rate,
+                       static_cast<std::uint32_t>(owner.size())});
+        owner.push_back(&torrent);
+      }
+      torrent.winners = 0;
+    }
+    std::size_t kept = selectTop(all, options.globalSlots);
+    for (std::size_t i = 0; i < kept; i++)
+      owner[all[i].index]->winners++;
+  }
+
+  unchoked = 0;
+  for (std::size_t i = 0; i < ids.size(); i++) {
+    if (i > 0 && i % options.batch == 0)
+      co_await yield();
+    auto it = torrents.find(ids[i]);
+    if (it != torrents.end())
+      apply(it->second, rotate);
+  }
+}
+
+} // namespace btc
@@ -0,0 +1,420 @@
+#include <Peer/peerConnection.h>
+#include <algorithm>
+#include <array>
+
+namespace btc {
+
+PeerConnection::PeerConnection(tcp::socket socket, RingBuffer ring,
+                               const TorrentFile &torrent, std::string peerId,
+                               PeerHandler &handler, Options options)
+    : socket(std::move(socket)), ring(std::move(ring)), handler(handler),
+      options(options), peerId(std::move(peerId)),
+      pieceCount(torrent.getPieces().size()),
+      pieceLength(static_cast<std::uint64_t>(torrent.getPieceLength())),
+      totalLength(static_cast<std::uint64_t>(torrent.getTotalLength())),
+      peerPieces(pieceCount), wake(this->socket.get_executor()),
+      idle(this->socket.get_executor()) {
+  // A bitfield or a piece message, whichever is longer.
+  maxMessage = std::max((pieceCount + 7) / 8, options.maxRequestLength + 8) + 1;
+}
+
+PeerConnection::await_exp_connection
+PeerConnection::connect(net::io_context &ctx, const Peer &peer,
+                        const TorrentFile &torrent, std::string_view peerId,
+                        PeerHandler &handler, Options options) {
+  sys::error_code ec;
+  auto address = net::ip::make_address(peer.ip, ec);
+  if (ec)
+    co_return std::unexpected(ec);
+
+  tcp::socket socket(ctx);
+  co_await socket.async_connect(tcp::endpoint(address, peer.port),
+                                net::redirect_error(net::use_awaitable, ec));
+  if (ec)
+    co_return std::unexpected(ec);
+
+  co_return co_await handshake(std::move(socket), torrent, peerId, handler,
+                               options, true);
+}
+
+PeerConnection::await_exp_connection
+PeerConnection::accept(tcp::socket socket, const TorrentFile &torrent,
+                       std::string_view peerId, PeerHandler &handler,
+                       Options options) {
+  co_return co_await handshake(std::move(socket), torrent, peerId, handler,
+                               options, false);
+}
+
+// The initiator sends its handshake first; the receiving side answers only
+// once it knows the peer asked for our torrent.
+PeerConnection::await_exp_connection
+PeerConnection::handshake(tcp::socket socket, const TorrentFile &torrent,
+                          std::string_view peerId, PeerHandler &handler,
+                          Options options, bool initiator) {
+  std::string out;
+  PeerWire::appendHandshake(out, torrent.getInfoHash(), peerId);
+
+  // Past the deadline the socket is closed, which fails the pending read or
+  // write.
+  bool expired = false;
+  net::steady_timer deadline(socket.get_executor());
+  deadline.expires_after(options.handshakeTimeout);
+  deadline.async_wait([&socket, &expired](sys::error_code ec) {
+    if (ec)
+      return;
+    expired = true;
+    socket.close(ec);
+  });
+  auto failure = [&](sys::error_code ec) -> std::error_code {
+    if (expired)
+      return error_code::peerTimeoutErr;
+    return ec;
+  };
+
+  // Writes are already batched; Nagle would hold small requests back for
+  // the peer's delayed ACK.
+  sys::error_code ec;
+  socket.set_option(tcp::no_delay(true), ec);
+  if (initiator) {
+    co_await net::async_write(socket, net::buffer(out),
+                              net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+      co_return std::unexpected(failure(ec));
+  }
+
+  std::array<char, PeerWire::handshakeSize> in;
+  co_await net::async_read(socket, net::buffer(in),
+                           net::redirect_error(net::use_awaitable, ec));
+  if (ec)
+    co_return std::unexpected(failure(ec));
+
+  auto handshakeRes =
+      PeerWire::parseHandshake(std::string_view(in.data(), in.size()));
+  if (!handshakeRes)
+    co_return std::unexpected(handshakeRes.error());
+  if (handshakeRes->infoHash != torrent.getInfoHash())
+    co_return std::unexpected(error_code::infoHashMismatchErr);
+
+  if (!initiator) {
+    co_await net::async_write(socket, net::buffer(out),
+                              net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+      co_return std::unexpected(failure(ec));
+  }
+  deadline.cancel();
+
+  std::size_t bitfield = (torrent.getPieces().size() + 7) / 8;
+  auto ringRes = RingBuffer::create(
+      std::max(bitfield, options.maxRequestLength) + 64 * 1024);
+  if (!ringRes)
+    co_return std::unexpected(ringRes.error());
+
+  co_return std::shared_ptr<PeerConnection>(new PeerConnection(
+      std::move(socket), std::move(*ringRes), torrent,
+      std::move(handshakeRes->peerId), handler, options));
+}
+
+PeerConnection::await_exp_void PeerConnection::run() {
+  auto self = shared_from_this();
+  lastRead = lastWrite = std::chrono::steady_clock::now();
+  net::co_spawn(
+      socket.get_executor(), [self] { return self->writeLoop(); },
+      net::detached);
+  net::co_spawn(
+      socket.get_executor(), [self] { return self->watchdog(); },
+      net::detached);
+
+  std::error_code error;
+  while (!error) {
+    // Every complete message in the buffer is handled in place.
+    PeerMessage message;
+    while (open) {
+      auto frameRes = PeerWire::frame(ring.data(), maxMessage, message);
+      if (!frameRes) {
+        error = frameRes.error();
+        break;
+      }
+      if (*frameRes == 0)
+        break;
+      auto handled = handle(message);
+      if (!handled) {
+        error = handled.error();
+        break;
+      }
+      ring.consume(*frameRes);
+    }
+    if (error)
+      break;
+    if (!open) {
+      error = error_code::peerConnectionClosedErr;
+      break;
+    }
+
+    std::span<char> space = ring.prepare();
+    sys::error_code ec;
+    std::size_t n = co_await socket.async_read_some(
+        net::buffer(space.data(), space.size()),
+        net::redirect_error(net::use_awaitable, ec));
+    if (ec) {
+      error = ec;
+    } else {
+      ring.commit(n);
+      lastRead = std::chrono::steady_clock::now();
+    }
+  }
+
+  if (timedOut)
+    error = error_code::peerTimeoutErr;
+  close();
+  dropOutstanding();
+  handler.onClose(*this, error);
+  co_return std::unexpected(error);
+}
+
+void PeerConnection::close() {
+  if (!open)
+    return;
+  open = false;
+  sys::error_code ec;
+  socket.close(ec);
+  wake.cancel();
+  idle.cancel();
+}
+
+PeerConnection::exp_void PeerConnection::handle(const PeerMessage &message) {
+  bool first = !received;
+  if (message.type != MessageType::keepAlive)
+    received = true;
+
+  switch (message.type) {
+  case MessageType::choke:
+    peerChoking = true;
+    dropOutstanding();
+    break;
+  case MessageType::unchoke:
+    peerChoking = false;
+    request();
+    break;
+  case MessageType::interested:
+  case MessageType::notInterested:
+    peerInterested = message.type == MessageType::interested;
+    handler.onInterest(*this);
+    break;
+  case MessageType::have: {
+    std::uint32_t piece = PeerWire::parseHave(message);
+    if (piece >= pieceCount)
+      return std::unexpected(error_code::invalidPeerMessageErr);
+    if (!peerPieces.test(piece)) {
+      peerPieces.set(piece);
+      handler.onHave(*this, piece);
+    }
+    break;
+  }
+  case MessageType::bitfield:
+    // Only as the first message (BEP 3); a later one would replace pieces
+    // the handler has already counted.
+    if (!first)
+      return std::unexpected(error_code::invalidPeerMessageErr);
+    return handleBitfield(message.payload);
+  case MessageType::request: {
+    auto block = *PeerWire::parseBlock(message);
+    if (!isValidBlock(block))
+      return std::unexpected(error_code::invalidPeerMessageErr);
+    // Requests while choked are dropped, as BEP 3 allows, and so are those
+    // past maxPeerRequests.
+    if (amChoking || peerRequests.size() >= options.maxPeerRequests)
+      break;
+    peerRequests.push_back(block);
+    handler.onRequest(*this, block);
+    break;
+  }
+  case MessageType::cancel: {
+    auto block = *PeerWire::parseBlock(message);
+    std::erase(peerRequests, block);
+    break;
+  }
+  case MessageType::piece: {
+    auto block = *PeerWire::parseBlock(message);
+    auto it = std::find(outstanding.begin(), outstanding.end(), block);
+    // Blocks we did not ask for, or cancelled, are ignored.
+    if (it == outstanding.end())
+      break;
+    outstanding.erase(it);
+    downloadRate.add(block.length);
+    handler.onBlock(*this, block, PeerWire::pieceData(message));
+    request();
+    break;
+  }
+  default:
+    break;
+  }
+  return {};
+}
+
+PeerConnection::exp_void
+PeerConnection::handleBitfield(std::string_view payload) {
+  auto bitfieldRes = Bitfield::fromBytes(payload, pieceCount);
+  if (!bitfieldRes)
+    return std::unexpected(bitfieldRes.error());
+  peerPieces = std::move(*bitfieldRes);
+  handler.onBitfield(*this);
+  return {};
+}
+
+bool PeerConnection::isValidBlock(const BlockRequest &block) const {
+  if (block.piece >= pieceCount || block.length == 0 ||
+      block.length > options.maxRequestLength)
+    return false;
+  std::uint64_t start = block.piece * pieceLength;
+  std::uint64_t pieceSize = std::min(pieceLength, totalLength - start);
+  return static_cast<std::uint64_t>(block.offset) + block.length <= pieceSize;
+}
+
+std::size_t PeerConnection::getPipelineDepth() const {
+  double blocks = downloadRate.get() * options.queueTime.count() /
+                  static_cast<double>(options.blockSize);
+  return std::clamp(static_cast<std::size_t>(blocks), options.minOutstanding,
+                    options.maxOutstanding);
+}
+
+void PeerConnection::request() {
+  if (!open || peerChoking || !amInterested)
+    return;
+
+  std::size_t depth = getPipelineDepth();
+  bool sent = false;
+  while (outstanding.size() < depth) {
+    auto block = handler.pickBlock(*this);
+    if (!block)
+      break;
+    outstanding.push_back(*block);
+    PeerWire::appendBlock(outbox, MessageType::request, *block);
+    sent = true;
+  }
+  if (sent)
+    send();
+}
+
+void PeerConnection::dropOutstanding() {
+  if (outstanding.empty())
+    return;
+  std::vector<BlockRequest> dropped(outstanding.begin(), outstanding.end());
+  outstanding.clear();
+  handler.onRequestsDropped(*this, dropped);
+}
+
+void PeerConnection::sendBitfield(const Bitfield &have) {
+  PeerWire::appendBitfield(outbox, have);
+  send();
+}
+
+void PeerConnection::sendHave(std::uint32_t piece) {
+  PeerWire::appendHave(outbox, piece);
+  send();
+}
+
+void PeerConnection::setInterested(bool interested) {
+  if (amInterested == interested)
+    return;
+  amInterested = interested;
+  PeerWire::append(outbox, interested ? MessageType::interested
+                                      : MessageType::notInterested);
+  send();
+  if (interested)
+    request();
+}
+
+void PeerConnection::choke() {
+  if (amChoking)
+    return;
+  amChoking = true;
+  peerRequests.clear();
+  PeerWire::append(outbox, MessageType::choke);
+  send();
+}
+
+void PeerConnection::unchoke() {
+  if (!amChoking)
+    return;
+  amChoking = false;
+  PeerWire::append(outbox, MessageType::unchoke);
+  send();
+}
+
+void PeerConnection::sendPiece(const BlockRequest &block,
+                               std::string_view data) {
+  // The peer may have cancelled the request, or been choked, meanwhile.
+  auto it = std::find(peerRequests.begin(), peerRequests.end(), block);
+  if (it == peerRequests.end() || data.size() != block.length)
+    return;
+  peerRequests.erase(it);
+
+  PeerWire::appendPieceHeader(outbox, block);
+  outbox.append(data);
+  uploadRate.add(block.length);
+  send();
+}
+
+void PeerConnection::cancel(const BlockRequest &block) {
+  auto it = std::find(outstanding.begin(), outstanding.end(), block);
+  if (it == outstanding.end())
+    return;
+  outstanding.erase(it);
+  PeerWire::appendBlock(outbox, MessageType::cancel, block);
+  send();
+}
+
+void PeerConnection::send() {
+  if (open && !outbox.empty())
+    wake.cancel();
+}
+
+// Writes whatever has been queued since the previous write as one batch, then
+// sleeps on the timer until send() cancels it.
+net::awaitable<void> PeerConnection::writeLoop() {
+  while (open) {
+    if (outbox.empty()) {
+      wake.expires_at(net::steady_timer::time_point::max());
+      sys::error_code ec;
+      co_await wake.async_wait(net::redirect_error(net::use_awaitable, ec));
+      continue;
+    }
+
+    std::swap(outbox, sending);
+    sys::error_code ec;
+    co_await net::async_write(socket, net::buffer(sending),
+                              net::redirect_error(net::use_awaitable, ec));
+    sending.clear();
+    lastWrite = std::chrono::steady_clock::now();
+    if (ec)
+      close();
+  }
+}
+
+// Closes the connection once the peer has been silent for idleTimeout, and
+// queues a keep-alive when we have written nothing for keepAliveInterval.
+net::awaitable<void> PeerConnection::watchdog() {
+  while (open) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastRead >= options.idleTimeout) {
+      timedOut = true;
+      close();
+      break;
+    }
+    if (now - lastWrite >= options.keepAliveInterval) {
+      // A write still in progress counts as activity.
+      if (outbox.empty() && sending.empty()) {
+        PeerWire::append(outbox, MessageType::keepAlive);
+        send();
+      }
+      lastWrite = now;
+    }
+
+    idle.expires_at(std::min(lastRead + options.idleTimeout,
+                             lastWrite + options.keepAliveInterval));
+    sys::error_code ec;
+    co_await idle.async_wait(net::redirect_error(net::use_awaitable, ec));
+  }
+}
+
+} // namespace btc
@@ -0,0 +1,130 @@
+#include <Peer/peerWire.h>
+
+namespace btc {
+
+void PeerWire::appendHandshake(std::string &out, std::string_view infoHash,
+                               std::string_view peerId) {
+  out.push_back(static_cast<char>(protocol.size()));
+  out.append(protocol);
+  out.append(8, '\0');
+  out.append(infoHash);
+  out.append(peerId);
+}
+
+PeerWire::exp_handshake PeerWire::parseHandshake(std::string_view in) {
+  if (in.size() != handshakeSize ||
+      static_cast<unsigned char>(in[0]) != protocol.size() ||
+      in.substr(1, protocol.size()) != protocol)
+    return std::unexpected(error_code::invalidHandshakeErr);
+
+  Handshake handshake;
+  std::string_view rest = in.substr(1 + protocol.size());
+  handshake.reserved = static_cast<std::uint64_t>(readU32(rest.data())) << 32 |
+                       readU32(rest.data() + 4);
+  handshake.infoHash = rest.substr(8, 20);
+  handshake.peerId = rest.substr(28, 20);
+  return handshake;
+}
+
+PeerWire::exp_size PeerWire::frame(std::string_view in, std::size_t maxLength,
+                                   PeerMessage &out) {
+  if (in.size() < headerSize)
+    return 0;
+  std::size_t length = readU32(in.data());
+  if (length > maxLength)
+    return std::unexpected(error_code::peerMessageTooLargeErr);
+  if (in.size() < headerSize + length)
+    return 0;
+
+  if (length == 0) {
+    out = {MessageType::keepAlive, {}};
+    return headerSize;
+  }
+
+  auto type = static_cast<MessageType>(in[headerSize]);
+  std::string_view payload = in.substr(headerSize + 1, length - 1);
+  std::size_t expected;
+  switch (type) {
+  case MessageType::choke:
+  case MessageType::unchoke:
+  case MessageType::interested:
+  case MessageType::notInterested:
+    expected = 0;
+    break;
+  case MessageType::have:
+    expected = 4;
+    break;
+  case MessageType::request:
+  case MessageType::cancel:
+    expected = 12;
+    break;
+  case MessageType::port:
+    expected = 2;
+    break;
+  case MessageType::piece:
+    if (payload.size() < 8)
+      return std::unexpected(error_code::invalidPeerMessageErr);
+    expected = payload.size();
+    break;
+  default:
+    // bitfield, and extension messages the caller may ignore
+    expected = payload.size();
+    break;
+  }
+  if (payload.size() != expected)
+    return std::unexpected(error_code::invalidPeerMessageErr);
+
+  out = {type, payload};
+  return headerSize + length;
+}
+
+PeerWire::exp_block PeerWire::parseBlock(const PeerMessage &message) {
+  const char *p = message.payload.data();
+  if (message.type == MessageType::piece)
+    return BlockRequest{readU32(p), readU32(p + 4),
+                        static_cast<std::uint32_t>(message.payload.size() -
+                                                   8)};
+  if (message.payload.size() != 12)
+    return std::unexpected(error_code::invalidPeerMessageErr);
+  return BlockRequest{readU32(p), readU32(p + 4), readU32(p + 8)};
+}
+
+void PeerWire::append(std::string &out, MessageType type) {
+  if (type == MessageType::keepAlive) {
+    appendU32(out, 0);
+    return;
+  }
+  appendU32(out, 1);
+  out.push_back(static_cast<char>(type));
+}
+
+void PeerWire::appendHave(std::string &out, std::uint32_t piece) {
+  appendU32(out, 5);
+  out.push_back(static_cast<char>(MessageType::have));
+  appendU32(out, piece);
+}
+
+void PeerWire::appendBitfield(std::string &out, const Bitfield &have) {
+  std::string_view bytes = have.bytes();
+  appendU32(out, static_cast<std::uint32_t>(bytes.size() + 1));
+  out.push_back(static_cast<char>(MessageType::bitfield));
+  out += bytes;
+}
+
+void PeerWire::appendBlock(std::string &out, MessageType type,
+                           const BlockRequest &block) {
+  appendU32(out, 13);
+  out.push_back(static_cast<char>(type));
+  appendU32(out, block.piece);
+  appendU32(out, block.offset);
+  appendU32(out, block.length);
+}
+
+void PeerWire::appendPieceHeader(std::string &out, const BlockRequest &block) {
+  appendU32(out, 9 + block.length);
+  out.push_back(static_cast<char>(MessageType::piece));
+  appendU32(out, block.piece);
+  appendU32(out, block.offset);
+}
+
+} // namespace btc
@@ -0,0 +1,358 @@
+#include <Peer/piecePicker.h>
+#include <algorithm>
+
+namespace btc {
+
+PiecePicker::PiecePicker(const TorrentFile &torrent, std::size_t blockSize)
+    : PiecePicker(torrent.getPieces().size(),
+                  static_cast<std::uint64_t>(torrent.getPieceLength()),
+                  static_cast<std::uint64_t>(torrent.getTotalLength()),
+                  blockSize) {}
+
+PiecePicker::PiecePicker(std::size_t pieceCount, std::uint64_t pieceLength,
+                         std::uint64_t totalLength, std::size_t blockSize)
+    : pieceLength(pieceLength), totalLength(totalLength),
+      blockSize(blockSize), availability(pieceCount, 0),
+      state(pieceCount, State::queued), have(pieceCount),
+      queued(pieceCount, true), heads(1, none),
+      next(pieceCount, none), prev(pieceCount, none),
+      queuedCount(pieceCount) {
+  // Ties within a bucket are broken by list order, so start it shuffled.
+  std::vector<std::uint32_t> order(pieceCount);
+  for (std::uint32_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  for (std::size_t i = order.size(); i > 1; i--)
+    std::swap(order[i - 1], order[random() % i]);
+  for (std::uint32_t piece : order)
+    link(piece);
+}
+
+std::uint32_t PiecePicker::random() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+std::size_t PiecePicker::getPieceSize(std::size_t piece) const {
+  std::uint64_t start = piece * pieceLength;
+  return static_cast<std::size_t>(std::min(pieceLength, totalLength - start));
+}
+
+std::size_t PiecePicker::getBlockCount(std::size_t piece) const {
+  return (getPieceSize(piece) + blockSize - 1) / blockSize;
+}
+
+BlockRequest PiecePicker::makeBlock(std::size_t piece,
+                                    std::size_t block) const {
+  std::size_t offset = block * blockSize;
+  return {static_cast<std::uint32_t>(piece),
+          static_cast<std::uint32_t>(offset),
+          static_cast<std::uint32_t>(
+              std::min(blockSize, getPieceSize(piece) - offset))};
+}
+
+// Inserts a queued piece into the bucket of its availability, at the front
+// or the back at random.
+void PiecePicker::link(std::uint32_t piece) {
+  std::uint32_t bucket = availability[piece];
+  if (bucket >= heads.size())
+    heads.resize(bucket + 1, none);
+
+  std::uint32_t head = heads[bucket];
+  if (head == none) {
+    heads[bucket] = piece;
+    next[piece] = prev[piece] = piece;
+    return;
+  }
+  // Lists are circular: the head's prev is the tail.
+  std::uint32_t tail = prev[head];
+  next[piece] = head;
+  prev[piece] = tail;
+  next[tail] = piece;
+  prev[head] = piece;
+  if (random() & 1)
+    heads[bucket] = piece;
+}
+
+void PiecePicker::unlink(std::uint32_t piece) {
+  unlink(piece, availability[piece]);
+}
+
+void PiecePicker::unlink(std::uint32_t piece, std::uint32_t bucket) {
+  if (next[piece] == piece) {
+    heads[bucket] = none;
+  } else {
+    next[prev[piece]] = next[piece];
+    prev[next[piece]] = prev[piece];
+    if (heads[bucket] == piece)
+      heads[bucket] = next[piece];
+  }
+  next[piece] = prev[piece] = none;
+}
+
+void PiecePicker::incrementPiece(std::size_t piece) {
+  auto p = static_cast<std::uint32_t>(piece);
+  if (state[piece] == State::queued) {
+    unlink(p);
+    availability[piece]++;
+    link(p);
+  } else {
+    availability[piece]++;
+  }
+}
+
+void PiecePicker::decrementPiece(std::size_t piece) {
+  auto p = static_cast<std::uint32_t>(piece);
+  assert(availability[piece] > 0 && "piece availability below zero");
+  if (state[piece] == State::queued) {
+    unlink(p);
+    availability[piece]--;
+    link(p);
+  } else {
+    availability[piece]--;
+  }
+}
+
+// Counts are updated in bulk by the bitfield; only queued pieces, which sit
+// in the bucket of their old count, have to be moved one by one.
+void PiecePicker::addPeer(const Bitfield &pieces) {
+  pieces.increment(availability);
+  for (std::size_t i = pieces.findNext(0); i != Bitfield::npos;
+       i = pieces.findNext(i + 1))
+    if (state[i] == State::queued) {
+      auto p = static_cast<std::uint32_t>(i);
+      unlink(p, availability[i] - 1);
+      link(p);
+    }
+}
+
+void PiecePicker::removePeer(const Bitfield &pieces) {
+  pieces.decrement(availability);
+  for (std::size_t i = pieces.findNext(0); i != Bitfield::npos;
+       i = pieces.findNext(i + 1)) {
+    assert(availability[i] != UINT32_MAX && "piece availability below zero");
+    if (state[i] == State::queued) {
+      auto p = static_cast<std::uint32_t>(i);
+      unlink(p, availability[i] + 1);
+      link(p);
+    }
+  }
+}
+
+PiecePicker::Partial *PiecePicker::findPartial(std::size_t piece) {
+  auto it = partialIndex.find(piece);
+  return it == partialIndex.end() ? nullptr : &downloading[it->second];
+}
+
+PiecePicker::Partial &PiecePicker::start(std::size_t piece) {
+  unlink(static_cast<std::uint32_t>(piece));
+  state[piece] = State::downloading;
+  queued.reset(piece);
+  queuedCount--;
+
+  std::size_t blocks = getBlockCount(piece);
+  freeBlocks += blocks;
+  partialIndex[piece] = downloading.size();
+  downloading.push_back({piece, std::vector<Block>(blocks), blocks});
+  return downloading.back();
+}
+
+std::size_t PiecePicker::takeFree(Partial &partial, std::size_t count,
+                                  std::vector<BlockRequest> &out) {
+  std::size_t taken = 0;
+  for (std::size_t b = 0; b < partial.blocks.size() && taken < count; b++) {
+    Block &block = partial.blocks[b];
+    if (block.received || block.requests > 0)
+      continue;
+    block.requests = 1;
+    freeBlocks--;
+    out.push_back(makeBlock(partial.piece, b));
+    taken++;
+  }
+  return taken;
+}
+
+std::size_t PiecePicker::pickNew(const Bitfield &peerPieces,
+                                 std::size_t count,
+                                 std::vector<BlockRequest> &out) {
+  std::size_t taken = 0;
+  std::size_t pieces = availability.size();
+
+  if (haveCount < randomFirst) {
+    // From a random piece to the end, then from the start.
+    std::size_t from = random() % pieces;
+    for (std::size_t i = peerPieces.findNextCommon(queued, from);
+         i != Bitfield::npos && taken < count;
+         i = peerPieces.findNextCommon(queued, i + 1))
+      taken += takeFree(start(i), count - taken, out);
+    for (std::size_t i = peerPieces.findNextCommon(queued, 0);
+         i < from && taken < count;
+         i = peerPieces.findNextCommon(queued, i + 1))
+      taken += takeFree(start(i), count - taken, out);
+    return taken;
+  }
+
+  // Rarest first. Unless there are seeds, the peer is counted in every
+  // piece it could give us, so bucket 0 holds no candidate. Each bucket is
+  // walked once, up to the tail it had on entry, since started pieces are
+  // unlinked along the way.
+  std::size_t skipped = 0;
+  for (std::size_t bucket = seeds > 0 ? 0 : 1;
+       bucket < heads.size() && taken < count && skipped < scanLimit;
+       bucket++) {
+    std::uint32_t piece = heads[bucket];
+    if (piece == none)
+      continue;
+    std::uint32_t tail = prev[piece];
+    for (;;) {
+      std::uint32_t following = next[piece];
+      bool last = piece == tail;
+      if (peerPieces.test(piece))
+        taken += takeFree(start(piece), count - taken, out);
+      else
+        skipped++;
+      if (last || taken >= count || skipped == scanLimit)
+        break;
+      piece = following;
+    }
+  }
+
+  // The rarest pieces are ones the peer lacks. Of a few of its queued
+  // pieces from a random point on, the least available is started.
+  while (taken < count && skipped == scanLimit) {
+    std::size_t from = random() % pieces;
+    std::size_t i = peerPieces.findNextCommon(queued, from);
+    if (i == Bitfield::npos)
+      i = peerPieces.findNextCommon(queued, 0);
+    if (i == Bitfield::npos)
+      break;
+    std::size_t best = i;
+    for (std::size_t seen = 1; seen < sampleSize; seen++) {
+      i = peerPieces.findNextCommon(queued, i + 1);
+      if (i == Bitfield::npos)
+        break;
+      if (availability[i] < availability[best])
+        best = i;
+    }
+    taken += takeFree(start(best), count - taken, out);
+  }
+  return taken;
+}
+
+// Blocks that are requested but not received, the least requested first.
+// Blocks picked by this same call, from `out[from]` on, are not doubled.
+std::size_t PiecePicker::pickEndgame(const Bitfield &peerPieces,
+                                     std::size_t count,
+                                     std::vector<BlockRequest> &out,
+                                     std::size_t from,
+                                     const requested_fn &requested) {
+  std::size_t taken = 0;
+  for (std::size_t level = 1; level < endgameDuplicates && taken < count;
+       level++) {
+    for (auto &partial : downloading) {
+      if (!peerPieces.test(partial.piece))
+        continue;
+      for (std::size_t b = 0; b < partial.blocks.size() && taken < count;
+           b++) {
+        Block &block = partial.blocks[b];
+        if (block.received || block.requests != level)
+          continue;
+        BlockRequest request = makeBlock(partial.piece, b);
+        if ((requested && requested(request)) ||
+            std::find(out.begin() + static_cast<std::ptrdiff_t>(from),
+                      out.end(), request) != out.end())
+          continue;
+        block.requests++;
+        out.push_back(request);
+        taken++;
+      }
+    }
+  }
+  return taken;
+}
+
+std::size_t PiecePicker::pick(const Bitfield &peerPieces,
+                              std::size_t count,
+                              std::vector<BlockRequest> &out,
+                              const requested_fn &requested) {
+  std::size_t from = out.size();
+  std::size_t taken = 0;
+  if (freeBlocks > 0)
+    for (auto &partial : downloading) {
+      if (taken == count)
+        break;
+      if (peerPieces.test(partial.piece))
+        taken += takeFree(partial, count - taken, out);
+    }
+  if (taken < count && queuedCount > 0)
+    taken += pickNew(peerPieces, count - taken, out);
+  if (taken < count && isEndgame())
+    taken += pickEndgame(peerPieces, count - taken, out, from, requested);
+  return taken;
+}
+
+void PiecePicker::abort(const BlockRequest &request) {
+  Partial *partial = findPartial(request.piece);
+  if (!partial)
+    return;
+  Block &block = partial->blocks[request.offset / blockSize];
+  if (block.requests == 0)
+    return;
+  if (--block.requests == 0 && !block.received)
+    freeBlocks++;
+}
+
+bool PiecePicker::received(const BlockRequest &request) {
+  Partial *partial = findPartial(request.piece);
+  if (!partial)
+    return false;
+  Block &block = partial->blocks[request.offset / blockSize];
+  if (block.received)
+    return false;
+  if (block.requests == 0)
+    freeBlocks--;
+  else
+    block.requests--;
+  block.received = true;
+  return --partial->missing == 0;
+}
+
+void PiecePicker::pieceFailed(std::size_t piece) {
+  Partial *partial = findPartial(piece);
+  if (!partial)
+    return;
+  // Late answers to requests still out are taken as received blocks.
+  for (auto &block : partial->blocks) {
+    if (block.received || block.requests > 0)
+      freeBlocks++;
+    block = Block();
+  }
+  partial->missing = partial->blocks.size();
+}
+
+void PiecePicker::setHave(std::size_t piece) {
+  if (state[piece] == State::have)
+    return;
+
+  if (state[piece] == State::queued) {
+    unlink(static_cast<std::uint32_t>(piece));
+    queued.reset(piece);
+    queuedCount--;
+  } else {
+    std::size_t index = partialIndex[piece];
+    for (auto &block : downloading[index].blocks)
+      if (!block.received && block.requests == 0)
+        freeBlocks--;
+    downloading.erase(downloading.begin() +
+                      static_cast<std::ptrdiff_t>(index));
+    partialIndex.erase(piece);
+    for (std::size_t i = index; i < downloading.size(); i++)
+      partialIndex[downloading[i].piece] = i;
+  }
+  state[piece] = State::have;
+  have.set(piece);
+  haveCount++;
+}
+
+} // namespace btc
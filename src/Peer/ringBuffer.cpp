@@ -0,0 +1,64 @@
+#include <Peer/ringBuffer.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+namespace btc {
+
+RingBuffer::exp_ring RingBuffer::create(std::size_t capacity) {
+  std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  capacity = (std::max<std::size_t>(capacity, 1) + page - 1) / page * page;
+
+  int fd = ::memfd_create("btc-ring", MFD_CLOEXEC);
+  if (fd < 0)
+    return std::unexpected(error_code::ringBufferMappingErr);
+  if (::ftruncate(fd, static_cast<off_t>(capacity)) < 0) {
+    ::close(fd);
+    return std::unexpected(error_code::ringBufferMappingErr);
+  }
+
+  // Reserve twice the size, then map the file over both halves.
+  void *area = ::mmap(nullptr, 2 * capacity, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (area == MAP_FAILED) {
+    ::close(fd);
+    return std::unexpected(error_code::ringBufferMappingErr);
+  }
+  char *base = static_cast<char *>(area);
+  for (char *half : {base, base + capacity}) {
+    if (::mmap(half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+               fd, 0) == MAP_FAILED) {
+      ::munmap(area, 2 * capacity);
+      ::close(fd);
+      return std::unexpected(error_code::ringBufferMappingErr);
+    }
+  }
+  // The mappings keep the memory alive.
+  ::close(fd);
+  return RingBuffer(base, capacity);
+}
+
+RingBuffer::RingBuffer(RingBuffer &&other) noexcept
+    : base(std::exchange(other.base, nullptr)),
+      capacity(std::exchange(other.capacity, 0)),
+      head(std::exchange(other.head, 0)), tail(std::exchange(other.tail, 0)) {}
+
+RingBuffer &RingBuffer::operator=(RingBuffer &&other) noexcept {
+  if (this != &other) {
+    if (base)
+      ::munmap(base, 2 * capacity);
+    base = std::exchange(other.base, nullptr);
+    capacity = std::exchange(other.capacity, 0);
+    head = std::exchange(other.head, 0);
+    tail = std::exchange(other.tail, 0);
+  }
+  return *this;
+}
+
+RingBuffer::~RingBuffer() {
+  if (base)
+    ::munmap(base, 2 * capacity);
+}
+
+} // namespace btc
@@ -0,0 +1,221 @@
+#include <Peer/swarm.h>
+#include <algorithm>
+#include <cassert>
+
+namespace btc {
+
+Swarm::Swarm(net::io_context &ctx, const TorrentFile &torrent,
+             WriteCache &cache, std::string peerId, Options options)
+    : ctx(ctx), torrent(torrent), cache(cache), peerId(std::move(peerId)),
+      options(options), picker(torrent, options.peer.blockSize),
+      wake(ctx, net::steady_timer::time_point::max()) {
+  picker.setRandomFirst(options.randomFirst);
+  picker.setEndgameDuplicates(options.endgameDuplicates);
+}
+
+void Swarm::addPeers(const std::vector<Peer> &list) {
+  for (const auto &peer : list)
+    if (known.insert(peer.ip + ":" + std::to_string(peer.port)).second)
+      candidates.push_back(peer);
+  connectNext();
+}
+
+void Swarm::connectNext() {
+  while (!done && !candidates.empty() &&
+         peers.size() + connecting < options.maxPeers) {
+    connecting++;
+    net::co_spawn(ctx, connectTo(std::move(candidates.front())),
+                  net::detached);
+    candidates.pop_front();
+  }
+}
+
+net::awaitable<void> Swarm::connectTo(Peer peer) {
+  auto connRes = co_await PeerConnection::connect(ctx, peer, torrent, peerId,
+                                                  *this, options.peer);
+  connecting--;
+  if (!connRes || done) {
+    if (connRes)
+      (*connRes)->close();
+    connectNext();
+    wake.cancel();
+    co_return;
+  }
+
+  std::shared_ptr<PeerConnection> conn = std::move(*connRes);
+  peers[conn.get()].conn = conn;
+  if (picker.getHaveCount() > 0)
+    conn->sendBitfield(picker.getHave());
+  // onClose() does the bookkeeping.
+  co_await conn->run();
+}
+
+Swarm::await_exp_void Swarm::wait() {
+  while (!done && (peers.size() + connecting > 0 || !candidates.empty())) {
+    sys::error_code ec;
+    wake.expires_at(net::steady_timer::time_point::max());
+    co_await wake.async_wait(net::redirect_error(net::use_awaitable, ec));
+  }
+  if (!done)
+    co_return std::unexpected(error_code::swarmExhaustedErr);
+  if (result)
+    co_return std::unexpected(result);
+  co_return exp_void{};
+}
+
+void Swarm::onBitfield(PeerConnection &conn) {
+  PeerState &state = peers[&conn];
+  // The connection takes a bitfield only as the first message, so none of
+  // the peer's pieces are counted yet. Whatever it announces from here on
+  // is in getPeerPieces(), which onClose() takes back out.
+  assert(!state.counted);
+  state.counted = true;
+  state.seed = conn.getPeerPieces().all();
+  if (state.seed)
+    picker.addSeed();
+  else
+    picker.addPeer(conn.getPeerPieces());
+  updateInterest(conn);
+}
+
+void Swarm::onHave(PeerConnection &conn, std::uint32_t piece) {
+  peers[&conn].counted = true;
+  picker.incrementPiece(piece);
+  if (!conn.isInterested() && !picker.isHave(piece))
+    conn.setInterested(true);
+}
+
+void Swarm::updateInterest(PeerConnection &conn) {
+  conn.setInterested(
+      conn.getPeerPieces().countAndNot(picker.getHave()) > 0);
+}
+
+std::optional<BlockRequest> Swarm::pickBlock(PeerConnection &conn) {
+  // In endgame every pick is a duplicate; only idle peers get one, so a
+  // fast peer's pipeline is not filled with blocks already on their way.
+  if (done || (picker.isEndgame() && !conn.getOutstanding().empty()))
+    return std::nullopt;
+
+  // Blocks this connection already has out are skipped.
+  auto requested = [&](const BlockRequest &block) {
+    auto it = owners.find(key(block));
+    return it != owners.end() &&
+           std::find(it->second.begin(), it->second.end(), &conn) !=
+               it->second.end();
+  };
+  picked.clear();
+  if (picker.pick(conn.getPeerPieces(), 1, picked, requested) == 0)
+    return std::nullopt;
+
+  auto &list = owners[key(picked[0])];
+  if (!list.empty())
+    stats.duplicateRequests++;
+  list.push_back(&conn);
+  return picked[0];
+}
+
+void Swarm::onBlock(PeerConnection &conn, const BlockRequest &block,
+                    std::string_view data) {
+  auto it = owners.find(key(block));
+  if (done || it == owners.end())
+    return;
+
+  // The first copy is kept; the same request to other peers is cancelled.
+  picker.received(block);
+  for (PeerConnection *other : it->second)
+    if (other != &conn) {
+      other->cancel(block);
+      picker.abort(block);
+      stats.cancels++;
+    }
+  owners.erase(it);
+
+  auto writeRes = cache.write(block.piece, block.offset, data);
+  if (!writeRes) {
+    finish(writeRes.error());
+    return;
+  }
+  if (*writeRes == BlockStatus::pieceVerified) {
+    pieceVerified(block.piece);
+  } else if (*writeRes == BlockStatus::pieceFailed) {
+    stats.piecesFailed++;
+    picker.pieceFailed(block.piece);
+    requestAll();
+  } else if (picker.isEndgame()) {
+    // Cancelled pipelines have room for duplicates of other blocks.
+    requestAll();
+  }
+}
+
+void Swarm::pieceVerified(std::uint32_t piece) {
+  picker.setHave(piece);
+  if (picker.isComplete()) {
+    finish(std::error_code());
+    return;
+  }
+  for (auto &[conn, state] : peers) {
+    conn->sendHave(piece);
+    if (conn->isInterested() &&
+        conn->getPeerPieces().countAndNot(picker.getHave()) == 0)
+      conn->setInterested(false);
+  }
+  if (picker.isEndgame())
+    requestAll();
+}
+
+void Swarm::dropOwner(PeerConnection &conn, const BlockRequest &block) {
+  auto it = owners.find(key(block));
+  if (it == owners.end())
+    return;
+  std::erase(it->second, &conn);
+  if (it->second.empty())
+    owners.erase(it);
+  picker.abort(block);
+}
+
+void Swarm::onRequestsDropped(PeerConnection &conn,
+                              std::span<const BlockRequest> blocks) {
+  for (const auto &block : blocks)
+    dropOwner(conn, block);
+  // Other peers can take the blocks over.
+  for (auto &[other, state] : peers)
+    if (other != &conn)
+      other->request();
+}
+
+void Swarm::onClose(PeerConnection &conn, std::error_code) {
+  auto it = peers.find(&conn);
+  if (it == peers.end())
+    return;
+  if (it->second.seed)
+    picker.removeSeed();
+  else if (it->second.counted)
+    picker.removePeer(conn.getPeerPieces());
+  peers.erase(it);
+
+  connectNext();
+  wake.cancel();
+}
+
+void Swarm::requestAll() {
+  for (auto &[conn, state] : peers)
+    conn->request();
+}
+
+void Swarm::finish(std::error_code error) {
+  if (done)
+    return;
+  done = true;
+  result = error;
+  if (!error) {
+    auto flushRes = cache.flushAll();
+    if (!flushRes)
+      result = flushRes.error();
+  }
+  for (auto &[conn, state] : peers)
+    conn->close();
+  owners.clear();
+  wake.cancel();
+}
+
+} // namespace btc
@@ -0,0 +1,51 @@
+#include <Storage/diskIo.h>
+#include <Storage/uringDiskIo.h>
+#include <string_view>
+
+namespace btc {
+
+std::unique_ptr<DiskIo> DiskIo::create(net::io_context &ctx,
+                                       DiskStorage &storage, ThreadPool &pool,
+                                       DiskBackend preferred) {
+  if (preferred == DiskBackend::ioUring) {
+    auto uringRes = UringDiskIo::create(ctx, storage);
+    if (uringRes)
+      return std::move(*uringRes);
+  }
+  return std::make_unique<ThreadPoolDiskIo>(ctx, storage, pool);
+}
+
+void ThreadPoolDiskIo::asyncRead(std::size_t piece, std::size_t offset,
+                                 std::span<char> out,
+                                 completion_handler onDone) {
+  queued.push_back({piece, offset, out, false, std::move(onDone)});
+}
+
+void ThreadPoolDiskIo::asyncWrite(std::size_t piece, std::size_t offset,
+                                  std::span<const char> data,
+                                  completion_handler onDone) {
+  std::span<char> buffer(const_cast<char *>(data.data()), data.size());
+  queued.push_back({piece, offset, buffer, true, std::move(onDone)});
+}
+
+void ThreadPoolDiskIo::submit() {
+  // The work guard keeps io_context::run() from returning while a request is
+  // still on the pool.
+  for (auto &request : queued) {
+    pool.submit([this, request = std::move(request),
+                 work = net::make_work_guard(ctx)]() mutable {
+      exp_void res =
+          request.writing
+              ? storage.write(request.piece, request.offset,
+                              std::string_view(request.buffer.data(),
+                                               request.buffer.size()))
+              : storage.read(request.piece, request.offset, request.buffer);
+      net::post(ctx, [onDone = std::move(request.onDone), res] {
+        onDone(res);
+      });
+    });
+  }
+  queued.clear();
+}
+
+} // namespace btc
@@ -0,0 +1,209 @@
+#include <Storage/diskStorage.h>
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace btc {
+
+namespace {
+
+// Paths come from the metainfo file; they must stay inside the download
+// directory.
+bool isSafe(const std::filesystem::path &path) {
+  if (path.empty() || path.has_root_path())
+    return false;
+  for (const auto &part : path) {
+    if (part == ".." || part == ".")
+      return false;
+  }
+  return true;
+}
+
+#ifdef IOV_MAX
+const std::size_t maxIovecs = IOV_MAX;
+#else
+const std::size_t maxIovecs = 1024;
+#endif
+
+} // namespace
+
+DiskStorage::Handle::~Handle() { ::close(fd); }
+
+DiskStorage::exp_storage DiskStorage::open(const TorrentFile &torrent,
+                                           const std::filesystem::path &root,
+                                           Allocation allocation,
+                                           std::size_t maxOpenFiles) {
+  if (!isSafe(torrent.getName()))
+    return std::unexpected(error_code::unsafeFilePathErr);
+  if (torrent.getFiles()) {
+    for (const auto &file : *torrent.getFiles()) {
+      if (!isSafe(file.path))
+        return std::unexpected(error_code::unsafeFilePathErr);
+    }
+  }
+
+  DiskStorage storage(torrent, root, std::max<std::size_t>(maxOpenFiles, 1));
+  const FileMap &files = storage.files;
+
+  for (std::size_t i = 0; i < files.getFileCount(); i++) {
+    std::filesystem::path path = files.getPath(i, root);
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec)
+      return std::unexpected(error_code::errorOpeningFileErr);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return std::unexpected(error_code::errorOpeningFileErr);
+    Handle handle(fd);
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+      return std::unexpected(error_code::errorOpeningFileErr);
+
+    off_t length = static_cast<off_t>(files.getFileLength(i));
+    if (allocation == Allocation::full) {
+      // posix_fallocate emulates the allocation by writing zeroes where
+      // the file system has no fallocate support.
+      if (length > 0 && ::posix_fallocate(fd, 0, length) != 0)
+        return std::unexpected(error_code::errorWritingFileErr);
+    } else if (st.st_size < length && ::ftruncate(fd, length) < 0) {
+      return std::unexpected(error_code::errorWritingFileErr);
+    }
+  }
+  return storage;
+}
+
+DiskStorage::exp_void
+DiskStorage::write(std::size_t piece, std::size_t offset,
+                   std::span<const std::string_view> buffers) {
+  std::vector<std::span<char>> spans;
+  spans.reserve(buffers.size());
+  for (auto buffer : buffers)
+    spans.emplace_back(const_cast<char *>(buffer.data()), buffer.size());
+  return transfer(piece, offset, spans, true);
+}
+
+DiskStorage::exp_void
+DiskStorage::read(std::size_t piece, std::size_t offset,
+                  std::span<const std::span<char>> buffers) {
+  return transfer(piece, offset, buffers, false);
+}
+
+std::size_t DiskStorage::getOpenFiles() const {
+  std::lock_guard lock(cache->mutex);
+  return cache->open.size();
+}
+
+bool DiskStorage::isInRange(std::size_t piece, std::size_t offset,
+                            std::size_t length) const {
+  if (piece >= files.getPieceCount())
+    return false;
+  // Written so that no sum can wrap around.
+  std::uint64_t left = files.getTotalLength() -
+                       static_cast<std::uint64_t>(piece) *
+                           files.getPieceLength();
+  return offset <= left && length <= left - offset;
+}
+
+DiskStorage::exp_handle DiskStorage::handle(std::size_t file) {
+  {
+    std::lock_guard lock(cache->mutex);
+    auto it = cache->open.find(file);
+    if (it != cache->open.end()) {
+      cache->lru.splice(cache->lru.begin(), cache->lru, it->second.second);
+      return it->second.first;
+    }
+  }
+
+  // Opened outside the lock; if two threads race on the same file, the
+  // second descriptor is simply closed when its last user drops it.
+  int fd = ::open(files.getPath(file, root).c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+    return std::unexpected(error_code::errorOpeningFileErr);
+  auto opened = std::make_shared<const Handle>(fd);
+
+  std::lock_guard lock(cache->mutex);
+  auto it = cache->open.find(file);
+  if (it != cache->open.end())
+    return it->second.first;
+
+  // Evicted handles stay valid for threads still using them.
+  while (cache->open.size() >= maxOpenFiles) {
+    cache->open.erase(cache->lru.back());
+    cache->lru.pop_back();
+  }
+  cache->lru.push_front(file);
+  cache->open.emplace(file, std::make_pair(opened, cache->lru.begin()));
+  return opened;
+}
+
+DiskStorage::exp_void
+DiskStorage::transfer(std::size_t piece, std::size_t offset,
+                      std::span<const std::span<char>> buffers, bool writing) {
+  std::size_t total = 0;
+  for (auto buffer : buffers)
+    total += buffer.size();
+
+  if (!isInRange(piece, offset, total))
+    return std::unexpected(error_code::invalidBlockRangeErr);
+
+  thread_local std::vector<FileSegment> segments;
+  thread_local std::vector<iovec> iovecs;
+  segments.clear();
+  files.map(piece, offset, total, segments);
+
+  std::size_t buffer = 0;
+  std::size_t bufferOffset = 0;
+  for (const auto &segment : segments) {
+    auto handleRes = handle(segment.file);
+    if (!handleRes)
+      return std::unexpected(handleRes.error());
+    int fd = (*handleRes)->fd;
+
+    // Slices of the caller's buffers that make up this segment.
+    iovecs.clear();
+    for (std::size_t left = segment.length; left > 0;) {
+      std::size_t chunk =
+          std::min(left, buffers[buffer].size() - bufferOffset);
+      if (chunk > 0)
+        iovecs.push_back({buffers[buffer].data() + bufferOffset, chunk});
+      left -= chunk;
+      bufferOffset += chunk;
+      if (bufferOffset == buffers[buffer].size()) {
+        buffer++;
+        bufferOffset = 0;
+      }
+    }
+
+    off_t position = static_cast<off_t>(segment.offset);
+    std::size_t first = 0;
+    while (first < iovecs.size()) {
+      int count =
+          static_cast<int>(std::min(iovecs.size() - first, maxIovecs));
+      ssize_t n = writing ? ::pwritev(fd, &iovecs[first], count, position)
+                          : ::preadv(fd, &iovecs[first], count, position);
+      if (n <= 0)
+        return std::unexpected(writing ? error_code::errorWritingFileErr
+                                       : error_code::errorReadingFileErr);
+
+      // Partial transfer: skip what was done and retry from there.
+      position += n;
+      for (auto done = static_cast<std::size_t>(n); done > 0;) {
+        iovec &io = iovecs[first];
+        std::size_t step = std::min(done, io.iov_len);
+        io.iov_base = static_cast<char *>(io.iov_base) + step;
+        io.iov_len -= step;
+        done -= step;
+        if (io.iov_len == 0)
+          first++;
+      }
+    }
+  }
+  return {};
+}
+
+} // namespace btc
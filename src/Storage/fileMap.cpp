@@ -0,0 +1,98 @@
+#include <Storage/fileMap.h>
+#include <algorithm>
+
+namespace btc {
+
+FileMap::FileMap(const TorrentFile &torrent)
+    : name(torrent.getName()), pieceLength(torrent.getPieceLength()),
+      single(!torrent.getFiles()) {
+  starts.push_back(0);
+  if (single) {
+    starts.push_back(torrent.getTotalLength());
+  } else {
+    paths.reserve(torrent.getFiles()->size());
+    starts.reserve(torrent.getFiles()->size() + 1);
+    for (const auto &file : *torrent.getFiles()) {
+      paths.push_back(file.path);
+      starts.push_back(starts.back() + file.length);
+    }
+  }
+
+  // One pass over pieces and files together; the extra entry lets
+  // getLastFile look at the next piece without a bounds check.
+  std::size_t pieces = torrent.getPieces().size();
+  pieceFirstFile.reserve(pieces + 1);
+  std::size_t file = 0;
+  for (std::size_t piece = 0; piece < pieces; piece++) {
+    std::uint64_t begin = static_cast<std::uint64_t>(piece) * pieceLength;
+    while (file + 1 < getFileCount() && starts[file + 1] <= begin)
+      file++;
+    pieceFirstFile.push_back(static_cast<std::uint32_t>(file));
+  }
+  pieceFirstFile.push_back(static_cast<std::uint32_t>(getFileCount() - 1));
+}
+
+std::size_t FileMap::getPieceSize(std::size_t piece) const {
+  std::uint64_t begin = static_cast<std::uint64_t>(piece) * pieceLength;
+  return static_cast<std::size_t>(
+      std::min<std::uint64_t>(pieceLength, getTotalLength() - begin));
+}
+
+std::filesystem::path
+FileMap::getPath(std::size_t file, const std::filesystem::path &root) const {
+  if (single)
+    return root / name;
+  return root / name / paths[file];
+}
+
+std::size_t FileMap::fileAt(std::uint64_t offset) const {
+  auto it = std::upper_bound(starts.begin() + 1, starts.end() - 1, offset);
+  return static_cast<std::size_t>(it - starts.begin()) - 1;
+}
+
+std::size_t FileMap::getLastFile(std::size_t piece) const {
+  std::uint64_t end =
+      static_cast<std::uint64_t>(piece) * pieceLength + getPieceSize(piece);
+  std::size_t file = pieceFirstFile[piece + 1];
+  while (file > pieceFirstFile[piece] && starts[file] >= end)
+    file--;
+  return file;
+}
+
+void FileMap::map(std::size_t piece, std::size_t offset, std::size_t length,
+                  std::vector<FileSegment> &out) const {
+  std::uint64_t position =
+      static_cast<std::uint64_t>(piece) * pieceLength + offset;
+  // A range starting past the end of its piece lies outside the piece's
+  // files; it is looked up over the whole torrent instead.
+  std::size_t file;
+  if (offset < getPieceSize(piece)) {
+    auto first = starts.begin() + pieceFirstFile[piece] + 1;
+    auto last = starts.begin() + pieceFirstFile[piece + 1] + 1;
+    file = static_cast<std::size_t>(std::upper_bound(first, last, position) -
+                                    starts.begin()) -
+           1;
+  } else {
+    file = fileAt(position);
+  }
+
+  while (length > 0 && file < getFileCount()) {
+    std::uint64_t inFile = position - starts[file];
+    std::size_t chunk = static_cast<std::size_t>(
+        std::min<std::uint64_t>(length, getFileLength(file) - inFile));
+    if (chunk > 0)
+      out.push_back({file, inFile, chunk});
+    position += chunk;
+    length -= chunk;
+    file++;
+  }
+}
+
+std::vector<FileSegment> FileMap::map(std::size_t piece, std::size_t offset,
+                                      std::size_t length) const {
+  std::vector<FileSegment> out;
+  map(piece, offset, length, out);
+  return out;
+}
+
+} // namespace btc
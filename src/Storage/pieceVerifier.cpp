@@ -0,0 +1,186 @@
+#include <Crypto/sha1.h>
+#include <Storage/fileMap.h>
+#include <Storage/pieceVerifier.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <latch>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <numeric>
+#include <string_view>
+#include <unistd.h>
+
+namespace btc {
+
+namespace {
+
+// Largest batch buffer a pool thread keeps for its next batch. Batches of
+// bigger pieces allocate their own, so lanes × pieceLength is not left
+// behind on every thread once verification is over.
+const std::size_t keptBufferSize = 8 << 20;
+
+// Counts a latch down when it goes out of scope.
+struct CountDown {
+  std::latch &latch;
+  ~CountDown() { latch.count_down(); }
+};
+
+// Reads piece `piece` into `out`. Keeps the last opened file in
+// `fd`/`openFile` so consecutive pieces of the same file reuse it.
+bool readPiece(const FileMap &files, const std::filesystem::path &root,
+               std::size_t piece, char *out, int &fd, std::size_t &openFile) {
+  thread_local std::vector<FileSegment> segments;
+  segments.clear();
+  files.map(piece, 0, files.getPieceSize(piece), segments);
+
+  for (const auto &segment : segments) {
+    if (openFile != segment.file) {
+      if (fd >= 0)
+        ::close(fd);
+      fd = ::open(files.getPath(segment.file, root).c_str(),
+                  O_RDONLY | O_CLOEXEC);
+      openFile = segment.file;
+    }
+    if (fd < 0)
+      return false;
+
+    std::size_t done = 0;
+    while (done < segment.length) {
+      ssize_t n = ::pread(fd, out + done, segment.length - done,
+                          static_cast<off_t>(segment.offset + done));
+      if (n <= 0)
+        return false;
+      done += static_cast<std::size_t>(n);
+    }
+    out += segment.length;
+  }
+  return true;
+}
+
+// Hashes the pieces listed in `toHash` (ascending) into `valid`, in batches
+// of up to Sha1::lanes pieces per pool task.
+void hashPieces(const TorrentFile &torrent, const FileMap &files,
+                const std::filesystem::path &root, ThreadPool &pool,
+                const std::vector<std::size_t> &toHash,
+                std::vector<char> &valid,
+                const PieceVerifier::progress_handler &onProgress) {
+  const PieceHashes &hashes = torrent.getPieces();
+  const std::size_t pieceLength = files.getPieceLength();
+
+  std::size_t batches = (toHash.size() + Sha1::lanes - 1) / Sha1::lanes;
+  std::mutex progressMutex;
+  std::size_t done = 0;
+
+  auto hashBatch = [&](std::size_t batch) {
+    std::size_t first = batch * Sha1::lanes;
+    std::size_t count = std::min(Sha1::lanes, toHash.size() - first);
+
+    // Without memory for the batch its pieces stay unverified, as if they
+    // could not be read.
+    try {
+      thread_local std::vector<char> kept;
+      std::unique_ptr<char[]> own;
+      char *buffer;
+      if (count * pieceLength <= keptBufferSize) {
+        kept.resize(count * pieceLength);
+        buffer = kept.data();
+      } else {
+        own = std::make_unique_for_overwrite<char[]>(count * pieceLength);
+        buffer = own.get();
+      }
+
+      int fd = -1;
+      std::size_t openFile = files.getFileCount();
+      std::string_view inputs[Sha1::lanes];
+      bool readable[Sha1::lanes];
+      for (std::size_t i = 0; i < count; i++) {
+        std::size_t piece = toHash[first + i];
+        char *out = buffer + i * pieceLength;
+        readable[i] = readPiece(files, root, piece, out, fd, openFile);
+        inputs[i] = std::string_view(out, files.getPieceSize(piece));
+      }
+      if (fd >= 0)
+        ::close(fd);
+
+      Sha1::digest_t digests[Sha1::lanes];
+      Sha1::hashMany({inputs, count}, {digests, count});
+      for (std::size_t i = 0; i < count; i++) {
+        auto expected = hashes.hash(toHash[first + i]);
+        valid[toHash[first + i]] =
+            readable[i] && std::equal(expected.begin(), expected.end(),
+                                      digests[i].begin());
+      }
+    } catch (const std::bad_alloc &) {
+    }
+
+    if (onProgress) {
+      std::lock_guard lock(progressMutex);
+      done += count;
+      onProgress(done, toHash.size());
+    }
+  };
+
+  // A worker of the same pool that waited on the latch could hold up the
+  // batches it waits for, so there the batches run inline.
+  if (pool.isWorkerThread()) {
+    for (std::size_t batch = 0; batch < batches; batch++)
+      hashBatch(batch);
+    return;
+  }
+
+  std::latch remaining(static_cast<std::ptrdiff_t>(batches));
+  for (std::size_t batch = 0; batch < batches; batch++) {
+    pool.submit([&, batch] {
+      // Counted down however the batch ends, so verify() cannot hang.
+      CountDown counted{remaining};
+      hashBatch(batch);
+    });
+  }
+  remaining.wait();
+}
+
+} // namespace
+
+std::vector<bool> PieceVerifier::verify(const TorrentFile &torrent,
+                                        const std::filesystem::path &root,
+                                        ThreadPool &pool,
+                                        progress_handler onProgress) {
+  std::vector<std::size_t> toHash(torrent.getPieces().size());
+  std::iota(toHash.begin(), toHash.end(), 0);
+
+  // Written by one task per element, so plain bytes rather than vector<bool>.
+  std::vector<char> valid(toHash.size(), 0);
+  hashPieces(torrent, FileMap(torrent), root, pool, toHash, valid,
+             onProgress);
+  return std::vector<bool>(valid.begin(), valid.end());
+}
+
+std::vector<bool> PieceVerifier::verify(const TorrentFile &torrent,
+                                        const std::filesystem::path &root,
+                                        ThreadPool &pool,
+                                        const ResumeData &resume,
+                                        progress_handler onProgress) {
+  const FileMap files(torrent);
+  const std::vector<bool> unchanged = resume.unchangedFiles(torrent, root);
+  const std::size_t pieces = files.getPieceCount();
+
+  std::vector<char> valid(pieces, 0);
+  std::vector<std::size_t> toHash;
+  for (std::size_t piece = 0; piece < pieces; piece++) {
+    bool trusted = true;
+    for (std::size_t f = files.getFirstFile(piece);
+         f <= files.getLastFile(piece); f++)
+      trusted = trusted && unchanged[f];
+
+    if (trusted)
+      valid[piece] = resume.getPieces()[piece];
+    else
+      toHash.push_back(piece);
+  }
+
+  hashPieces(torrent, files, root, pool, toHash, valid, onProgress);
+  return std::vector<bool>(valid.begin(), valid.end());
+}
+
+} // namespace btc
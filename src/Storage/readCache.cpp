@@ -0,0 +1,224 @@
+#include <Storage/readCache.h>
+#include <algorithm>
+#include <cstring>
+
+namespace btc {
+
+std::list<ReadCache::Key> &ReadCache::list(Queue queue) {
+  return lists[static_cast<std::size_t>(queue)];
+}
+
+std::size_t &ReadCache::bytes(Queue queue) {
+  return sizes[static_cast<std::size_t>(queue)];
+}
+
+// Makes `node` the most recently used entry of `to`.
+void ReadCache::move(Node &node, Queue to) {
+  Key key = std::move(*node.position);
+  list(node.queue).erase(node.position);
+  bytes(node.queue) -= node.size;
+  node.position = list(to).insert(list(to).begin(), std::move(key));
+  bytes(to) += node.size;
+  node.queue = to;
+}
+
+void ReadCache::remove(std::unordered_map<Key, Node, KeyHash>::iterator it) {
+  const Key &key = it->first;
+  auto &chunks = torrents.find(key.infoHash)->second.chunks;
+  auto piece = chunks.find(key.piece);
+  std::erase(piece->second, key.chunk);
+  if (piece->second.empty())
+    chunks.erase(piece);
+
+  list(it->second.queue).erase(it->second.position);
+  bytes(it->second.queue) -= it->second.size;
+  nodes.erase(it);
+}
+
+ReadCache::Torrent &ReadCache::torrent(const std::string &infoHash) {
+  auto [it, added] = torrents.try_emplace(infoHash);
+  if (added)
+    it->second.generation = ++generations;
+  return it->second;
+}
+
+// Evicts the least recently used window of the recent list while it is over
+// its target, of the frequent list otherwise; the key moves to a ghost list.
+void ReadCache::replace(bool frequentGhostHit) {
+  std::size_t recentBytes = bytes(Queue::recent);
+  bool fromRecent = !list(Queue::recent).empty() &&
+                    (recentBytes > target ||
+                     (frequentGhostHit && recentBytes == target) ||
+                     list(Queue::frequent).empty());
+  Queue from = fromRecent ? Queue::recent : Queue::frequent;
+
+  Node &node = nodes.find(list(from).back())->second;
+  node.data.reset();
+  move(node, fromRecent ? Queue::recentGhost : Queue::frequentGhost);
+  stats.evictions++;
+}
+
+void ReadCache::insert(const Key &key, std::unique_ptr<char[]> data,
+                       std::size_t size, std::size_t next) {
+  if (size > budget)
+    return;
+  auto resident = [&] {
+    return bytes(Queue::recent) + bytes(Queue::frequent);
+  };
+
+  auto it = nodes.find(key);
+  if (it != nodes.end() && it->second.data)
+    return; // loaded meanwhile by another thread
+
+  if (it != nodes.end()) {
+    // Evicted too early: grow the list it was evicted from.
+    bool frequentGhost = it->second.queue == Queue::frequentGhost;
+    std::size_t hit = bytes(it->second.queue);
+    std::size_t other = bytes(frequentGhost ? Queue::recentGhost
+                                            : Queue::frequentGhost);
+    std::size_t delta =
+        size * std::max<std::size_t>(1, other / std::max<std::size_t>(hit, 1));
+    if (frequentGhost)
+      target = target > delta ? target - delta : 0;
+    else
+      target = std::min(budget, target + delta);
+
+    while (resident() + size > budget)
+      replace(frequentGhost);
+    Node &node = it->second;
+    bytes(node.queue) -= node.size;
+    node.size = size;
+    bytes(node.queue) += size;
+    node.data = std::move(data);
+    node.next = next;
+    move(node, Queue::frequent);
+    return;
+  }
+
+  // A new key: keep the ghost lists within the budget, then make room.
+  while (!list(Queue::recentGhost).empty() &&
+         bytes(Queue::recent) + bytes(Queue::recentGhost) + size > budget)
+    remove(nodes.find(list(Queue::recentGhost).back()));
+  while (!list(Queue::frequentGhost).empty() &&
+         resident() + bytes(Queue::recentGhost) +
+                 bytes(Queue::frequentGhost) + size >
+             2 * budget)
+    remove(nodes.find(list(Queue::frequentGhost).back()));
+  while (resident() + size > budget)
+    replace(false);
+
+  list(Queue::recent).push_front(key);
+  bytes(Queue::recent) += size;
+  nodes.emplace(key, Node{Queue::recent, list(Queue::recent).begin(), size,
+                          std::move(data), next});
+  torrents.find(key.infoHash)->second.chunks[key.piece].push_back(key.chunk);
+}
+
+ReadCache::exp_void ReadCache::read(std::string_view infoHash,
+                                    DiskStorage &storage, std::size_t piece,
+                                    std::size_t offset, std::span<char> out) {
+  if (!storage.isInRange(piece, offset, out.size()))
+    return std::unexpected(error_code::invalidBlockRangeErr);
+
+  const FileMap &files = storage.getFileMap();
+  Key key{std::string(infoHash), piece, 0};
+  while (!out.empty()) {
+    std::size_t pieceSize = files.getPieceSize(key.piece);
+    if (offset >= pieceSize) {
+      offset -= pieceSize;
+      key.piece++;
+      continue;
+    }
+
+    std::size_t chunkSize = window > 0 ? std::min(window, pieceSize)
+                                       : pieceSize;
+    key.chunk = offset / chunkSize;
+    std::size_t chunkStart = key.chunk * chunkSize;
+    std::size_t chunkLength = std::min(chunkSize, pieceSize - chunkStart);
+    std::size_t count = std::min(out.size(), chunkStart + chunkLength - offset);
+
+    bool hit = false;
+    std::uint64_t generation = 0;
+    {
+      std::lock_guard lock(mutex);
+      auto it = nodes.find(key);
+      if (it != nodes.end() && it->second.data) {
+        Node &node = it->second;
+        std::memcpy(out.data(), node.data.get() + offset - chunkStart, count);
+        // A peer walking forward through the window is still the read that
+        // loaded it; only going back to earlier data counts as reuse.
+        bool reused = offset - chunkStart < node.next;
+        move(node, reused ? Queue::frequent : node.queue);
+        node.next = offset + count - chunkStart;
+        stats.hits++;
+        hit = true;
+      } else {
+        stats.misses++;
+        generation = torrent(key.infoHash).generation;
+      }
+    }
+
+    if (!hit) {
+      auto data = std::make_unique_for_overwrite<char[]>(chunkLength);
+      auto readRes = storage.read(key.piece, chunkStart,
+                                  std::span<char>(data.get(), chunkLength));
+      if (!readRes)
+        return readRes;
+      std::memcpy(out.data(), data.get() + offset - chunkStart, count);
+
+      std::lock_guard lock(mutex);
+      auto it = torrents.find(key.infoHash);
+      if (it != torrents.end() && it->second.generation == generation)
+        insert(key, std::move(data), chunkLength,
+               offset + count - chunkStart);
+    }
+
+    out = out.subspan(count);
+    offset += count;
+  }
+  return {};
+}
+
+void ReadCache::removePiece(const std::string &infoHash, Torrent &torrent,
+                            std::size_t piece) {
+  auto it = torrent.chunks.find(piece);
+  if (it == torrent.chunks.end())
+    return;
+  // remove() edits the list, and drops it with its last chunk.
+  std::vector<std::size_t> chunks = it->second;
+  for (std::size_t chunk : chunks)
+    remove(nodes.find(Key{infoHash, piece, chunk}));
+}
+
+void ReadCache::invalidate(std::string_view infoHash, std::size_t piece) {
+  std::lock_guard lock(mutex);
+  auto it = torrents.find(std::string(infoHash));
+  if (it == torrents.end())
+    return;
+  it->second.generation = ++generations;
+  removePiece(it->first, it->second, piece);
+}
+
+void ReadCache::erase(std::string_view infoHash) {
+  std::lock_guard lock(mutex);
+  auto it = torrents.find(std::string(infoHash));
+  if (it == torrents.end())
+    return;
+  while (!it->second.chunks.empty())
+    removePiece(it->first, it->second, it->second.chunks.begin()->first);
+  // A read still in flight finds no torrent and does not insert.
+  torrents.erase(it);
+}
+
+ReadCache::Stats ReadCache::getStats() const {
+  std::lock_guard lock(mutex);
+  return stats;
+}
+
+std::size_t ReadCache::getMemoryUsage() const {
+  std::lock_guard lock(mutex);
+  return sizes[static_cast<std::size_t>(Queue::recent)] +
+         sizes[static_cast<std::size_t>(Queue::frequent)];
+}
+
+} // namespace btc
@@ -0,0 +1,205 @@
+#include <Bencode/bencodeDecoder.h>
+#include <Bencode/bencodeEncoder.h>
+#include <Bencode/bencodeValue.h>
+#include <Storage/fileMap.h>
+#include <Storage/mappedFile.h>
+#include <Storage/resumeData.h>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace btc {
+
+ResumeData ResumeData::capture(const TorrentFile &torrent,
+                               const std::filesystem::path &root,
+                               std::vector<bool> pieces) {
+  ResumeData data;
+  data.infoHash = torrent.getInfoHash();
+  data.pieces = std::move(pieces);
+  for (const auto &path : filePaths(torrent, root))
+    data.files.push_back(stamp(path));
+  return data;
+}
+
+std::string ResumeData::encode() const {
+  std::string bitfield((pieces.size() + 7) / 8, '\0');
+  for (std::size_t i = 0; i < pieces.size(); i++) {
+    if (pieces[i])
+      bitfield[i / 8] |= static_cast<char>(0x80 >> (i % 8));
+  }
+
+  BNode::list_t fileList;
+  for (const auto &file : files) {
+    BNode::dict_t entry;
+    entry["mtime"] = BNode(file.mtime);
+    entry["size"] = BNode(file.size);
+    fileList.emplace_back(std::move(entry));
+  }
+
+  BNode::dict_t root;
+  root["files"] = BNode(std::move(fileList));
+  root["info-hash"] = BNode(infoHash);
+  root["piece-count"] = BNode(static_cast<BNode::int_t>(pieces.size()));
+  root["pieces"] = BNode(std::move(bitfield));
+  root["version"] = BNode(version);
+  return BencodeEncoder::encode(BNode(std::move(root)));
+}
+
+ResumeData::exp_resume ResumeData::decode(std::string_view input) {
+  auto documentRes = BencodeDecoder::decodeView(input);
+  if (!documentRes || !documentRes->getRoot().isDict())
+    return std::unexpected(error_code::invalidResumeDataErr);
+  const BView &root = documentRes->getRoot();
+
+  auto infoHashRes = root.dictFindString("info-hash");
+  auto countRes = root.dictFindInt("piece-count");
+  auto piecesRes = root.dictFindString("pieces");
+  auto filesRes = root.dictFindList("files");
+  if (root.dictFindInt("version", 0) != version || !infoHashRes ||
+      !countRes || !piecesRes || !filesRes)
+    return std::unexpected(error_code::invalidResumeDataErr);
+
+  std::string_view bitfield = piecesRes->getStr();
+  BNode::int_t count = countRes->getInt();
+  if (count < 0 ||
+      bitfield.size() != (static_cast<std::size_t>(count) + 7) / 8)
+    return std::unexpected(error_code::invalidResumeDataErr);
+
+  ResumeData data;
+  data.infoHash = infoHashRes->getStr();
+  data.pieces.resize(static_cast<std::size_t>(count));
+  for (std::size_t i = 0; i < data.pieces.size(); i++)
+    data.pieces[i] = (bitfield[i / 8] & (0x80 >> (i % 8))) != 0;
+
+  for (const auto &entry : filesRes->getList()) {
+    auto sizeRes = entry.dictFindInt("size");
+    auto mtimeRes = entry.dictFindInt("mtime");
+    if (!sizeRes || !mtimeRes)
+      return std::unexpected(error_code::invalidResumeDataErr);
+    data.files.push_back({sizeRes->getInt(), mtimeRes->getInt()});
+  }
+  return data;
+}
+
+std::filesystem::path ResumeData::pathFor(const std::filesystem::path &dir,
+                                          std::string_view infoHash) {
+  static const char digits[] = "0123456789abcdef";
+  std::string name;
+  for (unsigned char c : infoHash) {
+    name.push_back(digits[c >> 4]);
+    name.push_back(digits[c & 0xF]);
+  }
+  return dir / (name + ".resume");
+}
+
+ResumeData::exp_resume ResumeData::load(const std::filesystem::path &dir,
+                                        std::string_view infoHash) {
+  auto fileRes = MappedFile::open(pathFor(dir, infoHash));
+  if (!fileRes)
+    return std::unexpected(fileRes.error());
+
+  auto dataRes = decode(fileRes->getData());
+  if (dataRes && dataRes->infoHash != infoHash)
+    return std::unexpected(error_code::invalidResumeDataErr);
+  return dataRes;
+}
+
+namespace {
+
+bool writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+bool syncDirectory(const std::filesystem::path &dir) {
+  int fd = ::open(dir.empty() ? "." : dir.c_str(),
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
+} // namespace
+
+// Written and synced to a temporary file first, then renamed over the old
+// one and the directory synced, so after a crash the resume file is either
+// the old one or the new one, never truncated. The temporary file is
+// removed on failure.
+ResumeData::exp_void ResumeData::save(const std::filesystem::path &dir) const {
+  std::filesystem::path path = pathFor(dir, infoHash);
+  std::filesystem::path temp = path;
+  temp += ".tmp";
+
+  std::string content = encode();
+  int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+  if (fd < 0)
+    return std::unexpected(error_code::errorWritingFileErr);
+  bool written = writeAll(fd, content) && ::fsync(fd) == 0;
+  written = ::close(fd) == 0 && written;
+
+  std::error_code ec;
+  if (written)
+    std::filesystem::rename(temp, path, ec);
+  if (!written || ec) {
+    std::filesystem::remove(temp, ec);
+    return std::unexpected(error_code::errorWritingFileErr);
+  }
+  if (!syncDirectory(path.parent_path()))
+    return std::unexpected(error_code::errorWritingFileErr);
+  return {};
+}
+
+std::vector<bool>
+ResumeData::unchangedFiles(const TorrentFile &torrent,
+                           const std::filesystem::path &root) const {
+  std::vector<std::filesystem::path> paths = filePaths(torrent, root);
+  std::vector<bool> unchanged(paths.size(), false);
+  if (infoHash != torrent.getInfoHash() || files.size() != paths.size() ||
+      pieces.size() != torrent.getPieces().size())
+    return unchanged;
+
+  for (std::size_t i = 0; i < paths.size(); i++) {
+    FileStamp current = stamp(paths[i]);
+    unchanged[i] =
+        current.size == files[i].size && current.mtime == files[i].mtime;
+  }
+  return unchanged;
+}
+
+std::vector<std::filesystem::path>
+ResumeData::filePaths(const TorrentFile &torrent,
+                      const std::filesystem::path &root) {
+  FileMap files(torrent);
+  std::vector<std::filesystem::path> paths;
+  paths.reserve(files.getFileCount());
+  for (std::size_t i = 0; i < files.getFileCount(); i++)
+    paths.push_back(files.getPath(i, root));
+  return paths;
+}
+
+FileStamp ResumeData::stamp(const std::filesystem::path &path) {
+  std::error_code ec;
+  auto size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return {-1, 0};
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return {-1, 0};
+
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      mtime.time_since_epoch());
+  return {static_cast<std::int64_t>(size), ns.count()};
+}
+
+} // namespace btc
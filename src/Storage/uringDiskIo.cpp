@@ -0,0 +1,495 @@
+#include <Storage/uringDiskIo.h>
+
+#if __has_include(<linux/io_uring.h>)
+#define BTC_HAS_IO_URING 1
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace btc {
+
+#ifdef BTC_HAS_IO_URING
+
+namespace {
+
+int uringSetup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+               unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                    minComplete, flags, nullptr, 0));
+}
+
+int uringRegister(int fd, unsigned opcode, const void *arg, unsigned count) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+unsigned loadAcquire(unsigned *p) {
+  return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+}
+
+void storeRelease(unsigned *p, unsigned v) {
+  std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release);
+}
+
+// io_uring_enter errors that go away once completions are reaped or after a
+// short wait; anything else means the ring itself is unusable.
+bool isTransient(int error) {
+  return error == EAGAIN || error == EBUSY || error == EINTR;
+}
+
+// Whether the kernel supports every opcode this backend issues. Probing
+// arrived in 5.6 together with IORING_OP_READ and IORING_OP_WRITE, so a
+// kernel that cannot probe cannot run them either.
+bool supportsOpcodes(int fd) {
+  const unsigned count = 256;
+  std::vector<char> buffer(sizeof(io_uring_probe) +
+                           count * sizeof(io_uring_probe_op));
+  auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+  if (uringRegister(fd, IORING_REGISTER_PROBE, probe, count) < 0)
+    return false;
+  for (unsigned op : {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED,
+                      IORING_OP_WRITE_FIXED}) {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// The submission and completion queues shared with the kernel.
+struct UringDiskIo::Ring {
+  int fd = -1;
+
+  void *sqMap = MAP_FAILED;
+  std::size_t sqMapSize = 0;
+  void *cqMap = MAP_FAILED;
+  std::size_t cqMapSize = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  std::size_t sqesSize = 0;
+
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned sqEntries;
+  unsigned *cqHead, *cqTail, *cqMask;
+  io_uring_cqe *cqes;
+  unsigned cqEntries;
+
+  bool setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = uringSetup(entries, &params);
+    if (fd < 0)
+      return false;
+
+    sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMapSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+    sqMap = ::mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqMap == MAP_FAILED)
+      return false;
+    if (single) {
+      cqMap = sqMap;
+    } else {
+      cqMap = ::mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cqMap == MAP_FAILED)
+        return false;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(
+        ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+      return false;
+
+    auto *sq = static_cast<char *>(sqMap);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+
+    auto *cq = static_cast<char *>(cqMap);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    cqEntries = params.cq_entries;
+    return true;
+  }
+
+  // Only this thread moves the SQ tail, so it can be read plainly.
+  io_uring_sqe *nextSqe() {
+    unsigned tail = *sqTail;
+    if (tail - loadAcquire(sqHead) >= sqEntries)
+      return nullptr;
+    unsigned index = tail & *sqMask;
+    sqArray[index] = index;
+    std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+    return &sqes[index];
+  }
+
+  void pushSqe() { storeRelease(sqTail, *sqTail + 1); }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED)
+      ::munmap(sqes, sqesSize);
+    if (cqMap != MAP_FAILED && cqMap != sqMap)
+      ::munmap(cqMap, cqMapSize);
+    if (sqMap != MAP_FAILED)
+      ::munmap(sqMap, sqMapSize);
+    if (fd >= 0)
+      ::close(fd);
+  }
+};
+
+UringDiskIo::UringDiskIo(net::io_context &ctx, DiskStorage &storage)
+    : ctx(ctx), storage(storage), ring(std::make_unique<Ring>()),
+      event(ctx), retry(ctx) {}
+
+UringDiskIo::exp_uring UringDiskIo::create(net::io_context &ctx,
+                                           DiskStorage &storage,
+                                           unsigned entries) {
+  std::unique_ptr<UringDiskIo> io(new UringDiskIo(ctx, storage));
+  if (!io->ring->setup(entries) || !supportsOpcodes(io->ring->fd))
+    return std::unexpected(error_code::ioUringUnavailableErr);
+
+  int eventFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (eventFd < 0)
+    return std::unexpected(error_code::ioUringUnavailableErr);
+  io->event.assign(eventFd);
+  if (uringRegister(io->ring->fd, IORING_REGISTER_EVENTFD, &eventFd, 1) < 0)
+    return std::unexpected(error_code::ioUringUnavailableErr);
+
+  // Registered files save the kernel a descriptor lookup per request; it
+  // is only an optimisation, so failing to register is not an error.
+  const FileMap &files = storage.getFileMap();
+  if (files.getFileCount() <= maxRegisteredFiles) {
+    std::vector<int> fds;
+    for (std::size_t i = 0; i < files.getFileCount(); i++) {
+      auto handleRes = storage.handle(i);
+      if (!handleRes)
+        break;
+      io->registeredFiles.push_back(*handleRes);
+      fds.push_back((*handleRes)->fd);
+    }
+    if (fds.size() != files.getFileCount() ||
+        uringRegister(io->ring->fd, IORING_REGISTER_FILES, fds.data(),
+                      static_cast<unsigned>(fds.size())) < 0)
+      io->registeredFiles.clear();
+  }
+  return io;
+}
+
+UringDiskIo::~UringDiskIo() {
+  // The kernel may still be writing into caller buffers: wait for every
+  // submitted operation before tearing the ring down. Their handlers are
+  // dropped, as are those of requests never submitted.
+  auto release = [](Operation *op) {
+    if (--op->request->pending == 0)
+      delete op->request;
+    delete op;
+  };
+
+  while (inFlight > 0) {
+    unsigned waitFor = inFlight > unsubmitted ? 1 : 0;
+    int submitted =
+        uringEnter(ring->fd, static_cast<unsigned>(unsubmitted), waitFor,
+                   waitFor ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted < 0 && !isTransient(errno)) {
+      for (Operation *op : takeUnsubmitted())
+        release(op);
+      // What the kernel already took can no longer be waited for, so the
+      // ring is left mapped rather than pulled out from under it.
+      if (inFlight > 0)
+        (void)ring.release();
+      break;
+    }
+    if (submitted > 0)
+      unsubmitted -= static_cast<std::size_t>(submitted);
+
+    unsigned head = *ring->cqHead;
+    unsigned tail = loadAcquire(ring->cqTail);
+    for (; head != tail; head++, inFlight--)
+      release(reinterpret_cast<Operation *>(
+          ring->cqes[head & *ring->cqMask].user_data));
+    storeRelease(ring->cqHead, head);
+  }
+  for (Operation *op : backlog)
+    release(op);
+}
+
+bool UringDiskIo::registerBuffers(std::span<const std::span<char>> buffers) {
+  if (!registeredBuffers.empty())
+    return false;
+
+  std::vector<iovec> iovecs;
+  for (auto buffer : buffers)
+    iovecs.push_back({buffer.data(), buffer.size()});
+  if (uringRegister(ring->fd, IORING_REGISTER_BUFFERS, iovecs.data(),
+                    static_cast<unsigned>(iovecs.size())) < 0)
+    return false;
+  registeredBuffers.assign(buffers.begin(), buffers.end());
+  return true;
+}
+
+void UringDiskIo::asyncRead(std::size_t piece, std::size_t offset,
+                            std::span<char> out, completion_handler onDone) {
+  enqueue(piece, offset, out, false, std::move(onDone));
+}
+
+void UringDiskIo::asyncWrite(std::size_t piece, std::size_t offset,
+                             std::span<const char> data,
+                             completion_handler onDone) {
+  std::span<char> buffer(const_cast<char *>(data.data()), data.size());
+  enqueue(piece, offset, buffer, true, std::move(onDone));
+}
+
+void UringDiskIo::enqueue(std::size_t piece, std::size_t offset,
+                          std::span<char> buffer, bool writing,
+                          completion_handler onDone) {
+  if (!storage.isInRange(piece, offset, buffer.size())) {
+    net::post(ctx, [onDone = std::move(onDone)] {
+      onDone(std::unexpected(error_code::invalidBlockRangeErr));
+    });
+    return;
+  }
+
+  thread_local std::vector<FileSegment> segments;
+  segments.clear();
+  storage.getFileMap().map(piece, offset, buffer.size(), segments);
+
+  auto *request = new Request{std::move(onDone), {}, segments.size()};
+  if (segments.empty()) {
+    net::post(ctx, [request] {
+      request->onDone({});
+      delete request;
+    });
+    return;
+  }
+
+  char *data = buffer.data();
+  for (const auto &segment : segments) {
+    DiskStorage::handle_ptr handle;
+    if (registeredFiles.empty()) {
+      auto handleRes = storage.handle(segment.file);
+      if (handleRes)
+        handle = std::move(*handleRes);
+    }
+    backlog.push_back(new Operation{request, std::move(handle), segment.file,
+                                    segment.offset, data, segment.length,
+                                    writing});
+    data += segment.length;
+  }
+}
+
+void UringDiskIo::submit() {
+  fill();
+  if (unsubmitted > 0) {
+    int submitted =
+        uringEnter(ring->fd, static_cast<unsigned>(unsubmitted), 0, 0);
+    if (submitted > 0) {
+      unsubmitted -= static_cast<std::size_t>(submitted);
+    } else if (submitted < 0 && !isTransient(errno)) {
+      fail(errno);
+      return;
+    } else if (inFlight == unsubmitted && !retrying) {
+      // Nothing the kernel holds will complete and wake us, so try again
+      // shortly.
+      retrying = true;
+      retry.expires_after(std::chrono::milliseconds(1));
+      retry.async_wait([this](const sys::error_code &ec) {
+        if (ec == net::error::operation_aborted)
+          return;
+        retrying = false;
+        submit();
+      });
+    }
+  }
+  if (inFlight > unsubmitted)
+    wait();
+}
+
+// Takes back the SQEs the kernel has not consumed yet. Only this thread
+// moves the SQ tail, and without SQPOLL the kernel consumes only inside
+// io_uring_enter, so they are exactly the last `unsubmitted` entries.
+std::vector<UringDiskIo::Operation *> UringDiskIo::takeUnsubmitted() {
+  std::vector<Operation *> ops;
+  unsigned tail = *ring->sqTail;
+  for (; unsubmitted > 0; unsubmitted--, inFlight--) {
+    tail--;
+    ops.push_back(reinterpret_cast<Operation *>(
+        ring->sqes[tail & *ring->sqMask].user_data));
+  }
+  storeRelease(ring->sqTail, tail);
+  return ops;
+}
+
+// The ring refused work for good: every operation not yet with the kernel
+// fails with the error.
+void UringDiskIo::fail(int error) {
+  std::vector<Operation *> ops = takeUnsubmitted();
+  ops.insert(ops.end(), backlog.begin(), backlog.end());
+  backlog.clear();
+  for (Operation *op : ops)
+    complete(op, -error);
+  if (inFlight > 0)
+    wait();
+}
+
+// Moves queued operations into free SQEs. In-flight operations are capped at
+// the CQ size so completions can never overflow.
+void UringDiskIo::fill() {
+  while (!backlog.empty() && inFlight < ring->cqEntries) {
+    Operation *op = backlog.front();
+
+    // A file that could not be opened fails its operation right away.
+    if (registeredFiles.empty() && !op->handle) {
+      backlog.pop_front();
+      complete(op, -EBADF);
+      continue;
+    }
+
+    io_uring_sqe *sqe = ring->nextSqe();
+    if (!sqe)
+      break;
+    backlog.pop_front();
+
+    sqe->opcode = op->writing ? IORING_OP_WRITE : IORING_OP_READ;
+    for (std::size_t i = 0; i < registeredBuffers.size(); i++) {
+      auto buffer = registeredBuffers[i];
+      if (op->data >= buffer.data() &&
+          op->data + op->length <= buffer.data() + buffer.size()) {
+        sqe->opcode =
+            op->writing ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = static_cast<std::uint16_t>(i);
+        break;
+      }
+    }
+
+    if (registeredFiles.empty()) {
+      sqe->fd = op->handle->fd;
+    } else {
+      sqe->fd = static_cast<std::int32_t>(op->file);
+      sqe->flags |= IOSQE_FIXED_FILE;
+    }
+    sqe->off = op->offset;
+    sqe->addr = reinterpret_cast<std::uint64_t>(op->data);
+    sqe->len = static_cast<std::uint32_t>(op->length);
+    sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+    ring->pushSqe();
+
+    inFlight++;
+    unsubmitted++;
+  }
+}
+
+void UringDiskIo::wait() {
+  if (waiting)
+    return;
+  waiting = true;
+  event.async_wait(net::posix::stream_descriptor::wait_read,
+                   [this](const sys::error_code &ec) {
+                     if (ec == net::error::operation_aborted)
+                       return;
+                     waiting = false;
+                     std::uint64_t count;
+                     while (::read(event.native_handle(), &count,
+                                   sizeof(count)) > 0) {
+                     }
+                     reap();
+                     submit();
+                   });
+}
+
+void UringDiskIo::reap() {
+  unsigned head = *ring->cqHead;
+  unsigned tail = loadAcquire(ring->cqTail);
+  thread_local std::vector<io_uring_cqe> done;
+  done.clear();
+  for (; head != tail; head++)
+    done.push_back(ring->cqes[head & *ring->cqMask]);
+  storeRelease(ring->cqHead, head);
+
+  // Handlers may queue and submit new requests, so they run only after the
+  // completion queue has been released.
+  inFlight -= done.size();
+  for (const auto &cqe : done)
+    complete(reinterpret_cast<Operation *>(cqe.user_data), cqe.res);
+}
+
+void UringDiskIo::complete(Operation *op, std::int32_t res) {
+  Request *request = op->request;
+  if (res < 0 || (res == 0 && op->length > 0)) {
+    request->error = op->writing ? error_code::errorWritingFileErr
+                                 : error_code::errorReadingFileErr;
+  } else if (static_cast<std::size_t>(res) < op->length) {
+    op->offset += static_cast<std::size_t>(res);
+    op->data += res;
+    op->length -= static_cast<std::size_t>(res);
+    backlog.push_back(op);
+    return;
+  }
+
+  delete op;
+  if (--request->pending > 0)
+    return;
+  if (request->error)
+    request->onDone(std::unexpected(request->error));
+  else
+    request->onDone({});
+  delete request;
+}
+
+#else
+
+struct UringDiskIo::Ring {};
+
+UringDiskIo::UringDiskIo(net::io_context &ctx, DiskStorage &storage)
+    : ctx(ctx), storage(storage), event(ctx), retry(ctx) {}
+
+UringDiskIo::exp_uring UringDiskIo::create(net::io_context &, DiskStorage &,
+                                           unsigned) {
+  return std::unexpected(error_code::ioUringUnavailableErr);
+}
+
+UringDiskIo::~UringDiskIo() {}
+bool UringDiskIo::registerBuffers(std::span<const std::span<char>>) {
+  return false;
+}
+void UringDiskIo::asyncRead(std::size_t, std::size_t, std::span<char>,
+                            completion_handler onDone) {
+  net::post(ctx, [onDone = std::move(onDone)] {
+    onDone(std::unexpected(error_code::ioUringUnavailableErr));
+  });
+}
+void UringDiskIo::asyncWrite(std::size_t, std::size_t, std::span<const char>,
+                             completion_handler onDone) {
+  net::post(ctx, [onDone = std::move(onDone)] {
+    onDone(std::unexpected(error_code::ioUringUnavailableErr));
+  });
+}
+void UringDiskIo::submit() {}
+
+#endif
+
+} // namespace btc
@@ -0,0 +1,171 @@
+#include <Crypto/sha1.h>
+#include <Storage/writeCache.h>
+#include <algorithm>
+#include <cstring>
+
+namespace btc {
+
+WriteCache::~WriteCache() { (void)flushAll(); }
+
+std::size_t WriteCache::getBlockCount(std::size_t piece) const {
+  std::size_t size = storage.getFileMap().getPieceSize(piece);
+  return (size + blockSize - 1) / blockSize;
+}
+
+WriteCache::exp_status WriteCache::write(std::size_t piece,
+                                         std::size_t offset,
+                                         std::string_view data) {
+  const FileMap &files = storage.getFileMap();
+  // A block must lie within its own piece.
+  if (piece >= files.getPieceCount() || offset % blockSize != 0 ||
+      offset >= files.getPieceSize(piece) ||
+      data.size() != std::min(blockSize, files.getPieceSize(piece) - offset))
+    return std::unexpected(error_code::invalidBlockRangeErr);
+
+  auto it = entries.find(piece);
+  if (it == entries.end()) {
+    std::size_t size = files.getPieceSize(piece);
+    auto roomRes = makeRoom(size);
+    if (!roomRes)
+      return std::unexpected(roomRes.error());
+
+    Entry entry;
+    entry.data = std::make_unique_for_overwrite<char[]>(size);
+    entry.size = size;
+    entry.received.assign(getBlockCount(piece), false);
+    if (auto s = spilled.find(piece); s != spilled.end()) {
+      entry.onDisk = std::move(s->second);
+      spilled.erase(s);
+      entry.received = entry.onDisk;
+    } else {
+      entry.onDisk.assign(entry.received.size(), false);
+    }
+    entry.missing = static_cast<std::size_t>(
+        std::count(entry.received.begin(), entry.received.end(), false));
+    entry.position = lru.insert(lru.begin(), piece);
+    usage += size;
+    it = entries.emplace(piece, std::move(entry)).first;
+  } else {
+    lru.splice(lru.begin(), lru, it->second.position);
+  }
+
+  Entry &entry = it->second;
+  if (entry.verified)
+    return BlockStatus::stored;
+
+  std::size_t block = offset / blockSize;
+  std::memcpy(entry.data.get() + offset, data.data(), data.size());
+  entry.onDisk[block] = false;
+  if (!entry.received[block]) {
+    entry.received[block] = true;
+    entry.missing--;
+  }
+  if (entry.missing > 0)
+    return BlockStatus::stored;
+  return complete(piece, entry);
+}
+
+// Reads back any spilled blocks, then checks the piece against its hash.
+WriteCache::exp_status WriteCache::complete(std::size_t piece, Entry &entry) {
+  for (std::size_t block = 0; block < entry.onDisk.size(); block++) {
+    if (!entry.onDisk[block])
+      continue;
+    std::size_t offset = block * blockSize;
+    std::size_t length = std::min(blockSize, entry.size - offset);
+    auto readRes = storage.read(
+        piece, offset, std::span<char>(entry.data.get() + offset, length));
+    if (!readRes)
+      return std::unexpected(readRes.error());
+  }
+
+  auto digest = Sha1::hash(std::string_view(entry.data.get(), entry.size));
+  auto expected = hashes.hash(piece);
+  if (!std::equal(expected.begin(), expected.end(), digest.begin())) {
+    usage -= entry.size;
+    lru.erase(entry.position);
+    entries.erase(piece);
+    return BlockStatus::pieceFailed;
+  }
+
+  std::fill(entry.onDisk.begin(), entry.onDisk.end(), false);
+  entry.verified = true;
+  return BlockStatus::pieceVerified;
+}
+
+bool WriteCache::read(std::size_t piece, std::size_t offset,
+                      std::span<char> out) const {
+  auto it = entries.find(piece);
+  if (it == entries.end() || !it->second.verified ||
+      offset + out.size() > it->second.size)
+    return false;
+  std::memcpy(out.data(), it->second.data.get() + offset, out.size());
+  return true;
+}
+
+// Each run of consecutive blocks that is in memory but not yet on disk goes
+// out as one write; a verified piece is a single run.
+WriteCache::exp_void WriteCache::writeBlocks(std::size_t piece,
+                                             const Entry &entry) {
+  std::size_t blocks = entry.received.size();
+  for (std::size_t first = 0; first < blocks;) {
+    if (!entry.received[first] || entry.onDisk[first]) {
+      first++;
+      continue;
+    }
+    std::size_t last = first;
+    while (last < blocks && entry.received[last] && !entry.onDisk[last])
+      last++;
+
+    std::size_t offset = first * blockSize;
+    std::size_t length = std::min(last * blockSize, entry.size) - offset;
+    auto writeRes = storage.write(
+        piece, offset, std::string_view(entry.data.get() + offset, length));
+    if (!writeRes)
+      return writeRes;
+    first = last;
+  }
+  return {};
+}
+
+WriteCache::exp_void WriteCache::evict(std::size_t piece) {
+  auto it = entries.find(piece);
+  Entry &entry = it->second;
+  auto writeRes = writeBlocks(piece, entry);
+  if (!writeRes)
+    return writeRes;
+
+  if (!entry.verified)
+    spilled[piece] = std::move(entry.received);
+  usage -= entry.size;
+  lru.erase(entry.position);
+  entries.erase(it);
+  return {};
+}
+
+// A single piece larger than the whole budget is still admitted once the
+// cache is empty.
+WriteCache::exp_void WriteCache::makeRoom(std::size_t size) {
+  while (!lru.empty() && usage + size > budget) {
+    auto evictRes = evict(lru.back());
+    if (!evictRes)
+      return evictRes;
+  }
+  return {};
+}
+
+WriteCache::exp_void WriteCache::flush(std::size_t piece) {
+  if (!entries.contains(piece))
+    return {};
+  return evict(piece);
+}
+
+WriteCache::exp_void WriteCache::flushAll() {
+  while (!lru.empty()) {
+    auto evictRes = evict(lru.back());
+    if (!evictRes)
+      return evictRes;
+  }
+  return {};
+}
+
+} // namespace btc
@@ -0,0 +1,22 @@
+#include <Torrent/pieceHashes.h>
+#include <algorithm>
+
+namespace btc {
+
+PieceHashes::exp_hashes PieceHashes::create(std::string_view pieces,
+                                            std::size_t pieceLength,
+                                            std::size_t totalLength) {
+  if (pieces.size() % hashSize != 0)
+    return std::unexpected(error_code::piecesFieldLengthNonDivisibleBy20Err);
+
+  std::size_t count = pieces.size() / hashSize;
+  if (pieceLength == 0 ||
+      count != totalLength / pieceLength + (totalLength % pieceLength != 0))
+    return std::unexpected(error_code::pieceCountMismatchErr);
+
+  auto data = std::make_shared_for_overwrite<unsigned char[]>(pieces.size());
+  std::copy(pieces.begin(), pieces.end(), data.get());
+  return PieceHashes(std::move(data), count);
+}
+
+} // namespace btc
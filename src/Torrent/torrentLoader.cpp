@@ -0,0 +1,71 @@
+#include <Bencode/bencodeDecoder.h>
+#include <Torrent/torrentLoader.h>
+#include <Torrent/torrentParser.h>
+#include <algorithm>
+#include <latch>
+#include <mutex>
+
+namespace btc {
+
+std::vector<LoadedTorrent>
+TorrentLoader::loadFiles(std::span<const std::filesystem::path> paths,
+                         ThreadPool &pool, progress_handler onProgress) {
+  std::vector<LoadedTorrent> results;
+  results.reserve(paths.size());
+  for (const auto &path : paths)
+    results.push_back({path, std::unexpected(std::error_code())});
+
+  std::mutex progressMutex;
+  std::size_t done = 0;
+  auto load = [&](std::size_t i) {
+    results[i].torrent = TorrentParser::parseFile(paths[i], BencodeDecoder());
+    if (onProgress) {
+      std::lock_guard lock(progressMutex);
+      onProgress(++done, paths.size());
+    }
+  };
+
+  if (pool.isWorkerThread()) {
+    for (std::size_t i = 0; i < paths.size(); i++)
+      load(i);
+    return results;
+  }
+
+  // Each task writes only its own slot, so the results need no locking.
+  std::latch remaining(static_cast<std::ptrdiff_t>(paths.size()));
+  for (std::size_t i = 0; i < paths.size(); i++) {
+    pool.submit([&, i] {
+      load(i);
+      remaining.count_down();
+    });
+  }
+  remaining.wait();
+  return results;
+}
+
+TorrentLoader::exp_paths
+TorrentLoader::listDirectory(const std::filesystem::path &dir) {
+  std::error_code ec;
+  std::filesystem::directory_iterator it(dir, ec);
+  if (ec)
+    return std::unexpected(error_code::errorOpeningFileErr);
+
+  std::vector<std::filesystem::path> paths;
+  for (const auto &entry : it) {
+    if (entry.is_regular_file(ec) && entry.path().extension() == ".torrent")
+      paths.push_back(entry.path());
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+TorrentLoader::exp_loaded
+TorrentLoader::loadDirectory(const std::filesystem::path &dir,
+                             ThreadPool &pool, progress_handler onProgress) {
+  auto pathsRes = listDirectory(dir);
+  if (!pathsRes)
+    return std::unexpected(pathsRes.error());
+  return loadFiles(*pathsRes, pool, std::move(onProgress));
+}
+
+} // namespace btc
@@ -1,10 +1,9 @@
-#include "Bencode/bencodeValue.h"
+#include "Bencode/bencodeView.h"
 #include <Bencode/bencodeDecoder.h>
-#include <Bencode/bencodeEncoder.h>
+#include <Storage/mappedFile.h>
 #include <Torrent/torrentParser.h>
+#include <cstdint>
 #include <expected>
-#include <fstream>
-#include <iterator>
 #include <openssl/sha.h>
 #include <optional>
 #include <vector>
@@ -13,49 +12,47 @@ namespace btc {
 
 TorrentParser::exp_torrentfile
 TorrentParser::parseFile(std::filesystem::path path, BencodeDecoder decoder) {
-  std::fstream file(path);
-  if (!file)
-    return std::unexpected(error_code::errorOpeningFileErr);
-
-  std::string content{(std::istreambuf_iterator<char>(file)),
-                      std::istreambuf_iterator<char>()};
+  auto fileRes = MappedFile::open(path);
+  if (!fileRes)
+    return std::unexpected(fileRes.error());
 
+  // Parsing copies everything it keeps out of the mapping, so it can be
+  // released as soon as parseContent returns.
+  std::string_view content = fileRes->getData();
   if (!content.empty() && content.back() == '\n')
-    content.pop_back();
+    content.remove_suffix(1);
 
   return parseContent(content, decoder);
 }
 
 TorrentParser::exp_torrentfile
-TorrentParser::parseContent(std::string content, BencodeDecoder decoder) {
-  auto bencodeRes = decoder.decode(content);
-  if (!bencodeRes)
-    return std::unexpected(bencodeRes.error());
-
-  if (!bencodeRes->isDict())
+TorrentParser::parseContent(std::string_view content,
+                            BencodeDecoder decoder) {
+  auto documentRes = decoder.decodeView(content);
+  if (!documentRes)
+    return std::unexpected(documentRes.error());
+
+  const BView &root = documentRes->getRoot();
+  if (!root.isDict())
     return std::unexpected(error_code::rootStructureNotDictErr);
 
-  auto infoRes = bencodeRes->dictFindDict("info");
+  auto infoRes = root.dictFindDict("info");
   if (!infoRes)
     return std::unexpected(error_code::infoKeyNotDictErr);
 
-  auto announceRes = parseAnnounce(bencodeRes.value());
+  auto announceRes = parseAnnounce(root);
   if (!announceRes)
     return std::unexpected(announceRes.error());
 
-  auto nameRes = parseName(infoRes.value());
+  auto nameRes = parseName(*infoRes);
   if (!nameRes)
     return std::unexpected(nameRes.error());
 
-  auto piecesRes = parsePieces(infoRes.value());
-  if (!piecesRes)
-    return std::unexpected(piecesRes.error());
-
-  auto pieceLengthRes = parsePieceLength(infoRes.value());
+  auto pieceLengthRes = parsePieceLength(*infoRes);
   if (!pieceLengthRes)
     return std::unexpected(pieceLengthRes.error());
 
-  auto fileModeRes = validateFileMode(infoRes.value());
+  auto fileModeRes = validateFileMode(*infoRes);
   if (!fileModeRes)
     return std::unexpected(fileModeRes.error());
 
@@ -64,7 +61,7 @@ TorrentParser::parseContent(std::string content, BencodeDecoder decoder) {
 
   switch (*fileModeRes) {
   case FileMode::single: {
-    auto lengthRes = parseSingle(infoRes.value());
+    auto lengthRes = parseSingle(*infoRes);
     if (!lengthRes)
       return std::unexpected(lengthRes.error());
     length = *lengthRes;
@@ -72,19 +69,28 @@ TorrentParser::parseContent(std::string content, BencodeDecoder decoder) {
   }
 
   case FileMode::multiple: {
-    auto filesRes = parseMultiple(infoRes.value());
+    auto filesRes = parseMultiple(*infoRes);
     if (!filesRes)
       return std::unexpected(filesRes.error());
     files = std::move(*filesRes);
+    for (const auto &item : files) {
+      if (item.length > SIZE_MAX - length)
+        return std::unexpected(error_code::totalLengthOverflowErr);
+      length += item.length;
+    }
     break;
   }
   }
 
-  auto announceListRes = parseAnnounceList(bencodeRes.value());
-  auto commentRes = parseComment(bencodeRes.value());
-  auto createdByRes = parseCreatedBy(bencodeRes.value());
-  auto encodingRes = parseEncoding(bencodeRes.value());
-  auto creationDateRes = parseCreationDate(bencodeRes.value());
+  auto piecesRes = parsePieces(*infoRes, *pieceLengthRes, length);
+  if (!piecesRes)
+    return std::unexpected(piecesRes.error());
+
+  auto announceListRes = parseAnnounceList(root);
+  auto commentRes = parseComment(root);
+  auto createdByRes = parseCreatedBy(root);
+  auto encodingRes = parseEncoding(root);
+  auto creationDateRes = parseCreationDate(root);
 
   TorrentFile file;
   file.announce = *announceRes;
@@ -93,36 +99,37 @@ TorrentParser::parseContent(std::string content, BencodeDecoder decoder) {
   file.createdBy = createdByRes;
   file.encoding = encodingRes;
   file.creationDate = creationDateRes;
-  file.name = *nameRes;
-  file.pieces = *piecesRes;
+  file.name = std::move(*nameRes);
+  file.pieces = std::move(*piecesRes);
   file.pieceLength = *pieceLengthRes;
+  file.totalLength = length;
   file.announceList = announceListRes;
 
   if (*fileModeRes == FileMode::single)
     file.length = length;
   else
-    file.files = files;
+    file.files = std::move(files);
 
+  // Hash the info dictionary exactly as it appears in the file: re-encoding
+  // would change the digest of torrents that are not canonically encoded.
   unsigned char hash[20];
-  BencodeEncoder encoder;
-  std::string infoBencode = encoder.encode(static_cast<BNode>(infoRes.value()));
-
-  SHA1(reinterpret_cast<const unsigned char *>(infoBencode.data()),
-       infoBencode.size(), hash);
+  std::string_view infoRaw = infoRes->getRaw();
+  SHA1(reinterpret_cast<const unsigned char *>(infoRaw.data()), infoRaw.size(),
+       hash);
 
   file.infoHash = std::string(reinterpret_cast<char *>(hash), 20);
 
   return file;
 }
 
-TorrentParser::exp_string TorrentParser::parseAnnounce(BNode root) {
+TorrentParser::exp_string TorrentParser::parseAnnounce(const BView &root) {
   auto announceRes = root.dictFindString("announce");
   if (!announceRes)
     return std::unexpected(error_code::missingAnnounceKeyErr);
-  return announceRes->getStr();
+  return std::string(announceRes->getStr());
 }
 
-TorrentParser::exp_sizet TorrentParser::parsePieceLength(BNode info) {
+TorrentParser::exp_sizet TorrentParser::parsePieceLength(const BView &info) {
   auto pieceLenRes = info.dictFindInt("piece length");
   if (!pieceLenRes)
     return std::unexpected(error_code::missingPieceLengthFieldErr);
@@ -134,21 +141,33 @@ TorrentParser::exp_sizet TorrentParser::parsePieceLength(BNode info) {
   return pieceLenRes->getInt();
 }
 
-TorrentParser::exp_string TorrentParser::parseName(BNode info) {
+// The name and every path component become one component of a path under
+// the download directory, so none may climb out of it or be absolute.
+bool TorrentParser::isSafeComponent(std::string_view component) {
+  return !component.empty() && component != "." && component != ".." &&
+         component.find('/') == std::string_view::npos &&
+         component.find('\0') == std::string_view::npos;
+}
+
+TorrentParser::exp_string TorrentParser::parseName(const BView &info) {
   auto nameRes = info.dictFindString("name");
   if (!nameRes)
     return std::unexpected(error_code::missingNameFieldErr);
-  return nameRes->getStr();
+  if (!isSafeComponent(nameRes->getStr()))
+    return std::unexpected(error_code::unsafeFilePathErr);
+  return std::string(nameRes->getStr());
 }
 
-TorrentParser::exp_string TorrentParser::parsePieces(BNode info) {
+TorrentParser::exp_hashes TorrentParser::parsePieces(const BView &info,
+                                                     std::size_t pieceLength,
+                                                     std::size_t totalLength) {
   auto piecesRes = info.dictFindString("pieces");
   if (!piecesRes)
     return std::unexpected(error_code::missingPiecesFieldErr);
-  return piecesRes->getStr();
+  return PieceHashes::create(piecesRes->getStr(), pieceLength, totalLength);
 }
 
-TorrentParser::exp_filemode TorrentParser::validateFileMode(BNode info) {
+TorrentParser::exp_filemode TorrentParser::validateFileMode(const BView &info) {
   auto filesRes = info.dictFindList("files");
   auto lengthRes = info.dictFindInt("length");
 
@@ -159,7 +178,7 @@ TorrentParser::exp_filemode TorrentParser::validateFileMode(BNode info) {
   return (lengthRes) ? FileMode::single : FileMode::multiple;
 }
 
-TorrentParser::exp_sizet TorrentParser::parseSingle(BNode info) {
+TorrentParser::exp_sizet TorrentParser::parseSingle(const BView &info) {
   auto lengthRes = info.dictFindInt("length");
   if (!lengthRes)
     return std::unexpected(error_code::lengthFieldNotIntErr);
@@ -170,14 +189,17 @@ TorrentParser::exp_sizet TorrentParser::parseSingle(BNode info) {
   return lengthRes->getInt();
 }
 
-TorrentParser::exp_files TorrentParser::parseMultiple(BNode info) {
+TorrentParser::exp_files TorrentParser::parseMultiple(const BView &info) {
   auto filesRes = info.dictFindList("files");
   if (!filesRes)
     return std::unexpected(error_code::filesFieldNotListErr);
+  // A torrent without data is not valid, and FileMap relies on one file.
+  if (filesRes->getList().empty())
+    return std::unexpected(error_code::filesFieldEmptyErr);
 
   std::vector<FileInfo> files;
 
-  for (auto file : filesRes->getList()) {
+  for (const auto &file : filesRes->getList()) {
     if (!file.isDict())
       return std::unexpected(error_code::filesFieldItemNotDictErr);
     auto fileInfoRes = parseFile(file);
@@ -188,7 +210,7 @@ TorrentParser::exp_files TorrentParser::parseMultiple(BNode info) {
   return files;
 }
 
-TorrentParser::exp_fileinfo TorrentParser::parseFile(BNode file) {
+TorrentParser::exp_fileinfo TorrentParser::parseFile(const BView &file) {
   auto fileLenghtRes = parseFileLength(file);
   auto filePathRes = parseFilePath(file);
 
@@ -199,7 +221,7 @@ TorrentParser::exp_fileinfo TorrentParser::parseFile(BNode file) {
   return FileInfo{*fileLenghtRes, *filePathRes};
 }
 
-TorrentParser::exp_sizet TorrentParser::parseFileLength(BNode file) {
+TorrentParser::exp_sizet TorrentParser::parseFileLength(const BView &file) {
   auto lengthRes = file.dictFindInt("length");
   if (!lengthRes)
     return std::unexpected(error_code::missingFileLengthErr);
@@ -210,42 +232,46 @@ TorrentParser::exp_sizet TorrentParser::parseFileLength(BNode file) {
   return lengthRes->getInt();
 }
 
-TorrentParser::exp_string TorrentParser::parseFilePath(BNode file) {
+TorrentParser::exp_path TorrentParser::parseFilePath(const BView &file) {
   auto pathRes = file.dictFindList("path");
   if (!pathRes)
     return std::unexpected(error_code::missingFilePathErr);
 
-  std::string strPath = "";
-  for (auto item : pathRes->getList()) {
+  std::filesystem::path path;
+  for (const auto &item : pathRes->getList()) {
     if (!item.isStr())
       return std::unexpected(error_code::filePathFragmentNotStrErr);
-    strPath.append(item.getStr());
+    if (!isSafeComponent(item.getStr()))
+      return std::unexpected(error_code::unsafeFilePathErr);
+    path /= item.getStr();
   }
-  return strPath;
+  if (path.empty())
+    return std::unexpected(error_code::unsafeFilePathErr);
+  return path;
 }
 
-TorrentParser::opt_string TorrentParser::parseComment(BNode root) {
+TorrentParser::opt_string TorrentParser::parseComment(const BView &root) {
   auto commentRes = root.dictFindString("comment");
   if (!commentRes)
     return std::nullopt;
-  return commentRes->getStr();
+  return std::string(commentRes->getStr());
 }
 
-TorrentParser::opt_string TorrentParser::parseCreatedBy(BNode root) {
+TorrentParser::opt_string TorrentParser::parseCreatedBy(const BView &root) {
   auto createdBy = root.dictFindString("created by");
   if (!createdBy)
     return std::nullopt;
-  return createdBy->getStr();
+  return std::string(createdBy->getStr());
 }
 
-TorrentParser::opt_string TorrentParser::parseEncoding(BNode root) {
+TorrentParser::opt_string TorrentParser::parseEncoding(const BView &root) {
   auto encoding = root.dictFindString("encoding");
   if (!encoding)
     return std::nullopt;
-  return encoding->getStr();
+  return std::string(encoding->getStr());
 }
 
-TorrentParser::opt_date TorrentParser::parseCreationDate(BNode root) {
+TorrentParser::opt_date TorrentParser::parseCreationDate(const BView &root) {
   auto creationDate = root.dictFindInt("creation date");
   if (!creationDate)
     return std::nullopt;
@@ -256,20 +282,21 @@ TorrentParser::opt_date TorrentParser::parseCreationDate(BNode root) {
   return std::chrono::year_month_day{days};
 }
 
-TorrentParser::opt_stringlist TorrentParser::parseAnnounceList(BNode root) {
+TorrentParser::opt_stringlist
+TorrentParser::parseAnnounceList(const BView &root) {
   auto announceListRes = root.dictFindList("announce-list");
   if (!announceListRes)
     return std::nullopt;
 
   std::vector<std::string> trackers;
 
-  for (auto &list : announceListRes->getList()) {
+  for (const auto &list : announceListRes->getList()) {
     if (!list.isList())
       return std::nullopt;
-    for (auto &tracker : list.getList()) {
+    for (const auto &tracker : list.getList()) {
       if (!tracker.isStr())
         return std::nullopt;
-      trackers.push_back(tracker.getStr());
+      trackers.emplace_back(tracker.getStr());
     }
   }
   return trackers;
@@ -1,13 +1,15 @@
 #include "error_codes.h"
-#include <Bencode/bencodeDecoder.h>
+#include <Bencode/bencodeStreamParser.h>
 #include <Net/httpConnection.h>
 #include <Torrent/peer.h>
 #include <Tracker/trackerManager.h>
+#include <algorithm>
 #include <array>
-#include <boost/beast/core/buffers_to_string.hpp>
 #include <cstdint>
+#include <cstring>
 #include <errors.h>
 #include <expected>
+#include <format>
 #include <optional>
 #include <string_view>
 #include <sys/types.h>
@@ -15,6 +17,221 @@
 
 namespace btc {
 
+// Builds a TrackerResponse from parser events as the body arrives, so a
+// large scrape or peer list never has to be held whole. Only what the reply
+// carries for this request is kept: the root's fields, the peers, and the
+// scrape entry for the request's info hash; everything else is skipped.
+class TrackerManager::ResponseHandler : public BencodeHandler {
+
+public:
+  explicit ResponseHandler(const TrackerRequest &req) : req(req) {
+    resp.interval = 1800;
+    resp.minInterval = 30;
+  }
+
+  void onInt(BNode::int_t value) override {
+    Frame *top = parent(false);
+    if (!top)
+      return;
+    if (top->place == Place::root) {
+      if (top->key == "interval")
+        resp.interval = static_cast<std::uint32_t>(value);
+      else if (top->key == "min interval")
+        resp.minInterval = static_cast<std::uint32_t>(value);
+      else
+        count(root, top->key, value);
+    } else if (top->place == Place::entry) {
+      count(entry, top->key, value);
+    } else if (top->place == Place::peer && top->key == "port") {
+      peer.port = static_cast<port_t>(value);
+      hasPort = true;
+    }
+  }
+
+  void onStringBegin(std::size_t length) override {
+    target = nullptr;
+    Frame *top = parent(false);
+    if (!top)
+      return;
+    if (top->place == Place::root && top->key == "peers") {
+      // The length is only the tracker's claim, so the reservation is
+      // capped.
+      peers = Peers::compact;
+      compact = true;
+      resp.peerList.clear();
+      resp.peerList.reserve(std::min<std::size_t>(length / 6, 4096));
+      pendingSize = 0;
+      return;
+    }
+
+    if (top->place == Place::root) {
+      if (top->key == "tracker id")
+        target = &resp.trackerID;
+      else if (top->key == "warning reason")
+        target = &resp.warning;
+      else if (top->key == "failure reason")
+        target = &resp.failure;
+    } else if (top->place == Place::peer) {
+      if (top->key == "ip") {
+        target = &peer.ip;
+        hasIp = true;
+      } else if (top->key == "peer id") {
+        target = &peer.pID.emplace();
+      }
+    }
+    if (target)
+      target->clear();
+  }
+
+  void onStringData(std::string_view data) override {
+    if (target)
+      target->append(data);
+    else if (compact)
+      appendCompact(data);
+  }
+
+  void onStringEnd() override {
+    target = nullptr;
+    compact = false;
+  }
+
+  void onKey(std::string_view key) override { stack.back().key = key; }
+
+  void onListBegin() override {
+    Frame *top = parent(false);
+    Place place = Place::other;
+    if (top && top->place == Place::root && top->key == "peers") {
+      peers = Peers::list;
+      resp.peerList.clear();
+      badPeer = false;
+      place = Place::peerList;
+    }
+    stack.push_back({place, {}});
+  }
+
+  void onDictBegin() override {
+    Frame *top = parent(true);
+    Place place = Place::other;
+    if (!top) {
+      place = Place::root;
+    } else if (top->place == Place::root && top->key == "files") {
+      place = Place::files;
+    } else if (top->place == Place::files && top->key == req.infoHash) {
+      place = Place::entry;
+      hasEntry = true;
+    } else if (top->place == Place::peerList) {
+      place = Place::peer;
+      peer = Peer{std::nullopt, "", 0};
+      hasIp = hasPort = false;
+    }
+    stack.push_back({place, {}});
+  }
+
+  void onEnd() override {
+    if (stack.back().place == Place::peer) {
+      if (hasIp && hasPort)
+        resp.peerList.push_back(std::move(peer));
+      else
+        badPeer = true;
+    }
+    stack.pop_back();
+  }
+
+  exp_tracker_resp finish() {
+    if (!isDict)
+      return std::unexpected(error_code::invalidTrackerResponseErr);
+    if (!resp.failure.empty())
+      return std::move(resp);
+
+    if (req.kind == requestKind::scrape ? !hasEntry : peers == Peers::none)
+      return std::unexpected(error_code::invalidTrackerResponseErr);
+    const Counts &counts = req.kind == requestKind::scrape ? entry : root;
+    resp.complete = static_cast<std::uint64_t>(counts.complete);
+    resp.incomplete = static_cast<std::uint64_t>(counts.incomplete);
+    resp.downloaded = static_cast<std::uint64_t>(counts.downloaded);
+    // A malformed peer costs the whole list, not the reply.
+    if (peers == Peers::list && badPeer)
+      resp.peerList.clear();
+    return std::move(resp);
+  }
+
+private:
+  enum class Place : std::uint8_t { root, files, entry, peerList, peer, other };
+  enum class Peers : std::uint8_t { none, compact, list };
+
+  struct Frame {
+    Place place;
+    std::string key;
+  };
+
+  struct Counts {
+    BNode::int_t complete = -1;
+    BNode::int_t incomplete = -1;
+    BNode::int_t downloaded = -1;
+  };
+
+  // The container the next value lies in, or nullptr for the top-level
+  // value, which must be a dictionary. Anything but a dictionary in the
+  // peer list spoils it.
+  Frame *parent(bool dict) {
+    if (stack.empty()) {
+      isDict = dict;
+      return nullptr;
+    }
+    if (stack.back().place == Place::peerList && !dict)
+      badPeer = true;
+    return &stack.back();
+  }
+
+  static void count(Counts &counts, std::string_view key,
+                    BNode::int_t value) {
+    if (key == "complete")
+      counts.complete = value;
+    else if (key == "incomplete")
+      counts.incomplete = value;
+    else if (key == "downloaded")
+      counts.downloaded = value;
+  }
+
+  // Compact peers are 6 bytes each, and a chunk may end inside one.
+  void appendCompact(std::string_view data) {
+    while (!data.empty()) {
+      std::size_t take = std::min(data.size(), sizeof(pending) - pendingSize);
+      std::memcpy(pending + pendingSize, data.data(), take);
+      pendingSize += take;
+      data.remove_prefix(take);
+      if (pendingSize < sizeof(pending))
+        return;
+      pendingSize = 0;
+
+      Peer compact{};
+      compact.ip = std::format("{}.{}.{}.{}", pending[0], pending[1],
+                               pending[2], pending[3]);
+      compact.port = port_t(pending[5]) | port_t(pending[4]) << 8;
+      resp.peerList.push_back(std::move(compact));
+    }
+  }
+
+  const TrackerRequest &req;
+  TrackerResponse resp;
+  std::vector<Frame> stack;
+  bool isDict = false;
+  std::string *target = nullptr;
+
+  Counts root;
+  Counts entry;
+  bool hasEntry = false;
+
+  Peers peers = Peers::none;
+  bool compact = false;
+  unsigned char pending[6];
+  std::size_t pendingSize = 0;
+  Peer peer;
+  bool hasIp = false;
+  bool hasPort = false;
+  bool badPeer = false;
+};
+
 TrackerManager::await_exp_tracker_resp
 TrackerManager::send(TrackerRequest req) {
   if (req.url.scheme() == "http") {
@@ -69,12 +286,22 @@ TrackerManager::httpSend(TrackerRequest req) {
     appendQuery(q, "info_hash", req.infoHash);
     url.set_encoded_query(q);
   }
-  auto httpResp = co_await conn->get(url.buffer());
-  if (!httpResp)
-    co_return std::unexpected(httpResp.error());
+  // The reply is parsed as it arrives instead of after the last read.
+  ResponseHandler handler(req);
+  BencodeStreamParser parser(handler);
+  bool malformed = false;
+  auto streamRes = co_await conn->getStreamed(
+      url.buffer(), [&](std::string_view chunk) {
+        auto feedRes = parser.feed(chunk);
+        malformed = !feedRes;
+        return feedRes;
+      });
+  if (!streamRes && !malformed)
+    co_return std::unexpected(streamRes.error());
+  if (malformed || !parser.finish())
+    co_return std::unexpected(error_code::invalidTrackerResponseErr);
 
-  auto resp =
-      parseHttp(beast::buffers_to_string(httpResp->body().cdata()), req);
+  auto resp = handler.finish();
   if (!resp)
     co_return std::unexpected(resp.error());
   if (resp->trackerID != "")
@@ -91,106 +318,12 @@ void TrackerManager::appendQuery(std::string &q, std::string k,
 }
 
 TrackerManager::exp_tracker_resp
-TrackerManager::parseHttp(const std::span<char const> &resp,
-                          TrackerRequest &req) {
-  BencodeDecoder decoder;
-  TrackerResponse trackerResp;
-
-  auto nodeRes = decoder.decode(beast::buffers_to_string(resp));
-
-  if (!(nodeRes && nodeRes->isDict()))
-    return std::unexpected(error_code::invalidTrackerResponseErr);
-
-  trackerResp.interval = nodeRes->dictFindInt("interval", 1800).getInt();
-  trackerResp.minInterval = nodeRes->dictFindInt("min interval", 30).getInt();
-  trackerResp.trackerID = nodeRes->dictFindString("tracker id", "").getStr();
-  trackerResp.warning = nodeRes->dictFindString("warning reason", "").getStr();
-  trackerResp.failure = nodeRes->dictFindString("failure reason", "").getStr();
-  if (!trackerResp.failure.empty())
-    return trackerResp;
-
-  if (req.kind == requestKind::scrape) {
-    auto filesRes = nodeRes->dictFindDict("files");
-    if (!filesRes)
-      return std::unexpected(error_code::invalidTrackerResponseErr);
-    auto fileRes = filesRes->dictFindDict(req.infoHash);
-    if (!fileRes)
-      return std::unexpected(error_code::invalidTrackerResponseErr);
-
-    trackerResp.complete = fileRes->dictFindInt("complete", -1).getInt();
-    trackerResp.incomplete = fileRes->dictFindInt("incomplete", -1).getInt();
-    trackerResp.downloaded = fileRes->dictFindInt("downloaded", -1).getInt();
-
-    return trackerResp;
-  }
-
-  trackerResp.complete = nodeRes->dictFindInt("complete", -1).getInt();
-  trackerResp.incomplete = nodeRes->dictFindInt("incomplete", -1).getInt();
-  trackerResp.downloaded = nodeRes->dictFindInt("downloaded", -1).getInt();
-
-  auto peerNodeRes = nodeRes->dictFind("peers");
-  if (peerNodeRes && peerNodeRes->isStr()) {
-    auto peerRes = parseCompactPeersHttp(nodeRes.value());
-    if (peerRes)
-      trackerResp.peerList = peerRes.value();
-  } else if (peerNodeRes && peerNodeRes->isDict()) {
-    auto peerRes = parsePeersHttp(nodeRes.value());
-    if (peerRes)
-      trackerResp.peerList = peerRes.value();
-  } else
+TrackerManager::parseHttp(std::string_view resp, TrackerRequest &req) {
+  ResponseHandler handler(req);
+  BencodeStreamParser parser(handler);
+  if (!parser.feed(resp) || !parser.finish())
     return std::unexpected(error_code::invalidTrackerResponseErr);
-  return trackerResp;
-}
-
-TrackerManager::opt_peers TrackerManager::parseCompactPeersHttp(BNode root) {
-  std::vector<Peer> peerList;
-  std::string_view peersView = root.dictFindString("peers", "").getStr();
-
-  while (!peersView.empty()) {
-    std::string_view peerView = peersView.substr(0, 6);
-    unsigned char ip[4];
-    unsigned char port[2];
-
-    ip[0] = static_cast<unsigned char>(peerView.at(0));
-    ip[1] = static_cast<unsigned char>(peerView.at(1));
-    ip[2] = static_cast<unsigned char>(peerView.at(2));
-    ip[3] = static_cast<unsigned char>(peerView.at(3));
-
-    port[0] = static_cast<unsigned char>(peerView.at(4));
-    port[1] = static_cast<unsigned char>(peerView.at(5));
-
-    Peer peer{};
-    peer.ip = std::format("{}.{}.{}.{}", ip[3], ip[2], ip[1], ip[0]);
-    peer.port = port_t(port[1]) | port_t(port[0]) << 8;
-
-    peersView.remove_prefix(6);
-    peerList.push_back(peer);
-  }
-  return peerList;
-}
-
-TrackerManager::opt_peers TrackerManager::parsePeersHttp(BNode root) {
-  std::vector<Peer> peerList;
-  auto peersRes = root.dictFindList("peers");
-  for (auto node : peersRes->getList()) {
-    Peer peer{};
-
-    if (!node.isDict())
-      return std::nullopt;
-
-    auto pIDRes = node.dictFindString("peer id");
-    auto ipRes = node.dictFindString("ip");
-    auto portRes = node.dictFindInt("port");
-    if (!pIDRes || ipRes || portRes)
-      return std::nullopt;
-
-    peer.pID = pIDRes->getStr();
-    peer.ip = ipRes->getStr();
-    peer.port = portRes->getInt();
-
-    peerList.push_back(peer);
-  }
-  return peerList;
+  return handler.finish();
 }
 
 } // namespace btc
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <bufferPool.h>
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+
+namespace btc {
+
+namespace {
+
+std::atomic<std::size_t> nextThread = 0;
+thread_local const std::size_t threadIndex = nextThread.fetch_add(1);
+
+std::size_t roundUp(std::size_t size, std::size_t to) {
+  return (size + to - 1) / to * to;
+}
+
+} // namespace
+
+BufferPool::BufferPool(std::size_t bufferSize, std::size_t maxBuffers)
+    : bufferSize(bufferSize), maxBuffers(maxBuffers) {
+  std::size_t count = std::max<std::size_t>(
+      8, 2 * std::size_t(std::thread::hardware_concurrency()));
+  lists.reserve(count);
+  for (std::size_t i = 0; i < count; i++)
+    lists.push_back(std::make_unique<FreeList>());
+}
+
+BufferPool::~BufferPool() {
+  assert(inUse.load() == 0 && "buffers outlive their pool");
+}
+
+BufferPool::FreeList &BufferPool::localList() {
+  return *lists[threadIndex % lists.size()];
+}
+
+// Adds a slab of up to buffersPerSlab buffers to the calling thread's list.
+bool BufferPool::grow() {
+  std::vector<Buffer::Header *> fresh;
+  {
+    std::lock_guard lock(slabMutex);
+    std::size_t have = capacity.load(std::memory_order_relaxed);
+    if (have >= maxBuffers)
+      return false;
+
+    std::size_t count = std::min(buffersPerSlab, maxBuffers - have);
+    std::size_t stride = roundUp(std::max<std::size_t>(bufferSize, 1),
+                                 pageSize);
+    auto *memory =
+        static_cast<char *>(std::aligned_alloc(pageSize, stride * count));
+    if (!memory)
+      return false;
+
+    Slab slab{{memory, std::free},
+              std::make_unique<Buffer::Header[]>(count)};
+    for (std::size_t i = 0; i < count; i++) {
+      slab.headers[i].pool = this;
+      slab.headers[i].data = memory + i * stride;
+      fresh.push_back(&slab.headers[i]);
+    }
+    slabs.push_back(std::move(slab));
+    capacity.fetch_add(count, std::memory_order_relaxed);
+
+    // Made available before the slab lock is released, so a grow() that
+    // fails afterwards sees them.
+    FreeList &own = localList();
+    std::lock_guard listLock(own.mutex);
+    own.buffers.insert(own.buffers.end(), fresh.begin(), fresh.end());
+    available.fetch_add(fresh.size(), std::memory_order_release);
+  }
+  return true;
+}
+
+BufferPool::exp_buffer BufferPool::acquire() {
+  // Reserve a free buffer first, growing the pool when none is left. Only
+  // when it cannot grow and still none is free is every buffer in use.
+  std::size_t free = available.load(std::memory_order_relaxed);
+  for (;;) {
+    if (free == 0) {
+      // A buffer recycled while the pool could not grow is still taken.
+      bool grown = grow();
+      free = available.load(std::memory_order_relaxed);
+      if (!grown && free == 0)
+        return std::unexpected(error_code::bufferPoolExhaustedErr);
+      continue;
+    }
+    if (available.compare_exchange_weak(free, free - 1,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed))
+      break;
+  }
+
+  // The reserved buffer is in some list, or briefly held by a thread moving
+  // stolen buffers to its own list, so the scan ends up finding it.
+  FreeList &own = localList();
+  Buffer::Header *header = nullptr;
+  while (!header) {
+    {
+      std::lock_guard lock(own.mutex);
+      if (!own.buffers.empty()) {
+        header = own.buffers.back();
+        own.buffers.pop_back();
+        break;
+      }
+    }
+
+    // Take half of the first non-empty list, one lock at a time.
+    thread_local std::vector<Buffer::Header *> stolen;
+    stolen.clear();
+    for (auto &list : lists) {
+      if (list.get() == &own)
+        continue;
+      std::lock_guard lock(list->mutex);
+      if (list->buffers.empty())
+        continue;
+      std::size_t take = (list->buffers.size() + 1) / 2;
+      stolen.assign(list->buffers.end() - static_cast<std::ptrdiff_t>(take),
+                    list->buffers.end());
+      list->buffers.resize(list->buffers.size() - take);
+      break;
+    }
+
+    if (!stolen.empty()) {
+      header = stolen.back();
+      stolen.pop_back();
+      std::lock_guard lock(own.mutex);
+      own.buffers.insert(own.buffers.end(), stolen.begin(), stolen.end());
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  header->refs.store(1, std::memory_order_relaxed);
+  std::size_t used = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+  std::size_t peak = peakInUse.load(std::memory_order_relaxed);
+  while (used > peak &&
+         !peakInUse.compare_exchange_weak(peak, used,
+                                          std::memory_order_relaxed)) {
+  }
+  return Buffer(header);
+}
+
+void BufferPool::recycle(Buffer::Header *header) {
+  inUse.fetch_sub(1, std::memory_order_relaxed);
+  {
+    FreeList &own = localList();
+    std::lock_guard lock(own.mutex);
+    own.buffers.push_back(header);
+  }
+  available.fetch_add(1, std::memory_order_release);
+}
+
+BufferPool::Stats BufferPool::getStats() const {
+  return {bufferSize, capacity.load(std::memory_order_relaxed),
+          inUse.load(std::memory_order_relaxed),
+          peakInUse.load(std::memory_order_relaxed), maxBuffers};
+}
+
+} // namespace btc
@@ -0,0 +1,96 @@
+#include <threadPool.h>
+#include <utility>
+
+namespace btc {
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  if (threads == 0)
+    threads = 1;
+
+  queues.reserve(threads);
+  for (std::size_t i = 0; i < threads; i++)
+    queues.push_back(std::make_unique<Queue>());
+
+  workers.reserve(threads);
+  for (std::size_t i = 0; i < threads; i++)
+    workers.emplace_back([this, i] { run(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::submit(task_t task) {
+  std::size_t index = currentPool == this
+                          ? currentIndex
+                          : next.fetch_add(1, std::memory_order_relaxed) %
+                                queues.size();
+  {
+    std::lock_guard lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  queued.fetch_add(1);
+
+  // A worker counts itself as sleeping before it checks `queued` under the
+  // lock, so either it sees this task or this sees it; taking the lock then
+  // makes sure it is waiting before it is notified.
+  if (sleeping.load() > 0) {
+    {
+      std::lock_guard lock(mutex);
+    }
+    wake.notify_one();
+  }
+}
+
+// Takes the worker's own newest task, or else the oldest of another deque.
+bool ThreadPool::take(std::size_t index, task_t &task) {
+  {
+    Queue &own = *queues[index];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued.fetch_sub(1);
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < queues.size(); i++) {
+    Queue &victim = *queues[(index + i) % queues.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(std::size_t index) {
+  currentPool = this;
+  currentIndex = index;
+
+  for (;;) {
+    task_t task;
+    if (take(index, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock lock(mutex);
+    sleeping.fetch_add(1);
+    wake.wait(lock, [this] { return queued.load() > 0 || stopping; });
+    sleeping.fetch_sub(1);
+    if (stopping && queued.load() == 0)
+      return;
+  }
+}
+
+} // namespace btc
@@ -1,9 +1,15 @@
 #include <Bencode/bencodeDecoder.h>
 #include <Bencode/bencodeEncoder.h>
+#include <Bencode/bencodeStreamParser.h>
 #include <Bencode/bencodeValue.h>
+#include <array>
+#include <atomic>
 #include <gtest/gtest.h>
+#include <iterator>
 #include <limits>
 #include <string>
+#include <thread>
+#include <vector>
 
 using bencode_decoder = btc::BencodeDecoder;
 using bencode_encoder = btc::BencodeEncoder;
@@ -58,6 +64,63 @@ TEST(BencodeGeneral, RejectMaxNestingExceeded) {
   EXPECT_ERR(res1, btc::error_code::maximumNestingLimitExcedeedErr);
 }
 
+TEST(BencodeGeneral, AcceptMaxNesting) {
+  std::string list = std::string(255, 'l') + std::string(255, 'e');
+  auto res = bencode_decoder::decode(list);
+  ASSERT_OK(res);
+
+  std::string deeper = std::string(256, 'l') + std::string(256, 'e');
+  auto res1 = bencode_decoder::decodeView(deeper);
+  EXPECT_ERR(res1, btc::error_code::maximumNestingLimitExcedeedErr);
+}
+
+TEST(BencodeGeneral, ConcurrentDecode) {
+  std::string valid = "d4:dictd3:key5:value6:nestedli42e4:spamd3:subi-7eeee9:"
+                      "emptydictde9:emptylistle7:integeri123456789e4:listli0e"
+                      "3:fooli1ei2ei3eed5:inner6:foobaree6:neginti-98765ee";
+  std::string deep = std::string(500, 'l') + std::string(500, 'e');
+  std::string invalid = "d4:spamli1ei2ee3:abcxe";
+
+  std::atomic<int> failures = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 500; i++) {
+        switch ((t + i) % 4) {
+        case 0: {
+          auto res = bencode_decoder::decode(valid);
+          if (!res || bencode_encoder::encode(*res) != valid)
+            failures++;
+          break;
+        }
+        case 1: {
+          auto res = bencode_decoder::decodeView(valid);
+          if (!res || res->getRoot().dictFindInt("negint", 0) != -98765)
+            failures++;
+          break;
+        }
+        case 2: {
+          auto res = bencode_decoder::decode(deep);
+          if (res ||
+              res.error() != btc::error_code::maximumNestingLimitExcedeedErr)
+            failures++;
+          break;
+        }
+        case 3: {
+          auto res = bencode_decoder::decodeView(invalid);
+          if (res || res.error() != btc::error_code::invalidTypeEncounterErr)
+            failures++;
+          break;
+        }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  ASSERT_EQ(failures, 0);
+}
+
 TEST(BencodeGeneral, DecodeEncode) {
   std::string val = "d4:dictd3:key5:value6:nestedli42e4:spamd3:subi-7eeee9:"
                     "emptydictde9:emptylistle7:integeri123456789e4:listli0e3:"
@@ -70,6 +133,27 @@ TEST(BencodeGeneral, DecodeEncode) {
   ASSERT_EQ(encoded_val, val);
 }
 
+TEST(BencodeGeneral, EncodeIntoBuffer) {
+  std::string val = "d4:listli-9223372036854775808ei0e0:3:fooe3:numi42e"
+                    "4:spamd1:ad1:bleeee";
+  auto res = bencode_decoder::decode(val);
+  ASSERT_OK(res);
+
+  ASSERT_EQ(bencode_encoder::encodedSize(*res), val.size());
+
+  std::array<char, 128> buf{};
+  char *end = bencode_encoder::encode(*res, buf.data());
+  ASSERT_EQ(std::string_view(buf.data(), end), val);
+
+  std::string appended = "prefix";
+  bencode_encoder::encode(*res, appended);
+  ASSERT_EQ(appended, "prefix" + val);
+
+  std::string inserted;
+  bencode_encoder::encode(*res, std::back_inserter(inserted));
+  ASSERT_EQ(inserted, val);
+}
+
 TEST(BencodeGeneral, decodeRawBytes) {
   std::string input("3:\xFF\x00\x61", 5);
   auto res = bencode_decoder::decode(input);
@@ -287,3 +371,169 @@ TEST(BencodeDict, RejectDuplicateKey) {
   auto res = bencode_decoder::decode("d4:spami43e4:spami56ee");
   EXPECT_ERR(res, btc::error_code::duplicateKeyErr);
 }
+
+TEST(BencodeDict, LookupReturnsStoredNode) {
+  auto res = bencode_decoder::decode("d4:infod6:pieces3:abce4:spami43ee");
+  ASSERT_OK(res);
+  const btc::BNode &root = *res;
+
+  auto info = root.dictFindDict(std::string_view("info"));
+  ASSERT_NE(info, nullptr);
+  EXPECT_EQ(info, &root.getDict().at("info"));
+
+  auto pieces = info->dictFindString("pieces");
+  ASSERT_NE(pieces, nullptr);
+  EXPECT_EQ(&pieces->getStr(), &info->getDict().at("pieces").getStr());
+
+  EXPECT_EQ(root.dictFindList("info"), nullptr);
+  EXPECT_EQ(root.dictFind("missing"), nullptr);
+  EXPECT_EQ(root.dictFindInt("spam", 0), 43);
+  EXPECT_EQ(root.dictFindString("spam", "none"), "none");
+}
+
+// --------------------------------------------------------------------
+// VIEW
+// --------------------------------------------------------------------
+
+TEST(BencodeView, StringsBorrowFromInput) {
+  std::string input = "d4:spam3:abc4:listl3:fooi7eee";
+  auto res = bencode_decoder::decodeView(input);
+  ASSERT_OK(res);
+  const btc::BView &root = res->getRoot();
+  ASSERT_TRUE(root.isDict());
+
+  auto spam = root.dictFindString("spam");
+  ASSERT_NE(spam, nullptr);
+  EXPECT_EQ(spam->getStr(), "abc");
+  EXPECT_GE(spam->getStr().data(), input.data());
+  EXPECT_LE(spam->getStr().data() + spam->getStr().size(),
+            input.data() + input.size());
+
+  auto list = root.dictFindList("list");
+  ASSERT_NE(list, nullptr);
+  ASSERT_EQ(list->getList().size(), 2);
+  EXPECT_EQ(list->getList()[0].getStr(), "foo");
+  EXPECT_EQ(list->getList()[1].getInt(), 7);
+  EXPECT_EQ(root.dictFindInt("spam"), nullptr);
+  EXPECT_EQ(root.dictFindInt("missing", -1), -1);
+}
+
+TEST(BencodeView, LookupInUnsortedDict) {
+  auto res = bencode_decoder::decodeView("d1:ci3e1:ai1e1:bi2ee");
+  ASSERT_OK(res);
+  EXPECT_EQ(res->getRoot().dictFindInt("a", 0), 1);
+  EXPECT_EQ(res->getRoot().dictFindInt("b", 0), 2);
+  EXPECT_EQ(res->getRoot().dictFindInt("c", 0), 3);
+
+  auto dup = bencode_decoder::decodeView("d1:bi1e1:ai2e1:bi3ee");
+  EXPECT_ERR(dup, btc::error_code::duplicateKeyErr);
+}
+
+TEST(BencodeView, MatchesOwningDecode) {
+  std::string val = "d4:dictd3:key5:value6:nestedli42e4:spamd3:subi-7eeee9:"
+                    "emptydictde9:emptylistle7:integeri123456789e4:listli0e3:"
+                    "fooli1ei2ei3eed5:inner6:foobaree6:neginti-98765ee";
+
+  auto res = bencode_decoder::decodeView(val);
+  ASSERT_OK(res);
+  ASSERT_EQ(bencode_encoder::encode(res->getRoot().toNode()), val);
+
+  auto res1 = bencode_decoder::decodeView("i-0e");
+  EXPECT_ERR(res1, btc::error_code::invalidIntegerErr);
+
+  auto res2 = bencode_decoder::decodeView("i9223372036854775808e");
+  EXPECT_ERR(res2, btc::error_code::outOfRangeIntegerErr);
+
+  auto res3 = bencode_decoder::decodeView("5:spam");
+  EXPECT_ERR(res3, btc::error_code::lengthMismatchErr);
+
+  auto res4 = bencode_decoder::decodeView("lxe");
+  EXPECT_ERR(res4, btc::error_code::invalidListElementErr);
+}
+
+// --------------------------------------------------------------------
+// STREAM
+// --------------------------------------------------------------------
+
+namespace {
+// Re-encodes the received events so they can be compared with the input.
+class EncodingHandler : public btc::BencodeHandler {
+public:
+  std::string out;
+  std::size_t chunks = 0;
+
+  void onInt(btc::BNode::int_t val) override {
+    out += "i" + std::to_string(val) + "e";
+  }
+  void onStringBegin(std::size_t length) override {
+    out += std::to_string(length) + ":";
+  }
+  void onStringData(std::string_view data) override {
+    out += data;
+    chunks++;
+  }
+  void onKey(std::string_view key) override {
+    out += std::to_string(key.size()) + ":";
+    out += key;
+  }
+  void onListBegin() override { out += "l"; }
+  void onDictBegin() override { out += "d"; }
+  void onEnd() override { out += "e"; }
+};
+} // namespace
+
+TEST(BencodeStream, ParseByteByByte) {
+  std::string val = "d4:dictd3:key5:value6:nestedli42e4:spamd3:subi-7eeee9:"
+                    "emptydictde9:emptylistle7:integeri123456789e4:listli0e3:"
+                    "fooli1ei2ei3eed5:inner6:foobaree6:neginti-98765ee";
+
+  EncodingHandler handler;
+  btc::BencodeStreamParser parser(handler);
+  for (char c : val)
+    ASSERT_OK(parser.feed(std::string_view(&c, 1)));
+  ASSERT_OK(parser.finish());
+  ASSERT_TRUE(parser.isDone());
+  ASSERT_EQ(handler.out, val);
+}
+
+TEST(BencodeStream, StringsArriveInChunks) {
+  std::string blob(1000, 'x');
+  std::string val = "l1000:" + blob + "e";
+
+  EncodingHandler handler;
+  btc::BencodeStreamParser parser(handler);
+  for (std::size_t i = 0; i < val.size(); i += 100)
+    ASSERT_OK(parser.feed(std::string_view(val).substr(i, 100)));
+  ASSERT_OK(parser.finish());
+  ASSERT_EQ(handler.out, val);
+  ASSERT_GT(handler.chunks, 1);
+}
+
+TEST(BencodeStream, RejectInvalidInput) {
+  EncodingHandler handler;
+  btc::BencodeStreamParser parser(handler);
+
+  ASSERT_OK(parser.feed("li1e"));
+  auto res = parser.finish();
+  EXPECT_ERR(res, btc::error_code::missingListTerminatorErr);
+
+  parser.reset();
+  auto res1 = parser.feed("i-0e");
+  EXPECT_ERR(res1, btc::error_code::invalidIntegerErr);
+
+  parser.reset();
+  auto res2 = parser.feed("i1ei2e");
+  EXPECT_ERR(res2, btc::error_code::trailingInputErr);
+
+  parser.reset();
+  auto res3 = parser.feed("di1ei2ee");
+  EXPECT_ERR(res3, btc::error_code::nonStringKeyErr);
+
+  parser.reset();
+  auto res4 = parser.feed(std::string(500, 'l'));
+  EXPECT_ERR(res4, btc::error_code::maximumNestingLimitExcedeedErr);
+
+  parser.reset();
+  auto res5 = parser.finish();
+  EXPECT_ERR(res5, btc::error_code::emptyInputErr);
+}
@@ -0,0 +1,878 @@
+#include <Bencode/bencodeDecoder.h>
+#include <Crypto/sha1.h>
+#include <Peer/bitfield.h>
+#include <Peer/choker.h>
+#include <Peer/peerConnection.h>
+#include <Peer/peerWire.h>
+#include <Peer/piecePicker.h>
+#include <Peer/ringBuffer.h>
+#include <Peer/swarm.h>
+#include <Storage/diskStorage.h>
+#include <Storage/writeCache.h>
+#include <Torrent/torrentParser.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using peerWire = btc::PeerWire;
+using messageType = btc::MessageType;
+using blockRequest = btc::BlockRequest;
+using torrentParser = btc::TorrentParser;
+using bencodeDecoder = btc::BencodeDecoder;
+using bitfield = btc::Bitfield;
+
+#define ASSERT_OK(expr) ASSERT_TRUE((expr).has_value())
+
+namespace {
+
+bitfield makeBits(std::size_t size, std::initializer_list<std::size_t> set) {
+  bitfield bits(size);
+  for (std::size_t i : set)
+    bits.set(i);
+  return bits;
+}
+
+} // namespace
+
+TEST(PeerWire, FramesMessagesSplitAnywhere) {
+  std::string stream;
+  peerWire::append(stream, messageType::keepAlive);
+  peerWire::append(stream, messageType::unchoke);
+  peerWire::appendHave(stream, 7);
+  peerWire::appendBitfield(stream, makeBits(9, {0, 2, 3, 8}));
+  peerWire::appendBlock(stream, messageType::request, {3, 16384, 16384});
+  peerWire::appendPieceHeader(stream, {3, 16384, 5});
+  stream += "abcde";
+
+  // Fed one byte at a time, each message is framed once it is complete.
+  std::vector<btc::PeerMessage> messages;
+  std::size_t start = 0;
+  for (std::size_t end = 1; end <= stream.size(); end++) {
+    btc::PeerMessage message;
+    auto frameRes = peerWire::frame(
+        std::string_view(stream).substr(start, end - start), 1024, message);
+    ASSERT_OK(frameRes);
+    if (*frameRes > 0) {
+      messages.push_back(message);
+      start += *frameRes;
+    }
+  }
+  ASSERT_EQ(start, stream.size());
+  ASSERT_EQ(messages.size(), 6u);
+
+  EXPECT_EQ(messages[0].type, messageType::keepAlive);
+  EXPECT_EQ(messages[1].type, messageType::unchoke);
+  EXPECT_EQ(peerWire::parseHave(messages[2]), 7u);
+  EXPECT_EQ(messages[3].payload, std::string("\xB0\x80", 2));
+  EXPECT_EQ(*peerWire::parseBlock(messages[4]),
+            (blockRequest{3, 16384, 16384}));
+  EXPECT_EQ(*peerWire::parseBlock(messages[5]), (blockRequest{3, 16384, 5}));
+  EXPECT_EQ(peerWire::pieceData(messages[5]), "abcde");
+
+  btc::PeerMessage message;
+  auto largeRes = peerWire::frame(stream.substr(stream.size() - 18), 8,
+                                  message);
+  ASSERT_FALSE(largeRes);
+  EXPECT_EQ(largeRes.error(), btc::error_code::peerMessageTooLargeErr);
+  std::string badHave("\0\0\0\x03\x04\0\0", 7);
+  auto badRes = peerWire::frame(badHave, 1024, message);
+  ASSERT_FALSE(badRes);
+  EXPECT_EQ(badRes.error(), btc::error_code::invalidPeerMessageErr);
+
+  std::string handshake;
+  peerWire::appendHandshake(handshake, std::string(20, 'i'),
+                            std::string(20, 'p'));
+  ASSERT_EQ(handshake.size(), peerWire::handshakeSize);
+  auto handshakeRes = peerWire::parseHandshake(handshake);
+  ASSERT_OK(handshakeRes);
+  EXPECT_EQ(handshakeRes->infoHash, std::string(20, 'i'));
+  EXPECT_EQ(handshakeRes->peerId, std::string(20, 'p'));
+  handshake[5] = 'x';
+  ASSERT_FALSE(peerWire::parseHandshake(handshake));
+}
+
+TEST(Bitfield, EveryIsaMatchesThePlainLoops) {
+  // A size that ends mid-byte and mid-block, with runs of empty blocks.
+  const std::size_t size = 5000;
+  std::mt19937 rng(3);
+  bitfield a(size), b(size);
+  std::vector<bool> plainA(size), plainB(size);
+  for (std::size_t i = 0; i < size; i++) {
+    if (i < 1000 || i > 3000 ? rng() % 3 == 0 : i == 2222) {
+      a.set(i);
+      plainA[i] = true;
+    }
+    if (rng() % 2 == 0) {
+      b.set(i);
+      plainB[i] = true;
+    }
+  }
+
+  std::size_t count = 0, andNot = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    count += plainA[i];
+    andNot += plainA[i] && !plainB[i];
+  }
+
+  bitfield::Isa detected = bitfield::getIsa();
+  for (auto isa : {bitfield::Isa::scalar, bitfield::Isa::popcnt,
+                   bitfield::Isa::avx2}) {
+    if (!bitfield::setIsa(isa))
+      continue;
+    EXPECT_EQ(a.count(), count);
+    EXPECT_EQ(a.countAndNot(b), andNot);
+    bitfield c = a;
+    EXPECT_EQ(c.andNot(b).count(), andNot);
+
+    std::size_t expected = bitfield::npos;
+    for (std::size_t from = size; from-- > 0;) {
+      if (plainA[from])
+        expected = from;
+      ASSERT_EQ(a.findNext(from), expected);
+    }
+    EXPECT_EQ(a.findNext(size), bitfield::npos);
+    expected = bitfield::npos;
+    for (std::size_t from = size; from-- > 0;) {
+      if (plainA[from] && plainB[from])
+        expected = from;
+      ASSERT_EQ(a.findNextCommon(b, from), expected);
+    }
+
+    std::vector<std::uint32_t> counts(size, 7);
+    a.increment(counts);
+    b.increment(counts);
+    for (std::size_t i = 0; i < size; i++)
+      ASSERT_EQ(counts[i], 7u + plainA[i] + plainB[i]);
+    a.decrement(counts);
+    b.decrement(counts);
+    EXPECT_EQ(counts, std::vector<std::uint32_t>(size, 7));
+  }
+  bitfield::setIsa(detected);
+
+  // Wire bytes: piece 0 is the high bit, spare bits must be clear.
+  bitfield small = makeBits(10, {0, 9});
+  EXPECT_EQ(small.bytes(), std::string("\x80\x40", 2));
+  auto parsedRes = bitfield::fromBytes(small.bytes(), 10);
+  ASSERT_OK(parsedRes);
+  EXPECT_EQ(*parsedRes, small);
+  EXPECT_FALSE(bitfield::fromBytes(std::string("\x80\x20", 2), 10));
+  EXPECT_FALSE(bitfield::fromBytes(std::string("\x80", 1), 10));
+  EXPECT_TRUE(bitfield(10, true).all());
+  EXPECT_EQ(bitfield(10, true).bytes(), std::string("\xFF\xC0", 2));
+  EXPECT_TRUE(bitfield(10).none());
+}
+
+TEST(RingBuffer, DataStaysContiguousAcrossTheEnd) {
+  auto ringRes = btc::RingBuffer::create(1000);
+  ASSERT_OK(ringRes);
+  btc::RingBuffer &ring = *ringRes;
+  std::size_t capacity = ring.getCapacity();
+  ASSERT_GE(capacity, 1000u);
+
+  std::string first(capacity - 10, 'a');
+  std::memcpy(ring.prepare().data(), first.data(), first.size());
+  ring.commit(first.size());
+  ring.consume(first.size() - 5);
+
+  // 20 bytes written from 10 bytes before the end read back in one piece.
+  std::string second = "0123456789abcdefghij";
+  ASSERT_GE(ring.prepare().size(), second.size());
+  std::memcpy(ring.prepare().data(), second.data(), second.size());
+  ring.commit(second.size());
+  EXPECT_EQ(ring.data(), "aaaaa" + second);
+  EXPECT_EQ(ring.prepare().size(), capacity - 25);
+
+  btc::RingBuffer moved = std::move(ring);
+  moved.consume(5);
+  EXPECT_EQ(moved.data(), second);
+}
+
+namespace {
+
+const std::size_t pieceLength = 16384;
+
+std::string makeContent(std::size_t size) {
+  std::string out(size, '\0');
+  for (std::size_t i = 0; i < size; i++)
+    out[i] = static_cast<char>((i * 31 + (i >> 11)) & 0xFF);
+  return out;
+}
+
+btc::TorrentFile makeTorrent(const std::string &content,
+                             std::string_view name) {
+  std::string pieces;
+  for (std::size_t offset = 0; offset < content.size();
+       offset += pieceLength) {
+    auto digest = btc::Sha1::hash(
+        std::string_view(content).substr(offset, pieceLength));
+    pieces.append(digest.begin(), digest.end());
+  }
+  std::string metainfo =
+      "d8:announce15:http://a.b/anno4:infod6:lengthi" +
+      std::to_string(content.size()) + "e4:name" +
+      std::to_string(name.size()) + ":" + std::string(name) +
+      "12:piece lengthi" + std::to_string(pieceLength) + "e6:pieces" +
+      std::to_string(pieces.size()) + ":" + pieces + "ee";
+
+  bencodeDecoder decoder;
+  return *torrentParser::parseContent(metainfo, decoder);
+}
+
+// Serves every request from `content` and unchokes anyone interested. A
+// stalled seeder unchokes but never answers.
+struct Seeder : btc::PeerHandler {
+  const std::string &content;
+  bool stalled = false;
+  std::size_t requests = 0;
+  explicit Seeder(const std::string &content) : content(content) {}
+
+  std::optional<blockRequest> pickBlock(btc::PeerConnection &) override {
+    return std::nullopt;
+  }
+  void onBlock(btc::PeerConnection &, const blockRequest &,
+               std::string_view) override {}
+  void onInterest(btc::PeerConnection &conn) override {
+    if (conn.isPeerInterested())
+      conn.unchoke();
+  }
+  void onRequest(btc::PeerConnection &conn,
+                 const blockRequest &block) override {
+    requests++;
+    if (stalled)
+      return;
+    conn.sendPiece(block, std::string_view(content).substr(
+                              block.piece * pieceLength + block.offset,
+                              block.length));
+  }
+};
+
+// Requests every block of the torrent in order and closes when done.
+struct Leecher : btc::PeerHandler {
+  std::deque<blockRequest> queue;
+  std::string received;
+  std::size_t missing;
+  std::size_t deepest = 0;
+
+  explicit Leecher(std::size_t size) : received(size, '\0') {
+    for (std::size_t offset = 0; offset < size; offset += 4096)
+      queue.push_back({static_cast<std::uint32_t>(offset / pieceLength),
+                       static_cast<std::uint32_t>(offset % pieceLength),
+                       static_cast<std::uint32_t>(
+                           std::min<std::size_t>(4096, size - offset))});
+    missing = queue.size();
+  }
+
+  void onBitfield(btc::PeerConnection &conn) override {
+    conn.setInterested(true);
+  }
+  std::optional<blockRequest> pickBlock(btc::PeerConnection &) override {
+    if (queue.empty())
+      return std::nullopt;
+    blockRequest block = queue.front();
+    queue.pop_front();
+    return block;
+  }
+  void onBlock(btc::PeerConnection &conn, const blockRequest &block,
+               std::string_view data) override {
+    std::memcpy(received.data() + block.piece * pieceLength + block.offset,
+                data.data(), data.size());
+    deepest = std::max(deepest, conn.getPipelineDepth());
+    if (--missing == 0)
+      conn.close();
+  }
+  void onRequestsDropped(btc::PeerConnection &,
+                         std::span<const blockRequest> blocks) override {
+    queue.insert(queue.end(), blocks.begin(), blocks.end());
+  }
+};
+
+// Asks for `wanted` whole blocks and stays connected; with wanted == 0 it
+// is interested but never asks.
+struct Client : btc::PeerHandler {
+  std::size_t wanted;
+  std::size_t asked = 0;
+  std::size_t received = 0;
+  explicit Client(std::size_t wanted) : wanted(wanted) {}
+
+  void onBitfield(btc::PeerConnection &conn) override {
+    conn.setInterested(true);
+  }
+  std::optional<blockRequest> pickBlock(btc::PeerConnection &) override {
+    if (asked == wanted)
+      return std::nullopt;
+    auto piece = static_cast<std::uint32_t>(asked++ % 24);
+    return blockRequest{piece, 0, pieceLength};
+  }
+  void onBlock(btc::PeerConnection &, const blockRequest &,
+               std::string_view) override {
+    received++;
+  }
+};
+
+} // namespace
+
+TEST(PeerConnection, DownloadsATorrentOverLoopback) {
+  std::string content = makeContent(400000);
+  btc::TorrentFile torrent = makeTorrent(content, "peer");
+  btc::TorrentFile other = makeTorrent(content, "other");
+
+  btc::net::io_context ctx;
+  btc::tcp::acceptor acceptor(
+      ctx, btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0));
+  btc::Peer peer{std::nullopt, "127.0.0.1", acceptor.local_endpoint().port()};
+
+  Seeder seeder(content);
+  Leecher leecher(content.size());
+  std::error_code mismatch;
+  std::string seederId(20, 's');
+  std::string leecherId(20, 'l');
+
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        for (int i = 0; i < 2; i++) {
+          auto socket = co_await acceptor.async_accept(
+              btc::net::use_awaitable);
+          auto connRes = co_await btc::PeerConnection::accept(
+              std::move(socket), torrent, seederId, seeder);
+          if (!connRes) {
+            mismatch = connRes.error();
+            continue;
+          }
+          (*connRes)->sendBitfield(bitfield(25, true));
+          co_await (*connRes)->run();
+        }
+      },
+      btc::net::detached);
+
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        auto connRes = co_await btc::PeerConnection::connect(
+            ctx, peer, torrent, leecherId, leecher);
+        EXPECT_TRUE(connRes.has_value());
+        if (!connRes)
+          co_return;
+        EXPECT_EQ((*connRes)->getPeerId(), seederId);
+        co_await (*connRes)->run();
+
+        // A peer that asks for another torrent is turned away.
+        Leecher stranger(content.size());
+        auto strangerRes = co_await btc::PeerConnection::connect(
+            ctx, peer, other, leecherId, stranger);
+        EXPECT_FALSE(strangerRes.has_value());
+      },
+      btc::net::detached);
+
+  ctx.run();
+  EXPECT_EQ(leecher.missing, 0u);
+  EXPECT_EQ(leecher.received, content);
+  // The pipeline opened up past its minimum as the rate grew.
+  EXPECT_GT(leecher.deepest, btc::PeerConnection::Options().minOutstanding);
+  EXPECT_EQ(mismatch, btc::error_code::infoHashMismatchErr);
+}
+
+TEST(PeerConnection, EnforcesMessageOrderRequestLimitAndTimeouts) {
+  std::string content = makeContent(400000);
+  btc::TorrentFile torrent = makeTorrent(content, "limits");
+
+  btc::net::io_context ctx;
+  btc::tcp::acceptor acceptor(
+      ctx, btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0));
+  Seeder seeder(content);
+  seeder.stalled = true;
+  btc::PeerOptions options;
+  options.maxPeerRequests = 2;
+  options.handshakeTimeout = std::chrono::milliseconds(100);
+  options.idleTimeout = std::chrono::milliseconds(300);
+  options.keepAliveInterval = std::chrono::milliseconds(100);
+
+  std::vector<std::error_code> errors;
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        for (int i = 0; i < 3; i++) {
+          auto socket = co_await acceptor.async_accept(
+              btc::net::use_awaitable);
+          auto connRes = co_await btc::PeerConnection::accept(
+              std::move(socket), torrent, std::string(20, 's'), seeder,
+              options);
+          if (!connRes) {
+            errors.push_back(connRes.error());
+            continue;
+          }
+          errors.push_back((co_await (*connRes)->run()).error());
+        }
+      },
+      btc::net::detached);
+
+  // Raw clients: one that never handshakes, one that asks for more blocks
+  // than allowed and then goes quiet, and one that sends a bitfield after a
+  // have. Each reads whatever it gets until the other side closes.
+  std::vector<std::string> received;
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        for (int i = 0; i < 3; i++) {
+          btc::tcp::socket socket(ctx);
+          co_await socket.async_connect(acceptor.local_endpoint(),
+                                        btc::net::use_awaitable);
+          std::string out;
+          if (i > 0) {
+            peerWire::appendHandshake(out, torrent.getInfoHash(),
+                                      std::string(20, 'c'));
+            co_await btc::net::async_write(socket, btc::net::buffer(out),
+                                           btc::net::use_awaitable);
+            std::array<char, peerWire::handshakeSize> in;
+            co_await btc::net::async_read(socket, btc::net::buffer(in),
+                                          btc::net::use_awaitable);
+            out.clear();
+          }
+          if (i == 1) {
+            peerWire::append(out, messageType::interested);
+            for (std::uint32_t piece = 0; piece < 3; piece++)
+              peerWire::appendBlock(out, messageType::request,
+                                    {piece, 0, 4096});
+          } else if (i == 2) {
+            peerWire::appendHave(out, 0);
+            peerWire::appendBitfield(out, bitfield(25, true));
+          }
+          btc::sys::error_code ec;
+          co_await btc::net::async_write(
+              socket, btc::net::buffer(out),
+              btc::net::redirect_error(btc::net::use_awaitable, ec));
+          std::string data;
+          co_await btc::net::async_read(
+              socket, btc::net::dynamic_buffer(data),
+              btc::net::redirect_error(btc::net::use_awaitable, ec));
+          received.push_back(data);
+        }
+      },
+      btc::net::detached);
+  ctx.run_for(std::chrono::seconds(10));
+
+  ASSERT_EQ(errors.size(), 3u);
+  EXPECT_EQ(errors[0], btc::error_code::peerTimeoutErr);
+  EXPECT_EQ(errors[1], btc::error_code::peerTimeoutErr);
+  EXPECT_EQ(errors[2], btc::error_code::invalidPeerMessageErr);
+  EXPECT_EQ(seeder.requests, 2u);
+
+  // The quiet client was unchoked, then kept alive until the idle timeout.
+  ASSERT_EQ(received.size(), 3u);
+  std::string unchoke("\0\0\0\1\1", 5);
+  ASSERT_GE(received[1].size(), unchoke.size() + 4);
+  EXPECT_EQ(received[1].substr(0, 5), unchoke);
+  EXPECT_EQ(received[1].substr(5),
+            std::string(received[1].size() - 5, '\0'));
+}
+
+TEST(Swarm, EndgameFinishesPastAStalledPeer) {
+  std::string content = makeContent(400000);
+  btc::TorrentFile torrent = makeTorrent(content, "swarm");
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_swarm_test";
+  std::filesystem::remove_all(root);
+  auto storageRes = btc::DiskStorage::open(torrent, root);
+  ASSERT_OK(storageRes);
+  btc::WriteCache cache(*storageRes, torrent, 1 << 20);
+
+  btc::net::io_context ctx;
+  Seeder fast(content);
+  Seeder stalled(content);
+  stalled.stalled = true;
+  std::string seederId(20, 's');
+
+  // One connection each; the stalled peer's blocks are only finished by
+  // asking the other one again.
+  std::vector<btc::Peer> list;
+  std::vector<std::unique_ptr<btc::tcp::acceptor>> acceptors;
+  for (Seeder *seeder : {&stalled, &fast}) {
+    acceptors.push_back(std::make_unique<btc::tcp::acceptor>(
+        ctx,
+        btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0)));
+    btc::tcp::acceptor &acceptor = *acceptors.back();
+    list.push_back({std::nullopt, "127.0.0.1",
+                    acceptor.local_endpoint().port()});
+    btc::net::co_spawn(
+        ctx,
+        [&, seeder]() -> btc::net::awaitable<void> {
+          auto socket =
+              co_await acceptor.async_accept(btc::net::use_awaitable);
+          auto connRes = co_await btc::PeerConnection::accept(
+              std::move(socket), torrent, seederId, *seeder);
+          if (!connRes)
+            co_return;
+          (*connRes)->sendBitfield(bitfield(25, true));
+          co_await (*connRes)->run();
+        },
+        btc::net::detached);
+  }
+  list.push_back(list.front());
+
+  btc::SwarmOptions options;
+  options.endgameDuplicates = 2;
+  btc::Swarm swarm(ctx, torrent, cache, std::string(20, 'l'), options);
+  swarm.addPeers(list);
+  std::expected<void, std::error_code> result;
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> { result = co_await swarm.wait(); },
+      btc::net::detached);
+  ctx.run_for(std::chrono::seconds(20));
+
+  ASSERT_OK(result);
+  EXPECT_TRUE(swarm.getPicker().isComplete());
+  EXPECT_EQ(swarm.getConnectionCount(), 0u);
+  auto stats = swarm.getStats();
+  EXPECT_GT(stats.duplicateRequests, 0u);
+  EXPECT_EQ(stats.cancels, stats.duplicateRequests);
+  EXPECT_EQ(stats.piecesFailed, 0u);
+
+  std::ifstream file(root / "swarm", std::ios::binary);
+  std::string written((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+  EXPECT_EQ(written, content);
+  std::filesystem::remove_all(root);
+}
+
+TEST(Swarm, AvailabilityReturnsToZeroAfterAMisbehavingPeer) {
+  std::string content = makeContent(400000);
+  btc::TorrentFile torrent = makeTorrent(content, "misbehaving");
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_swarm_misbehaving";
+  std::filesystem::remove_all(root);
+  auto storageRes = btc::DiskStorage::open(torrent, root);
+  ASSERT_OK(storageRes);
+  btc::WriteCache cache(*storageRes, torrent, 1 << 20);
+
+  btc::net::io_context ctx;
+  btc::tcp::acceptor acceptor(
+      ctx, btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0));
+  std::vector<btc::Peer> list{
+      {std::nullopt, "127.0.0.1", acceptor.local_endpoint().port()}};
+
+  // A peer announcing piece 3 and then a bitfield of some other pieces,
+  // which is a protocol error.
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        auto socket =
+            co_await acceptor.async_accept(btc::net::use_awaitable);
+        std::array<char, peerWire::handshakeSize> in;
+        co_await btc::net::async_read(socket, btc::net::buffer(in),
+                                      btc::net::use_awaitable);
+        std::string out;
+        peerWire::appendHandshake(out, torrent.getInfoHash(),
+                                  std::string(20, 's'));
+        peerWire::appendHave(out, 3);
+        peerWire::appendBitfield(out, makeBits(25, {0, 1, 2}));
+        co_await btc::net::async_write(socket, btc::net::buffer(out),
+                                       btc::net::use_awaitable);
+        std::string data;
+        btc::sys::error_code ec;
+        co_await btc::net::async_read(
+            socket, btc::net::dynamic_buffer(data),
+            btc::net::redirect_error(btc::net::use_awaitable, ec));
+      },
+      btc::net::detached);
+
+  btc::Swarm swarm(ctx, torrent, cache, std::string(20, 'l'));
+  swarm.addPeers(list);
+  std::expected<void, std::error_code> result;
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> { result = co_await swarm.wait(); },
+      btc::net::detached);
+  ctx.run_for(std::chrono::seconds(10));
+
+  ASSERT_FALSE(result);
+  EXPECT_EQ(result.error(), btc::error_code::swarmExhaustedErr);
+  for (std::size_t piece = 0; piece < 25; piece++)
+    EXPECT_EQ(swarm.getPicker().getAvailability(piece), 0u) << piece;
+  std::filesystem::remove_all(root);
+}
+
+TEST(Choker, UnchokesTheFastestPeersWithinTheSlots) {
+  std::string content = makeContent(400000);
+  btc::TorrentFile torrent = makeTorrent(content, "choker");
+  btc::net::io_context ctx;
+  btc::tcp::acceptor acceptor(
+      ctx, btc::tcp::endpoint(btc::net::ip::make_address("127.0.0.1"), 0));
+  btc::Peer peer{std::nullopt, "127.0.0.1", acceptor.local_endpoint().port()};
+
+  // Served connections in the order the clients connect: two that download
+  // (the first three times as much), two that only say they are interested.
+  Seeder seeder(content);
+  std::vector<std::shared_ptr<btc::PeerConnection>> served;
+  std::vector<std::unique_ptr<Client>> clients;
+  std::vector<std::shared_ptr<btc::PeerConnection>> connections;
+  for (std::size_t wanted : {60, 20, 0, 0})
+    clients.push_back(std::make_unique<Client>(wanted));
+
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        for (std::size_t i = 0; i < clients.size(); i++) {
+          auto socket =
+              co_await acceptor.async_accept(btc::net::use_awaitable);
+          auto connRes = co_await btc::PeerConnection::accept(
+              std::move(socket), torrent, std::string(20, 's'), seeder);
+          if (!connRes)
+            co_return;
+          served.push_back(*connRes);
+          (*connRes)->sendBitfield(bitfield(25, true));
+          btc::net::co_spawn(ctx, (*connRes)->run(), btc::net::detached);
+        }
+      },
+      btc::net::detached);
+
+  auto unchokedIds = [&] {
+    std::string ids;
+    for (const auto &conn : served)
+      if (!conn->isChoking())
+        ids += conn->getPeerId()[0];
+    return ids;
+  };
+  std::string fastest, optimistic, global;
+  std::size_t unchokedCount = 0;
+
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        for (std::size_t i = 0; i < clients.size(); i++) {
+          auto connRes = co_await btc::PeerConnection::connect(
+              ctx, peer, torrent, std::string(20, static_cast<char>('a' + i)),
+              *clients[i]);
+          if (!connRes)
+            co_return;
+          connections.push_back(*connRes);
+          btc::net::co_spawn(ctx, (*connRes)->run(), btc::net::detached);
+        }
+        btc::net::steady_timer timer(ctx);
+        for (int i = 0; i < 1000; i++) {
+          bool interested = served.size() == clients.size() &&
+                            std::all_of(served.begin(), served.end(),
+                                        [](const auto &conn) {
+                                          return conn->isPeerInterested();
+                                        });
+          if (interested && clients[0]->received == 60 &&
+              clients[1]->received == 20)
+            break;
+          timer.expires_after(std::chrono::milliseconds(5));
+          co_await timer.async_wait(btc::net::use_awaitable);
+        }
+
+        // Two slots go to the two peers we uploaded to.
+        btc::ChokerOptions options;
+        options.slotsPerTorrent = 2;
+        options.optimisticUnchoke = false;
+        btc::Choker choker(ctx, options);
+        auto id = choker.addTorrent(true);
+        for (const auto &conn : served)
+          choker.addPeer(id, conn);
+        co_await choker.tick(true);
+        fastest = unchokedIds();
+        unchokedCount = choker.getUnchokedCount();
+
+        // An optimistic unchoke adds one of the others.
+        options.optimisticUnchoke = true;
+        btc::Choker rotating(ctx, options);
+        id = rotating.addTorrent(true);
+        for (const auto &conn : served)
+          rotating.addPeer(id, conn);
+        co_await rotating.tick(true);
+        optimistic = unchokedIds();
+
+        // With one slot for two torrents, only the fastest peer of both.
+        options.optimisticUnchoke = false;
+        options.globalSlots = 1;
+        btc::Choker limited(ctx, options);
+        auto first = limited.addTorrent(true);
+        auto second = limited.addTorrent(true);
+        limited.addPeer(first, served[1]);
+        limited.addPeer(first, served[2]);
+        limited.addPeer(second, served[0]);
+        limited.addPeer(second, served[3]);
+        co_await limited.tick(false);
+        global = unchokedIds();
+
+        for (const auto &conn : connections)
+          conn->close();
+        for (const auto &conn : served)
+          conn->close();
+      },
+      btc::net::detached);
+  ctx.run_for(std::chrono::seconds(20));
+
+  std::sort(fastest.begin(), fastest.end());
+  EXPECT_EQ(fastest, "ab");
+  EXPECT_EQ(unchokedCount, 2u);
+  std::sort(optimistic.begin(), optimistic.end());
+  EXPECT_TRUE(optimistic == "abc" || optimistic == "abd") << optimistic;
+  EXPECT_EQ(global, "a");
+}
+
+TEST(Choker, StopDuringARoundEndsTheLoop) {
+  btc::net::io_context ctx;
+  btc::ChokerOptions options;
+  options.interval = std::chrono::hours(1);
+  options.batch = 1;
+  btc::Choker choker(ctx, options);
+  for (int i = 0; i < 4; i++)
+    choker.addTorrent(false);
+
+  // The round yields after every torrent; stop() lands in between.
+  bool finished = false;
+  btc::net::co_spawn(
+      ctx,
+      [&]() -> btc::net::awaitable<void> {
+        co_await choker.run();
+        finished = true;
+      },
+      btc::net::detached);
+  btc::net::post(ctx, [&] { choker.stop(); });
+  ctx.run_for(std::chrono::seconds(5));
+  EXPECT_TRUE(finished);
+}
+
+TEST(PiecePicker, RarestFirstPartialFirstAndEndgame) {
+  // Eight pieces of two 16 KiB blocks; the last piece is 6000 bytes short.
+  const std::size_t piece = 32 * 1024;
+  btc::PiecePicker picker(8, piece, 8 * piece - 6000);
+  picker.setRandomFirst(0);
+
+  bitfield all(8, true);
+  bitfield low = makeBits(8, {0, 1, 2, 3});
+  bitfield two = makeBits(8, {0, 1});
+  picker.addSeed();
+  picker.addPeer(low);
+  picker.addPeer(two);
+  EXPECT_EQ(picker.getAvailability(0), 3u);
+  EXPECT_EQ(picker.getAvailability(3), 2u);
+  EXPECT_EQ(picker.getAvailability(7), 1u);
+
+  // Only the full peer has pieces 4 to 7; with have messages piece 5 and 6
+  // become common, so 4 or 7 comes first, and whole.
+  picker.incrementPiece(5);
+  picker.incrementPiece(5);
+  picker.incrementPiece(6);
+  picker.incrementPiece(6);
+  std::vector<blockRequest> out;
+  ASSERT_EQ(picker.pick(all, 2, out), 2u);
+  std::uint32_t first = out[0].piece;
+  EXPECT_TRUE(first == 4 || first == 7);
+  EXPECT_EQ(out[1].piece, first);
+  EXPECT_EQ(out[1].offset, 16384u);
+  EXPECT_EQ(out[1].length, first == 7 ? 16384u - 6000 : 16384u);
+
+  // A dropped request is handed out again before any new piece is started.
+  picker.abort(out[1]);
+  out.clear();
+  ASSERT_EQ(picker.pick(all, 1, out), 1u);
+  EXPECT_EQ(out[0].piece, first);
+  EXPECT_EQ(out[0].offset, 16384u);
+
+  // The peer with pieces 0 to 3 gets the rarer 2 and 3 before 0 and 1.
+  out.clear();
+  ASSERT_EQ(picker.pick(low, 4, out), 4u);
+  for (const auto &block : out)
+    EXPECT_TRUE(block.piece == 2 || block.piece == 3);
+
+  // Completing a piece.
+  EXPECT_FALSE(picker.received({first, 0, 16384}));
+  EXPECT_TRUE(picker.received({first, 16384, 16384}));
+  picker.setHave(first);
+  EXPECT_TRUE(picker.isHave(first));
+  EXPECT_EQ(picker.getHaveCount(), 1u);
+  EXPECT_EQ(picker.getDownloadingCount(), 2u);
+
+  // A failed piece is downloaded again.
+  ASSERT_EQ(out[0].piece, out[1].piece);
+  picker.received(out[0]);
+  picker.received(out[1]);
+  picker.pieceFailed(out[0].piece);
+  std::vector<blockRequest> again;
+  ASSERT_EQ(picker.pick(two, 2, again), 2u);
+  EXPECT_EQ(again[0].piece, again[1].piece);
+  EXPECT_TRUE(again[0].piece == 0 || again[0].piece == 1);
+  again.clear();
+  ASSERT_EQ(picker.pick(low, 2, again), 2u);
+  EXPECT_EQ(again[0].piece, out[0].piece);
+}
+
+TEST(PiecePicker, PeersWithOnlyCommonPiecesSkipTheRareOnes) {
+  // One-block pieces; the rarest 4000 are all with one other peer, and the
+  // peer picking for has only the last 96, which three peers share.
+  const std::size_t pieces = 4096;
+  btc::PiecePicker picker(pieces, 16384, pieces * 16384);
+  picker.setRandomFirst(0);
+  bitfield rare(pieces), common(pieces);
+  for (std::size_t i = 0; i < pieces; i++) {
+    if (i < 4000)
+      rare.set(i);
+    else
+      common.set(i);
+  }
+  picker.addPeer(rare);
+  for (int i = 0; i < 3; i++)
+    picker.addPeer(common);
+
+  std::vector<blockRequest> out;
+  for (std::size_t i = 0; i < 96; i++)
+    ASSERT_EQ(picker.pick(common, 1, out), 1u);
+  EXPECT_EQ(picker.pick(common, 1, out), 0u);
+  std::vector<bool> seen(pieces);
+  for (const auto &block : out) {
+    ASSERT_GE(block.piece, 4000u);
+    EXPECT_FALSE(seen[block.piece]);
+    seen[block.piece] = true;
+  }
+
+  // The other peer is still served from the rarest bucket.
+  out.clear();
+  ASSERT_EQ(picker.pick(rare, 1, out), 1u);
+  EXPECT_LT(out[0].piece, 4000u);
+  EXPECT_EQ(picker.getAvailability(out[0].piece), 1u);
+}
+
+TEST(PiecePicker, EndgameDuplicatesUpToTheCap) {
+  btc::PiecePicker picker(2, 16384, 2 * 16384);
+  picker.setEndgameDuplicates(2);
+  bitfield all(2, true);
+  picker.addPeer(all);
+  picker.addSeed();
+
+  std::vector<blockRequest> first;
+  ASSERT_EQ(picker.pick(all, 8, first), 2u);
+  EXPECT_TRUE(picker.isEndgame());
+
+  // A second peer gets both blocks again, the first peer nothing more.
+  auto askedOf = [&](const std::vector<blockRequest> &blocks) {
+    return [&](const blockRequest &block) {
+      return std::find(blocks.begin(), blocks.end(), block) != blocks.end();
+    };
+  };
+  std::vector<blockRequest> out;
+  EXPECT_EQ(picker.pick(all, 8, out, askedOf(first)), 0u);
+  std::vector<blockRequest> second;
+  EXPECT_EQ(picker.pick(all, 8, second, askedOf(second)), 2u);
+  std::vector<blockRequest> third;
+  EXPECT_EQ(picker.pick(all, 8, third, askedOf(third)), 0u);
+
+  EXPECT_TRUE(picker.received(first[0]));
+  EXPECT_FALSE(picker.received(second[0]));
+  picker.setHave(first[0].piece);
+  picker.abort(first[1]);
+  EXPECT_TRUE(picker.received(second[1]));
+  picker.setHave(second[1].piece);
+  EXPECT_TRUE(picker.isComplete());
+  EXPECT_FALSE(picker.isEndgame());
+}
@@ -0,0 +1,646 @@
+#include <Bencode/bencodeDecoder.h>
+#include <Crypto/sha1.h>
+#include <Storage/diskIo.h>
+#include <Storage/diskStorage.h>
+#include <Storage/fileMap.h>
+#include <Storage/pieceVerifier.h>
+#include <Storage/readCache.h>
+#include <Storage/resumeData.h>
+#include <Storage/uringDiskIo.h>
+#include <Storage/writeCache.h>
+#include <Torrent/torrentParser.h>
+#include <bufferPool.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <latch>
+#include <openssl/sha.h>
+#include <string>
+#include <threadPool.h>
+#include <vector>
+
+using sha1 = btc::Sha1;
+using pieceVerifier = btc::PieceVerifier;
+using torrentParser = btc::TorrentParser;
+using bencodeDecoder = btc::BencodeDecoder;
+
+#define ASSERT_OK(expr) ASSERT_TRUE((expr).has_value())
+
+namespace {
+
+std::string makeData(std::size_t size, unsigned seed) {
+  std::string out(size, '\0');
+  for (std::size_t i = 0; i < size; i++)
+    out[i] = static_cast<char>((i * 131 + seed * 7 + (i >> 9)) & 0xFF);
+  return out;
+}
+
+std::string opensslHash(std::string_view data) {
+  unsigned char hash[20];
+  SHA1(reinterpret_cast<const unsigned char *>(data.data()), data.size(),
+       hash);
+  return std::string(reinterpret_cast<char *>(hash), 20);
+}
+
+} // namespace
+
+TEST(Sha1, AllImplementationsMatchOpenssl) {
+  std::vector<std::string> data;
+  for (std::size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 16385})
+    data.push_back(makeData(size, static_cast<unsigned>(size)));
+  for (unsigned i = 0; i < 11; i++)
+    data.push_back(makeData(4096, i));
+  std::vector<std::string_view> inputs(data.begin(), data.end());
+
+  sha1::Isa detected = sha1::getIsa();
+  for (auto isa : {sha1::Isa::openssl, sha1::Isa::shaNi, sha1::Isa::avx2}) {
+    if (!sha1::setIsa(isa))
+      continue;
+    std::vector<sha1::digest_t> digests(inputs.size());
+    sha1::hashMany(inputs, digests);
+    for (std::size_t i = 0; i < inputs.size(); i++) {
+      std::string expected = opensslHash(inputs[i]);
+      EXPECT_EQ(std::string(digests[i].begin(), digests[i].end()), expected)
+          << "isa " << static_cast<int>(isa) << " input " << i;
+      auto single = sha1::hash(inputs[i]);
+      EXPECT_EQ(std::string(single.begin(), single.end()), expected);
+    }
+  }
+  sha1::setIsa(detected);
+}
+
+namespace {
+
+const std::size_t pieceLength = 16384;
+
+std::vector<std::string> torrentFiles() {
+  return {makeData(40000, 1), makeData(5, 2), makeData(100000, 3),
+          makeData(30000, 4)};
+}
+
+// Four files (40000, 5, 100000 and 30000 bytes, i.e. 11 pieces) written
+// under `root`/test; returns the matching metainfo.
+std::string writeTorrentData(const std::filesystem::path &root) {
+  std::vector<std::string> files = torrentFiles();
+  std::string all;
+  for (const auto &file : files)
+    all += file;
+
+  std::string pieces;
+  for (std::size_t offset = 0; offset < all.size(); offset += pieceLength)
+    pieces += opensslHash(std::string_view(all).substr(offset, pieceLength));
+
+  std::string content = "d8:announce15:http://a.b/anno4:infod5:filesl";
+  for (std::size_t i = 0; i < files.size(); i++)
+    content += "d6:lengthi" + std::to_string(files[i].size()) + "e4:pathl" +
+               "5:file" + std::to_string(i) + "ee";
+  content += "e4:name4:test12:piece lengthi" + std::to_string(pieceLength) +
+             "e6:pieces" + std::to_string(pieces.size()) + ":" + pieces + "ee";
+
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root / "test");
+  for (std::size_t i = 0; i < files.size(); i++)
+    std::ofstream(root / "test" / ("file" + std::to_string(i)),
+                  std::ios::binary)
+        << files[i];
+  return content;
+}
+
+// Overwrites one byte without changing the file size.
+void corrupt(const std::filesystem::path &path, std::size_t offset) {
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(static_cast<std::streamoff>(offset));
+  file.put('\x7F');
+}
+
+} // namespace
+
+TEST(PieceVerifier, VerifyMultiFileTorrent) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_verify_test";
+  std::string content = writeTorrentData(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+
+  btc::ThreadPool pool(3);
+  std::size_t progress = 0;
+  auto valid = pieceVerifier::verify(
+      *torrentRes, root, pool,
+      [&](std::size_t done, std::size_t total) {
+        EXPECT_EQ(total, torrentRes->getPieces().size());
+        progress = done;
+      });
+  ASSERT_EQ(valid.size(), torrentRes->getPieces().size());
+  ASSERT_EQ(progress, valid.size());
+  for (bool piece : valid)
+    EXPECT_TRUE(piece);
+
+  // From the only worker of a pool, the batches are hashed on that thread.
+  btc::ThreadPool single(1);
+  std::latch nested(1);
+  std::vector<bool> nestedValid;
+  single.submit([&] {
+    nestedValid = pieceVerifier::verify(*torrentRes, root, single);
+    nested.count_down();
+  });
+  nested.wait();
+  EXPECT_EQ(nestedValid, valid);
+
+  // Corrupt a byte of piece 6 (in file2) and drop file3 (pieces 8 to 10;
+  // piece 8 also covers the end of file2).
+  corrupt(root / "test" / "file2", 6 * pieceLength + 10 - 40005);
+  std::filesystem::remove(root / "test" / "file3");
+
+  valid = pieceVerifier::verify(*torrentRes, root, pool);
+  std::filesystem::remove_all(root);
+  for (std::size_t i = 0; i < valid.size(); i++)
+    EXPECT_EQ(valid[i], i != 6 && i < 8) << "piece " << i;
+}
+
+TEST(PieceVerifier, ResumeSkipsUnchangedFiles) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_resume_test";
+  std::string content = writeTorrentData(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+
+  btc::ThreadPool pool(2);
+  auto valid = pieceVerifier::verify(*torrentRes, root, pool);
+  valid[3] = false;
+  auto resume = btc::ResumeData::capture(*torrentRes, root, valid);
+  ASSERT_TRUE(resume.save(root));
+
+  // A save that cannot be renamed into place leaves no temporary file.
+  std::filesystem::path blocked =
+      btc::ResumeData::pathFor(root / "blocked", torrentRes->getInfoHash());
+  std::filesystem::create_directories(blocked / "entry");
+  ASSERT_FALSE(resume.save(root / "blocked"));
+  std::filesystem::path temp = blocked;
+  temp += ".tmp";
+  ASSERT_FALSE(std::filesystem::exists(temp));
+  std::filesystem::remove_all(root / "blocked");
+
+  auto loadedRes = btc::ResumeData::load(root, torrentRes->getInfoHash());
+  ASSERT_OK(loadedRes);
+  ASSERT_EQ(loadedRes->encode(), resume.encode());
+  ASSERT_EQ(loadedRes->getPieces(), valid);
+  ASSERT_EQ(loadedRes->getFiles().size(), 4u);
+
+  // Nothing changed: no piece is hashed and the recorded state is kept.
+  std::size_t hashed = 0;
+  auto onProgress = [&](std::size_t, std::size_t total) { hashed = total; };
+  auto resumed = pieceVerifier::verify(*torrentRes, root, pool, *loadedRes,
+                                       onProgress);
+  ASSERT_EQ(hashed, 0u);
+  ASSERT_EQ(resumed, valid);
+
+  // Corrupting file0 with its size and mtime preserved goes unnoticed, as
+  // intended; touching file3 rehashes only the pieces it covers (8 to 10).
+  auto file0 = root / "test" / "file0";
+  auto mtime = std::filesystem::last_write_time(file0);
+  corrupt(file0, 100);
+  std::filesystem::last_write_time(file0, mtime);
+  std::filesystem::last_write_time(root / "test" / "file3",
+                                   mtime + std::chrono::seconds(5));
+
+  resumed = pieceVerifier::verify(*torrentRes, root, pool, *loadedRes,
+                                  onProgress);
+  ASSERT_EQ(hashed, 3u);
+  ASSERT_EQ(resumed, valid);
+
+  auto missingRes = btc::ResumeData::load(root, std::string(20, 'z'));
+  ASSERT_FALSE(missingRes);
+  auto badRes = btc::ResumeData::decode("d7:versioni1ee");
+  ASSERT_FALSE(badRes);
+  ASSERT_EQ(badRes.error(), btc::error_code::invalidResumeDataErr);
+  std::filesystem::remove_all(root);
+}
+
+TEST(FileMap, MapsBlocksToFileSegments) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_filemap_test";
+  std::string content = writeTorrentData(root);
+  std::filesystem::remove_all(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+
+  btc::FileMap files(*torrentRes);
+  ASSERT_EQ(files.getFileCount(), 4u);
+  ASSERT_EQ(files.getTotalLength(), 170005u);
+  ASSERT_EQ(files.getPieceCount(), 11u);
+  ASSERT_EQ(files.getPieceSize(10), 170005u - 10 * pieceLength);
+  ASSERT_EQ(files.getFileOffset(2), 40005u);
+  ASSERT_EQ(files.fileAt(40004), 1u);
+  ASSERT_EQ(files.fileAt(40005), 2u);
+  ASSERT_EQ(files.getPath(3, root), root / "test" / "file3");
+
+  // Piece 2 starts in file0 and crosses the 5-byte file1 into file2.
+  ASSERT_EQ(files.getFirstFile(2), 0u);
+  ASSERT_EQ(files.getLastFile(2), 2u);
+  auto segments = files.map(2, 0, pieceLength);
+  ASSERT_EQ(segments.size(), 3u);
+  EXPECT_EQ(segments[0].file, 0u);
+  EXPECT_EQ(segments[0].offset, 2 * pieceLength);
+  EXPECT_EQ(segments[0].length, 40000 - 2 * pieceLength);
+  EXPECT_EQ(segments[1].file, 1u);
+  EXPECT_EQ(segments[1].offset, 0u);
+  EXPECT_EQ(segments[1].length, 5u);
+  EXPECT_EQ(segments[2].file, 2u);
+  EXPECT_EQ(segments[2].offset, 0u);
+  EXPECT_EQ(segments[2].length, 3 * pieceLength - 40005);
+
+  // A block in the middle of a piece only touches the file holding it.
+  segments = files.map(2, 16000, 100);
+  ASSERT_EQ(segments.size(), 1u);
+  EXPECT_EQ(segments[0].file, 2u);
+  EXPECT_EQ(segments[0].offset, 2 * pieceLength + 16000 - 40005);
+
+  ASSERT_EQ(files.getFirstFile(6), 2u);
+  ASSERT_EQ(files.getLastFile(6), 2u);
+  ASSERT_EQ(files.getFirstFile(10), 3u);
+}
+
+TEST(DiskStorage, WriteAndReadAcrossFiles) {
+  std::filesystem::path source =
+      std::filesystem::temp_directory_path() / "btc_storage_source";
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_storage_test";
+  std::string content = writeTorrentData(source);
+  std::filesystem::remove_all(source);
+  std::filesystem::remove_all(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+
+  auto storageRes = btc::DiskStorage::open(*torrentRes, root,
+                                           btc::Allocation::sparse, 2);
+  ASSERT_OK(storageRes);
+  ASSERT_EQ(std::filesystem::file_size(root / "test" / "file2"), 100000u);
+
+  std::string all;
+  for (const auto &file : torrentFiles())
+    all += file;
+
+  // Each piece goes out as blocks of two buffers; piece 2 crosses three
+  // files and the 5-byte file1 lies entirely inside one block.
+  const btc::FileMap &files = storageRes->getFileMap();
+  for (std::size_t piece = 0; piece < files.getPieceCount(); piece++) {
+    std::size_t size = files.getPieceSize(piece);
+    for (std::size_t offset = 0; offset < size; offset += 6000) {
+      std::size_t length = std::min<std::size_t>(6000, size - offset);
+      std::string_view block =
+          std::string_view(all).substr(piece * pieceLength + offset, length);
+      std::size_t split = std::min<std::size_t>(1000, length);
+      std::string_view parts[] = {block.substr(0, split),
+                                  block.substr(split)};
+      ASSERT_OK(storageRes->write(piece, offset, parts));
+    }
+  }
+  ASSERT_LE(storageRes->getOpenFiles(), 2u);
+
+  btc::ThreadPool pool(2);
+  for (bool piece : pieceVerifier::verify(*torrentRes, root, pool))
+    EXPECT_TRUE(piece);
+
+  std::string head(10, '\0');
+  std::string tail(pieceLength * 2, '\0');
+  std::span<char> parts[] = {head, tail};
+  ASSERT_OK(storageRes->read(2, 100, parts));
+  ASSERT_EQ(head + tail, all.substr(2 * pieceLength + 100, head.size() +
+                                                             tail.size()));
+
+  auto rangeRes = storageRes->read(10, 0, std::span<char>(tail));
+  ASSERT_FALSE(rangeRes);
+  ASSERT_EQ(rangeRes.error(), btc::error_code::invalidBlockRangeErr);
+  rangeRes = storageRes->read(0, SIZE_MAX - 10, std::span<char>(head));
+  ASSERT_FALSE(rangeRes);
+
+  // Piece 0 lies in file0 only; an offset reaching into file2 still lands
+  // there, and file0 keeps its size.
+  std::string patch(100, 'p');
+  ASSERT_OK(storageRes->write(0, 50000, patch));
+  ASSERT_EQ(std::filesystem::file_size(root / "test" / "file0"), 40000u);
+  std::string back(100, '\0');
+  ASSERT_OK(storageRes->read(3, 50000 - 3 * pieceLength, back));
+  ASSERT_EQ(back, patch);
+  std::filesystem::remove_all(root);
+
+  std::string unsafe = "d8:announce15:http://a.b/anno4:infod5:filesl"
+                       "d6:lengthi5e4:pathl2:..6:escapeee"
+                       "e4:name4:test12:piece lengthi16384e6:pieces20:" +
+                       std::string(20, 'x') + "ee";
+  auto unsafeRes = torrentParser::parseContent(unsafe, decoder);
+  ASSERT_FALSE(unsafeRes);
+  ASSERT_EQ(unsafeRes.error(), btc::error_code::unsafeFilePathErr);
+}
+
+TEST(DiskIo, AsyncWriteAndReadOnEachBackend) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_diskio_test";
+  std::string content = writeTorrentData(root);
+  std::filesystem::remove_all(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+
+  std::string all;
+  for (const auto &file : torrentFiles())
+    all += file;
+
+  btc::ThreadPool pool(2);
+  for (auto backend : {btc::DiskBackend::threadPool,
+                       btc::DiskBackend::ioUring}) {
+    auto storageRes = btc::DiskStorage::open(*torrentRes, root);
+    ASSERT_OK(storageRes);
+
+    btc::net::io_context ctx;
+    std::unique_ptr<btc::DiskIo> io;
+    if (backend == btc::DiskBackend::threadPool) {
+      io = std::make_unique<btc::ThreadPoolDiskIo>(ctx, *storageRes, pool);
+    } else {
+      auto uringRes = btc::UringDiskIo::create(ctx, *storageRes, 8);
+      if (!uringRes)
+        continue;
+      // Writes come from a registered buffer, reads go to a plain one.
+      std::span<char> buffers[] = {all};
+      ASSERT_TRUE((*uringRes)->registerBuffers(buffers));
+      io = std::move(*uringRes);
+    }
+    ASSERT_EQ(io->getBackend(), backend);
+
+    // More blocks than the 8-entry ring holds, some crossing files.
+    const btc::FileMap &files = storageRes->getFileMap();
+    std::size_t completed = 0;
+    for (std::size_t piece = 0; piece < files.getPieceCount(); piece++) {
+      std::size_t size = files.getPieceSize(piece);
+      for (std::size_t offset = 0; offset < size; offset += 6000) {
+        std::size_t length = std::min<std::size_t>(6000, size - offset);
+        io->asyncWrite(piece, offset,
+                       std::span<const char>(all).subspan(
+                           piece * pieceLength + offset, length),
+                       [&](auto res) {
+                         EXPECT_TRUE(res.has_value());
+                         completed++;
+                       });
+      }
+    }
+    io->asyncWrite(10, 0, std::span<const char>(all).first(pieceLength),
+                   [&](auto res) {
+                     ASSERT_FALSE(res);
+                     EXPECT_EQ(res.error(),
+                               btc::error_code::invalidBlockRangeErr);
+                     completed++;
+                   });
+    io->submit();
+    ctx.run();
+    ASSERT_EQ(completed, 33u);
+
+    for (bool piece : pieceVerifier::verify(*torrentRes, root, pool))
+      EXPECT_TRUE(piece);
+
+    std::string back(all.size(), '\0');
+    bool read = false;
+    io->asyncRead(0, 0, back, [&](auto res) { read = res.has_value(); });
+    io->submit();
+    ctx.restart();
+    ctx.run();
+    EXPECT_TRUE(read) << "backend " << static_cast<int>(backend);
+    EXPECT_EQ(back, all);
+
+    io.reset();
+    std::filesystem::remove_all(root);
+  }
+}
+
+TEST(WriteCache, VerifiesPiecesAndSpillsOnEviction) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_write_cache_test";
+  std::string content = writeTorrentData(root);
+  std::filesystem::remove_all(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+  auto storageRes = btc::DiskStorage::open(*torrentRes, root);
+  ASSERT_OK(storageRes);
+
+  std::string all;
+  for (const auto &file : torrentFiles())
+    all += file;
+  auto block = [&](std::size_t piece, std::size_t index) {
+    std::size_t offset = piece * pieceLength + index * 4096;
+    return std::string_view(all).substr(offset, 4096);
+  };
+
+  // Room for two pieces, in 4 KiB blocks.
+  btc::WriteCache cache(*storageRes, *torrentRes, 2 * pieceLength, 4096);
+  using status = btc::BlockStatus;
+
+  // Pieces 0 and 1 are half written, then piece 2 evicts piece 0.
+  for (std::size_t piece : {0, 1})
+    for (std::size_t i : {0, 1})
+      ASSERT_EQ(*cache.write(piece, i * 4096, block(piece, i)),
+                status::stored);
+  for (std::size_t i : {0, 1, 2})
+    ASSERT_EQ(*cache.write(2, i * 4096, block(2, i)), status::stored);
+  ASSERT_EQ(cache.getCachedPieces(), 2u);
+  ASSERT_EQ(cache.getMemoryUsage(), 2 * pieceLength);
+
+  // Piece 2 completes in memory; piece 0 is finished from its spilled blocks.
+  ASSERT_EQ(*cache.write(2, 3 * 4096, block(2, 3)), status::pieceVerified);
+  std::string copy(100, '\0');
+  ASSERT_TRUE(cache.read(2, 5000, copy));
+  ASSERT_EQ(copy, all.substr(2 * pieceLength + 5000, 100));
+  ASSERT_FALSE(cache.read(1, 0, copy));
+
+  for (std::size_t i : {2, 3})
+    ASSERT_TRUE(cache.write(0, i * 4096, block(0, i)));
+  ASSERT_EQ(cache.getCachedPieces(), 2u);
+
+  // A bad block fails its piece, which never reaches the disk.
+  std::string bad(block(1, 2));
+  bad[7] ^= 1;
+  ASSERT_EQ(*cache.write(1, 2 * 4096, bad), status::stored);
+  ASSERT_EQ(*cache.write(1, 3 * 4096, block(1, 3)), status::pieceFailed);
+  ASSERT_EQ(cache.getCachedPieces(), 1u);
+
+  // The last piece is 6165 bytes: a short final block.
+  auto shortRes = cache.write(10, 4096, block(10, 1).substr(0, 100));
+  ASSERT_FALSE(shortRes);
+  ASSERT_EQ(shortRes.error(), btc::error_code::invalidBlockRangeErr);
+  // Blocks past the end of their piece, though still inside the torrent.
+  auto pastRes = cache.write(0, pieceLength, block(1, 0));
+  ASSERT_FALSE(pastRes);
+  ASSERT_EQ(pastRes.error(), btc::error_code::invalidBlockRangeErr);
+  ASSERT_FALSE(cache.write(3, 3 * pieceLength, block(6, 0)));
+  for (std::size_t i : {0, 1}) {
+    std::string_view data = block(10, i).substr(0, i == 0 ? 4096 : 2069);
+    ASSERT_TRUE(cache.write(10, i * 4096, data));
+  }
+  ASSERT_OK(cache.flushAll());
+  ASSERT_EQ(cache.getMemoryUsage(), 0u);
+
+  btc::ThreadPool pool(2);
+  auto valid = pieceVerifier::verify(*torrentRes, root, pool);
+  for (std::size_t i = 0; i < valid.size(); i++)
+    EXPECT_EQ(valid[i], i == 0 || i == 2 || i == 10) << "piece " << i;
+  std::filesystem::remove_all(root);
+}
+
+TEST(ReadCache, ServesBlocksAndResistsScans) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "btc_read_cache_test";
+  std::string content = writeTorrentData(root);
+
+  bencodeDecoder decoder;
+  auto torrentRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(torrentRes);
+  auto storageRes = btc::DiskStorage::open(*torrentRes, root);
+  ASSERT_OK(storageRes);
+  const std::string &infoHash = torrentRes->getInfoHash();
+
+  std::string all;
+  for (const auto &file : torrentFiles())
+    all += file;
+
+  // Room for three whole pieces.
+  btc::ReadCache cache(3 * pieceLength);
+  std::string block(4096, '\0');
+  auto read = [&](std::size_t piece, std::size_t offset) {
+    ASSERT_OK(cache.read(infoHash, *storageRes, piece, offset, block));
+    ASSERT_EQ(block, all.substr(piece * pieceLength + offset, block.size()));
+  };
+
+  // The first block loads piece 0, the next three are served from memory.
+  for (std::size_t offset = 0; offset < pieceLength; offset += 4096)
+    read(0, offset);
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.hits, 3u);
+  EXPECT_EQ(cache.getMemoryUsage(), pieceLength);
+
+  // Going back to the start of piece 0 marks it as reused; a block crossing
+  // into the next piece loads both.
+  read(0, 0);
+  read(1, pieceLength - 100);
+  EXPECT_EQ(cache.getStats().misses, 3u);
+
+  // A sequential pass over the rest of the torrent keeps piece 0.
+  for (std::size_t piece = 3; piece < 10; piece++)
+    for (std::size_t offset = 0; offset < pieceLength; offset += 4096)
+      read(piece, offset);
+  EXPECT_LE(cache.getMemoryUsage(), cache.getBudget());
+  stats = cache.getStats();
+  read(0, 8192);
+  EXPECT_EQ(cache.getStats().hits, stats.hits + 1);
+
+  cache.invalidate(infoHash, 0);
+  read(0, 8192);
+  EXPECT_EQ(cache.getStats().misses, stats.misses + 1);
+
+  cache.erase(infoHash);
+  EXPECT_EQ(cache.getMemoryUsage(), 0u);
+  read(0, 8192);
+  EXPECT_EQ(cache.getStats().misses, stats.misses + 2);
+
+  // Windows smaller than a piece.
+  btc::ReadCache small(pieceLength, 8192);
+  ASSERT_OK(small.read(infoHash, *storageRes, 4, 6000, block));
+  ASSERT_EQ(block, all.substr(4 * pieceLength + 6000, block.size()));
+  EXPECT_EQ(small.getStats().misses, 2u);
+  EXPECT_EQ(small.getMemoryUsage(), pieceLength);
+
+  auto rangeRes = cache.read(infoHash, *storageRes, 10, 6000, block);
+  ASSERT_FALSE(rangeRes);
+  ASSERT_EQ(rangeRes.error(), btc::error_code::invalidBlockRangeErr);
+  std::filesystem::remove_all(root);
+}
+
+TEST(BufferPool, SharesAndRecyclesAlignedBuffers) {
+  btc::BufferPool pool(16 * 1024, 3);
+  auto first = pool.acquire();
+  ASSERT_OK(first);
+  EXPECT_EQ(first->size(), 16u * 1024);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(first->data()) %
+                btc::BufferPool::pageSize,
+            0u);
+
+  // A copy shares the buffer; the pool gets it back with the last handle.
+  btc::Buffer copy = *first;
+  EXPECT_EQ(copy.data(), first->data());
+  EXPECT_EQ(copy.useCount(), 2u);
+  char *data = first->data();
+  *first = btc::Buffer();
+  EXPECT_EQ(pool.getStats().inUse, 1u);
+  copy = btc::Buffer();
+  EXPECT_EQ(pool.getStats().inUse, 0u);
+
+  std::vector<btc::Buffer> held;
+  for (int i = 0; i < 3; i++)
+    held.push_back(*pool.acquire());
+  EXPECT_EQ(held.front().data(), data);
+  auto exhausted = pool.acquire();
+  ASSERT_FALSE(exhausted);
+  ASSERT_EQ(exhausted.error(), btc::error_code::bufferPoolExhaustedErr);
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(stats.capacity, 3u);
+  EXPECT_EQ(stats.inUse, 3u);
+  EXPECT_EQ(stats.peakInUse, 3u);
+  held.clear();
+
+  // Several threads acquiring and releasing at once share one slab.
+  btc::BufferPool shared(4096, 1024);
+  btc::ThreadPool workers(4);
+  std::latch done(4);
+  for (int t = 0; t < 4; t++)
+    workers.submit([&] {
+      std::vector<btc::Buffer> local;
+      for (int i = 0; i < 1000; i++) {
+        auto buffer = shared.acquire();
+        EXPECT_TRUE(buffer.has_value());
+        buffer->data()[0] = static_cast<char>(i);
+        local.push_back(std::move(*buffer));
+        if (local.size() == 4)
+          local.clear();
+      }
+      done.count_down();
+    });
+  done.wait();
+  EXPECT_EQ(shared.getStats().inUse, 0u);
+  EXPECT_LE(shared.getStats().capacity, btc::BufferPool::buffersPerSlab);
+
+  // With exactly as many buffers as the threads ever hold together, none
+  // of them is told the pool is exhausted.
+  btc::BufferPool tight(4096, 8);
+  std::atomic<int> failures = 0;
+  std::latch tightDone(4);
+  for (int t = 0; t < 4; t++)
+    workers.submit([&] {
+      std::vector<btc::Buffer> local;
+      for (int i = 0; i < 20000; i++) {
+        auto buffer = tight.acquire();
+        if (!buffer) {
+          failures++;
+          continue;
+        }
+        local.push_back(std::move(*buffer));
+        if (local.size() == 2)
+          local.clear();
+      }
+      tightDone.count_down();
+    });
+  tightDone.wait();
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(tight.getStats().inUse, 0u);
+}
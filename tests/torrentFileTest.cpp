@@ -1,10 +1,17 @@
 #include <Bencode/bencodeDecoder.h>
 #include <Bencode/bencodeEncoder.h>
 #include <Torrent/torrentFile.h>
+#include <Torrent/torrentLoader.h>
 #include <Torrent/torrentParser.h>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <latch>
+#include <openssl/sha.h>
 #include <string>
+#include <threadPool.h>
+#include <vector>
 
 using torrentParser = btc::TorrentParser;
 using torrentFile = btc::TorrentFile;
@@ -62,3 +69,219 @@ TEST(TorrentFile, parseValidTorrentFile) {
       file.getFiles()->back().path.string(),
       "[Sotark] Naruto Shippuden - 500 [720p][HEVC][x265][Dual-Audio].mkv");
 }
+
+TEST(TorrentFile, infoHashCoversRawInfoBytes) {
+  // The info keys are deliberately out of canonical order: re-encoding the
+  // decoded dictionary would sort them and hash different bytes.
+  std::string info = "d4:name4:test6:lengthi5e12:piece lengthi16384e"
+                     "6:pieces20:" +
+                     std::string(20, 'x') + "e";
+  std::string content = "d8:announce15:http://a.b/anno4:info" + info + "e";
+
+  bencodeDecoder decoder;
+  auto fileRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(fileRes);
+
+  unsigned char hash[20];
+  SHA1(reinterpret_cast<const unsigned char *>(info.data()), info.size(),
+       hash);
+  ASSERT_EQ(fileRes->getInfoHash(),
+            std::string(reinterpret_cast<char *>(hash), 20));
+
+  auto reencoded = btc::BencodeEncoder::encode(*decoder.decode(info));
+  ASSERT_NE(reencoded, info);
+}
+
+TEST(TorrentFile, parseFileFromMapping) {
+  std::string content = "d8:announce15:http://a.b/anno4:infod6:lengthi5e"
+                        "4:name4:test12:piece lengthi16384e6:pieces20:" +
+                        std::string(20, 'x') + "ee";
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "btc_mapped_test.torrent";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << content << '\n';
+  }
+
+  bencodeDecoder decoder;
+  auto fileRes = torrentParser::parseFile(path, decoder);
+  auto contentRes = torrentParser::parseContent(content, decoder);
+  std::filesystem::remove(path);
+  ASSERT_OK(fileRes);
+  ASSERT_OK(contentRes);
+  ASSERT_EQ(fileRes->getInfoHash(), contentRes->getInfoHash());
+  ASSERT_EQ(fileRes->getName(), "test");
+
+  auto missingRes = torrentParser::parseFile(path, decoder);
+  ASSERT_FALSE(missingRes);
+  ASSERT_EQ(missingRes.error(), btc::error_code::errorOpeningFileErr);
+}
+
+TEST(TorrentFile, loadDirectoryInStableOrder) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "btc_loader_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  auto makeTorrent = [](std::string name) {
+    return "d8:announce15:http://a.b/anno4:infod6:lengthi5e4:name" +
+           std::to_string(name.size()) + ":" + name +
+           "12:piece lengthi16384e6:pieces20:" + std::string(20, 'x') + "ee";
+  };
+  for (int i = 0; i < 40; i++) {
+    std::ofstream out(dir / ("t" + std::to_string(100 + i) + ".torrent"));
+    if (i == 7)
+      out << "d8:announcee";
+    else
+      out << makeTorrent("file" + std::to_string(i));
+  }
+  std::ofstream(dir / "notes.txt") << "ignored";
+
+  btc::ThreadPool pool(4);
+  std::size_t lastDone = 0;
+  auto loadedRes = btc::TorrentLoader::loadDirectory(
+      dir, pool, [&](std::size_t done, std::size_t total) {
+        EXPECT_EQ(total, 40u);
+        EXPECT_EQ(done, lastDone + 1);
+        lastDone = done;
+      });
+
+  // On the pool's only worker, the files are parsed there instead of
+  // waiting for tasks that worker would have to run.
+  btc::ThreadPool single(1);
+  std::latch nested(1);
+  std::size_t nestedCount = 0;
+  single.submit([&] {
+    auto nestedRes = btc::TorrentLoader::loadDirectory(dir, single);
+    if (nestedRes)
+      nestedCount = nestedRes->size();
+    nested.count_down();
+  });
+  nested.wait();
+  EXPECT_EQ(nestedCount, 40u);
+  std::filesystem::remove_all(dir);
+
+  ASSERT_OK(loadedRes);
+  ASSERT_EQ(loadedRes->size(), 40u);
+  ASSERT_EQ(lastDone, 40u);
+  for (int i = 0; i < 40; i++) {
+    const auto &loaded = (*loadedRes)[i];
+    ASSERT_EQ(loaded.path.filename(),
+              "t" + std::to_string(100 + i) + ".torrent");
+    if (i == 7) {
+      ASSERT_FALSE(loaded.torrent);
+      continue;
+    }
+    ASSERT_OK(loaded.torrent);
+    ASSERT_EQ(loaded.torrent->getName(), "file" + std::to_string(i));
+  }
+
+  auto missingRes = btc::TorrentLoader::loadDirectory(dir, pool);
+  ASSERT_FALSE(missingRes);
+}
+
+TEST(TorrentFile, pieceHashTable) {
+  bencodeDecoder decoder;
+  auto fileRes = torrentParser::parseFile(TEST_PATH, decoder);
+  ASSERT_OK(fileRes);
+
+  const btc::PieceHashes &pieces = fileRes->getPieces();
+  std::size_t pieceLength = fileRes->getPieceLength();
+  ASSERT_EQ(pieces.size(),
+            (fileRes->getTotalLength() + pieceLength - 1) / pieceLength);
+  ASSERT_EQ(pieces.getRaw().size(), pieces.size() * 20);
+
+  auto last = pieces.hash(pieces.size() - 1);
+  ASSERT_EQ(std::string_view(reinterpret_cast<const char *>(last.data()), 20),
+            pieces.getRaw().substr(pieces.getRaw().size() - 20));
+
+  // Copies share the table instead of duplicating it.
+  btc::TorrentFile copy = *fileRes;
+  ASSERT_EQ(copy.getPieces().hash(0).data(), pieces.hash(0).data());
+
+  auto torrent = [](std::string pieces, std::string length) {
+    return "d8:announce15:http://a.b/anno4:infod6:lengthi" + length +
+           "e4:name4:test12:piece lengthi16384e6:pieces" +
+           std::to_string(pieces.size()) + ":" + pieces + "ee";
+  };
+  auto oddRes =
+      torrentParser::parseContent(torrent(std::string(19, 'x'), "5"), decoder);
+  ASSERT_FALSE(oddRes);
+  ASSERT_EQ(oddRes.error(),
+            btc::error_code::piecesFieldLengthNonDivisibleBy20Err);
+
+  auto shortRes = torrentParser::parseContent(
+      torrent(std::string(20, 'x'), "16385"), decoder);
+  ASSERT_FALSE(shortRes);
+  ASSERT_EQ(shortRes.error(), btc::error_code::pieceCountMismatchErr);
+
+  auto exactRes = torrentParser::parseContent(
+      torrent(std::string(40, 'x'), "32768"), decoder);
+  ASSERT_OK(exactRes);
+  ASSERT_EQ(exactRes->getPieces().size(), 2u);
+
+  // Three files of the largest length overflow the total, which would wrap
+  // around to a small, consistent-looking one.
+  std::string huge = "d6:lengthi9223372036854775807e4:pathl1:aee";
+  auto overflowRes = torrentParser::parseContent(
+      "d8:announce15:http://a.b/anno4:infod5:filesl" + huge + huge + huge +
+          "e4:name4:test12:piece lengthi16384e6:pieces20:" +
+          std::string(20, 'x') + "ee",
+      decoder);
+  ASSERT_FALSE(overflowRes);
+  ASSERT_EQ(overflowRes.error(), btc::error_code::totalLengthOverflowErr);
+
+  // The piece count of a total near SIZE_MAX does not wrap to zero.
+  auto nearMaxRes = btc::PieceHashes::create("", 2, SIZE_MAX);
+  ASSERT_FALSE(nearMaxRes);
+  ASSERT_EQ(nearMaxRes.error(), btc::error_code::pieceCountMismatchErr);
+}
+
+TEST(TorrentFile, multiFilePathsKeepDirectories) {
+  std::string content = "d8:announce15:http://a.b/anno4:infod5:filesl"
+                        "d6:lengthi3e4:pathl3:sub5:a.txteed6:lengthi2e"
+                        "4:pathl1:x1:y5:b.bineee4:name4:test"
+                        "12:piece lengthi16384e6:pieces20:" +
+                        std::string(20, 'x') + "ee";
+
+  bencodeDecoder decoder;
+  auto fileRes = torrentParser::parseContent(content, decoder);
+  ASSERT_OK(fileRes);
+  ASSERT_TRUE(fileRes->getFiles());
+  ASSERT_EQ(fileRes->getFiles()->at(0).path,
+            std::filesystem::path("sub") / "a.txt");
+  ASSERT_EQ(fileRes->getFiles()->at(1).path,
+            std::filesystem::path("x") / "y" / "b.bin");
+  ASSERT_EQ(fileRes->getTotalLength(), 5u);
+}
+
+TEST(TorrentFile, unsafePathsAreRejected) {
+  auto torrent = [](std::string path, std::string name) {
+    return "d8:announce15:http://a.b/anno4:infod5:filesld6:lengthi3e4:path" +
+           path + "ee4:name" + name + "12:piece lengthi16384e6:pieces20:" +
+           std::string(20, 'x') + "ee";
+  };
+
+  bencodeDecoder decoder;
+  for (std::string path : {"l2:..6:escapee", "l4:/etce", "l1:.1:ae",
+                           "l0:1:ae", "l3:a/be", "le"}) {
+    auto fileRes = torrentParser::parseContent(torrent(path, "4:test"),
+                                               decoder);
+    ASSERT_FALSE(fileRes) << path;
+    ASSERT_EQ(fileRes.error(), btc::error_code::unsafeFilePathErr) << path;
+  }
+  for (std::string name : {"2:..", "1:.", "0:", "4:/etc"}) {
+    auto fileRes = torrentParser::parseContent(torrent("l1:ae", name),
+                                               decoder);
+    ASSERT_FALSE(fileRes) << name;
+    ASSERT_EQ(fileRes.error(), btc::error_code::unsafeFilePathErr) << name;
+  }
+  ASSERT_OK(torrentParser::parseContent(torrent("l1:ae", "4:test"), decoder));
+
+  auto emptyRes = torrentParser::parseContent(
+      "d8:announce15:http://a.b/anno4:infod5:filesle4:name4:test"
+      "12:piece lengthi16384e6:pieces0:ee",
+      decoder);
+  ASSERT_FALSE(emptyRes);
+  ASSERT_EQ(emptyRes.error(), btc::error_code::filesFieldEmptyErr);
+}